@@ -0,0 +1,129 @@
+/* Commit pipeline benchmark */
+/*                                                                       */
+/* For each durability mode and 1..256 concurrent clients, every client  */
+/* thread writes a record to one shared file and calls commit_sync(), as */
+/* the server's mutation paths do. Prints commits/s and the p50/p99      */
+/* commit_sync() latency. Each mode runs in its own process, since       */
+/* commit_init() configures the pipeline once.                           */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "./include/commit.h"
+#include "./include/metrics.h"
+
+#define MAX_CLIENTS 256
+#define MAX_SAMPLES 200000      // per client; later commits are counted, not timed
+#define RECORD_SIZE 64
+
+static int data_fd;
+static long run_until_usec;
+
+typedef struct {
+    int id;
+    long commits;
+    long samples;
+    long *latencies;
+} Client;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--seconds=N] [--group-max-batch=N] [--group-max-latency-us=N]\n"
+            "Writes commitbench.tmp in the current directory; run it on the data disk.\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static void *client_main(void *arg) {
+    Client *c = arg;
+    char record[RECORD_SIZE];
+    memset(record, 'x', sizeof(record));
+    off_t offset = (off_t)c->id * RECORD_SIZE;
+    long now;
+    while ((now = metrics_now_usec()) < run_until_usec) {
+        if (pwrite(data_fd, record, sizeof(record), offset) != (ssize_t)sizeof(record) ||
+            commit_sync(data_fd) != 0) {
+            perror("commit");
+            exit(EXIT_FAILURE);
+        }
+        if (c->samples < MAX_SAMPLES) c->latencies[c->samples++] = metrics_now_usec() - now;
+        c->commits++;
+    }
+    return NULL;
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *mode_name, int clients, int seconds) {
+    static Client c[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    run_until_usec = metrics_now_usec() + seconds * 1000000L;
+    for (int i = 0; i < clients; i++) {
+        c[i] = (Client){ i, 0, 0, malloc(MAX_SAMPLES * sizeof(long)) };
+        if (c[i].latencies == NULL || pthread_create(&threads[i], NULL, client_main, &c[i]) != 0) {
+            fprintf(stderr, "cannot start client %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    long commits = 0, samples = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        commits += c[i].commits;
+        samples += c[i].samples;
+    }
+
+    long *all = malloc(samples * sizeof(long));
+    if (all == NULL) exit(EXIT_FAILURE);
+    long used = 0;
+    for (int i = 0; i < clients; i++) {
+        memcpy(all + used, c[i].latencies, c[i].samples * sizeof(long));
+        used += c[i].samples;
+        free(c[i].latencies);
+    }
+    qsort(all, samples, sizeof(long), compare_long);
+    printf("%-7s %8d %12.0f %10ld %10ld\n", mode_name, clients, commits / (double)seconds,
+           samples ? all[samples / 2] : 0, samples ? all[(long)(samples * 0.99)] : 0);
+    fflush(stdout);
+    free(all);
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = 1;
+    CommitConfig config = { DURABILITY_STRICT, 64, 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--seconds=", 10) == 0)                    seconds = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--group-max-batch=", 18) == 0)       config.max_batch = atoi(argv[i] + 18);
+        else if (strncmp(argv[i], "--group-max-latency-us=", 23) == 0)  config.max_latency_us = atoi(argv[i] + 23);
+        else usage(argv[0]);
+    }
+    if (seconds <= 0) usage(argv[0]);
+
+    data_fd = open("commitbench.tmp", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (data_fd == -1) {
+        perror("commitbench.tmp");
+        return EXIT_FAILURE;
+    }
+    printf("%-7s %8s %12s %10s %10s\n", "mode", "clients", "commits/s", "p50 us", "p99 us");
+    const char *modes[] = { "strict", "group", "async" };
+    for (int m = 0; m < 3; m++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (parse_durability_mode(modes[m], &config.mode) != 0 || commit_init(&config) != 0) {
+                fprintf(stderr, "cannot start %s mode\n", modes[m]);
+                _exit(EXIT_FAILURE);
+            }
+            for (int clients = 1; clients <= MAX_CLIENTS; clients *= 2) run(modes[m], clients, seconds);
+            _exit(EXIT_SUCCESS);
+        }
+        if (pid == -1 || waitpid(pid, NULL, 0) != pid) return EXIT_FAILURE;
+    }
+    close(data_fd);
+    unlink("commitbench.tmp");
+    return 0;
+}
@@ -5,10 +5,14 @@
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <glob.h>
 #include "./include/types.h"
+#include "./include/format.h"
 
 #define DATA_DIR "data"
 
+static int data_version = DB_FORMAT_VERSION;   // taken from users.dat
+
 void print_user(User *u) {
     const char *role = u->role == ROLE_ADMIN   ? "ADMIN" :
                        u->role == ROLE_MANAGER ? "MANAGER" :
@@ -28,14 +32,12 @@ void print_account(Account *a) {
 }
 
 void print_transaction(TransactionRecord *t) {
-    char time_str[30];
+    char time_str[30], description[64];
     struct tm *tm = localtime(&t->timestamp);
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm);
-    // printf("  [TxID:%-3d] AccID:%-3d | %.2f | %s\n",
-    //        t->transactionID, t->accountID, t->amount, time_str);
+    describe_transaction(t, description, sizeof(description));
     printf("  [TxID:%-3d] AccID:%-3d | %.2f | %s | %s\n",
-           t->transactionID, t->accountID, t->amount, t->description, time_str);
-                  
+           t->transactionID, t->accountID, t->amount, description, time_str);
 }
 
 void print_loan(Loan *l) {
@@ -70,11 +72,28 @@ void print_session(Session *s) {
            s->user_id, time_str, s->session_active ? "YES" : "NO");
 }
 
-void dump_file(const char *filename, const char *title,
-               void (*printer)(void *), size_t record_size, size_t header_size) {
+// One data file: its v2 layout, and how to read the v1 layout it replaced
+typedef struct {
+    const char *filename;
+    const char *title;
+    void (*printer)(void *);
+    size_t record_size;
+    void (*upgrade)(const void *, void *);   // v1 record -> v2 record
+    size_t v1_record_size;
+    int has_header;                          // sessions.dat has none
+} Table;
+
+// Returns the format version of a headed file, 0 if it cannot be read
+int file_version(int fd) {
+    FileHeader hdr;
+    ssize_t n = pread(fd, &hdr, sizeof(hdr), 0);
+    if (n == sizeof(hdr) && hdr.magic == DB_MAGIC) return hdr.version;
+    return n >= (ssize_t)sizeof(HeaderV1) ? 1 : 0;
+}
+
+void dump_file(const Table *t) {
     char path[256];
-    snprintf(path, sizeof(path), "%s/%s", DATA_DIR, filename);
-    // snprintf(path, sizeof(path), "%s", filename);
+    snprintf(path, sizeof(path), "%s/%s", DATA_DIR, t->filename);
 
     int fd = open(path, O_RDONLY);
     if (fd == -1) {
@@ -82,17 +101,36 @@ void dump_file(const char *filename, const char *title,
         return;
     }
 
-    printf("=== %s ===\n", title);
+    // Waits out table-wide changes of a server run with --file-locks
+    struct flock lock = { .l_type = F_RDLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+    fcntl(fd, F_SETLKW, &lock);
+
+    int version = t->has_header ? file_version(fd) : data_version;
+    printf("=== %s (v%d) ===\n", t->title, version);
 
     // Skip header
-    lseek(fd, header_size, SEEK_SET);
+    off_t offset = !t->has_header ? 0 : version == 1 ? sizeof(HeaderV1) : sizeof(FileHeader);
+    size_t size = version == 1 ? t->v1_record_size : t->record_size;
+    FileHeader hdr;
+    if (version > 1 && t->has_header && pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+        hdr.record_size != t->record_size) {
+        printf("  (records are %u bytes, this build reads %zu; run ./migrate)\n\n",
+               (unsigned)hdr.record_size, t->record_size);
+        close(fd);
+        return;
+    }
+    lseek(fd, offset, SEEK_SET);
 
-    void *record = malloc(record_size);
+    void *raw = malloc(size);
+    void *record = malloc(t->record_size);
     int count = 0;
-    while (read(fd, record, record_size) == (ssize_t)record_size) {
-        printer(record);
+    while (version != 0 && read(fd, raw, size) == (ssize_t)size) {
+        if (version == 1) t->upgrade(raw, record);
+        else memcpy(record, raw, size);
+        t->printer(record);
         count++;
     }
+    free(raw);
     free(record);
     close(fd);
 
@@ -100,7 +138,76 @@ void dump_file(const char *filename, const char *title,
     printf("\n");
 }
 
+// Prints the written slots of a v1 or v2 run of transaction records
+int dump_transactions(int fd, int version) {
+    int count = 0;
+    if (version == 1) {
+        TransactionRecordV1 v1;
+        TransactionRecord t;
+        while (read(fd, &v1, sizeof(v1)) == (ssize_t)sizeof(v1)) {
+            upgrade_transaction(&v1, &t);
+            if (!(t.flags & RECORD_IN_USE)) continue;   // never-written slot
+            print_transaction(&t);
+            count++;
+        }
+    } else {
+        TransactionRecord t;
+        while (read(fd, &t, sizeof(t)) == (ssize_t)sizeof(t)) {
+            if (!(t.flags & RECORD_IN_USE)) continue;
+            print_transaction(&t);
+            count++;
+        }
+    }
+    return count;
+}
 
+// The transaction log is a directory of segments, each with its own header;
+// a v1 tree may still hold the single-file transactions.dat instead
+void dump_segments(const char *title) {
+    char pattern[256];
+    snprintf(pattern, sizeof(pattern), "%s/txlog/seg-*.dat", DATA_DIR);
+    glob_t files;
+    printf("=== %s ===\n", title);
+
+    int count = 0;
+    char legacy[256];
+    snprintf(legacy, sizeof(legacy), "%s/transactions.dat", DATA_DIR);
+    int fd = open(legacy, O_RDONLY);
+    if (fd != -1) {
+        printf("  -- transactions.dat (v1) --\n");
+        lseek(fd, sizeof(HeaderV1), SEEK_SET);
+        count += dump_transactions(fd, 1);
+        close(fd);
+    }
+
+    if (glob(pattern, 0, NULL, &files) == 0) {   // glob() sorts, so ids ascend
+        for (size_t i = 0; i < files.gl_pathc; i++) {
+            fd = open(files.gl_pathv[i], O_RDONLY);
+            if (fd == -1) continue;
+            SegmentHeader hdr;
+            SegmentHeaderV1 hdr_v1;
+            if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && hdr.magic == TXN_SEGMENT_MAGIC) {
+                printf("  -- segment %d (v%d, %s, %d slots, accounts %d..%d) --\n",
+                       hdr.segment_no, hdr.version, hdr.sealed ? "sealed" : "active",
+                       hdr.record_count, hdr.min_accountID, hdr.max_accountID);
+                lseek(fd, sizeof(hdr), SEEK_SET);
+                count += dump_transactions(fd, 2);
+            } else if (pread(fd, &hdr_v1, sizeof(hdr_v1), 0) == sizeof(hdr_v1) &&
+                       hdr_v1.magic == V1_SEGMENT_MAGIC) {
+                printf("  -- segment %d (v1, %s, %d slots, accounts %d..%d) --\n",
+                       hdr_v1.segment_no, hdr_v1.sealed ? "sealed" : "active",
+                       hdr_v1.record_count, hdr_v1.min_accountID, hdr_v1.max_accountID);
+                lseek(fd, sizeof(hdr_v1), SEEK_SET);
+                count += dump_transactions(fd, 1);
+            }
+            close(fd);
+        }
+        globfree(&files);
+    }
+
+    if (count == 0) printf("  (no records)\n");
+    printf("\n");
+}
 
 int main() {
     
@@ -109,12 +216,29 @@ int main() {
     printf("     BANKING SYSTEM DATABASE DUMP\n");
     printf("========================================\n\n");
 
-    dump_file("users.dat",       "USERS",          (void(*)(void*))print_user,       sizeof(User),       sizeof(UserHeader));
-    dump_file("accounts.dat",    "ACCOUNTS",       (void(*)(void*))print_account,    sizeof(Account),    sizeof(AccountHeader));
-    dump_file("transactions.dat","TRANSACTIONS",   (void(*)(void*))print_transaction,sizeof(TransactionRecord),sizeof(TransactionHeader));
-    dump_file("loans.dat",       "LOANS",          (void(*)(void*))print_loan,       sizeof(Loan),       sizeof(LoanHeader));
-    dump_file("feedback.dat",    "FEEDBACK",       (void(*)(void*))print_feedback,   sizeof(Feedback),   sizeof(FeedbackHeader));
-    dump_file("sessions.dat",    "SESSIONS",       (void(*)(void*))print_session,    sizeof(Session),    sizeof(LoanHeader));
+    const Table tables[] = {
+        { "users.dat",    "USERS",    (void(*)(void*))print_user,     sizeof(User),
+          (void(*)(const void*, void*))upgrade_user,     sizeof(UserV1),     1 },
+        { "accounts.dat", "ACCOUNTS", (void(*)(void*))print_account,  sizeof(Account),
+          (void(*)(const void*, void*))upgrade_account,  sizeof(AccountV1),  1 },
+        { "loans.dat",    "LOANS",    (void(*)(void*))print_loan,     sizeof(Loan),
+          (void(*)(const void*, void*))upgrade_loan,     sizeof(LoanV1),     1 },
+        { "feedback.dat", "FEEDBACK", (void(*)(void*))print_feedback, sizeof(Feedback),
+          (void(*)(const void*, void*))upgrade_feedback, sizeof(FeedbackV1), 1 },
+        { "sessions.dat", "SESSIONS", (void(*)(void*))print_session,  sizeof(Session),
+          (void(*)(const void*, void*))upgrade_session,  sizeof(SessionV1),  0 },
+    };
+
+    int fd = open(DATA_DIR "/users.dat", O_RDONLY);
+    if (fd != -1) {
+        data_version = file_version(fd);
+        close(fd);
+    }
+
+    dump_file(&tables[0]);
+    dump_file(&tables[1]);
+    dump_segments("TRANSACTIONS");
+    for (int i = 2; i < 5; i++) dump_file(&tables[i]);
 
     printf("Dump complete.\n\n");
     return 0;
@@ -0,0 +1,165 @@
+/* Deposit throughput benchmark */
+/*                                                                       */
+/* Runs deposit() in-process from 1..N client threads against a scratch  */
+/* data directory, through the same WAL, commit pipeline and history     */
+/* logger as the server. By default every client deposits into its own   */
+/* account; with --same-account all of them hit one account, which       */
+/* exercises the optimistic retry in commit_if_unchanged(). After each   */
+/* run the balances are read back and every successful deposit must be   */
+/* accounted for.                                                        */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "./include/types.h"
+#include "./include/database.h"
+#include "./include/transactions.h"
+#include "./include/commit.h"
+#include "./include/metrics.h"
+#include "./include/txlogger.h"
+
+#define MAX_CLIENTS 256
+
+static int same_account;
+static int reply_fd;
+static long run_until_usec;
+
+typedef struct {
+    int user_id;
+    long deposits;
+    long failures;
+} Client;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--clients=N[,N...]] [--seconds=N] [--same-account] [--durability=MODE]\n"
+            "Writes depositbench.tmp/ in the current directory and removes it afterwards.\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static void fail(const char *what) {
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+// A table file holding `count` records; open_id_counters() needs the header
+static void write_table(const char *path, size_t record_size, const void *records, int count) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) fail(path);
+    FileHeader header = { .magic = DB_MAGIC, .version = DB_FORMAT_VERSION,
+                          .record_size = record_size, .next_id = count, .record_count = count };
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, records, count * record_size) != (ssize_t)(count * record_size))
+        fail("write");
+    close(fd);
+}
+
+// One account per possible client, owned by user i
+static void write_tables(void) {
+    static Account accounts[MAX_CLIENTS];
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        accounts[i].accountID = i;
+        accounts[i].userID = i;
+        accounts[i].flags = RECORD_IN_USE;
+    }
+    write_table("data/users.dat", sizeof(User), NULL, 0);
+    write_table("data/accounts.dat", sizeof(Account), accounts, MAX_CLIENTS);
+    write_table("data/loans.dat", sizeof(Loan), NULL, 0);
+    write_table("data/feedback.dat", sizeof(Feedback), NULL, 0);
+}
+
+static double total_balance(void) {
+    double total = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Account a;
+        if (read_account(i, &a) != 0) fail("read_account");
+        total += a.balance;
+    }
+    return total;
+}
+
+static void *client_main(void *arg) {
+    Client *c = arg;
+    while (metrics_now_usec() < run_until_usec) {
+        if (deposit(c->user_id, 1.0, reply_fd) == 0) c->deposits++;
+        else c->failures++;
+    }
+    return NULL;
+}
+
+static void run(int clients, int seconds) {
+    static Client c[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    double before = total_balance();
+    run_until_usec = metrics_now_usec() + seconds * 1000000L;
+    for (int i = 0; i < clients; i++) {
+        c[i] = (Client){ same_account ? 0 : i, 0, 0 };
+        if (pthread_create(&threads[i], NULL, client_main, &c[i]) != 0) {
+            fprintf(stderr, "cannot start client %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    long deposits = 0, failures = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        deposits += c[i].deposits;
+        failures += c[i].failures;
+    }
+    // Deposits of 1.00 stay exact in a double, so the sum must match
+    double credited = total_balance() - before;
+    printf("%8d %12.0f %10ld %14.0f %s\n", clients, deposits / (double)seconds, failures,
+           credited, credited == (double)deposits ? "ok" : "MISMATCH");
+    fflush(stdout);
+    if (credited != (double)deposits) exit(EXIT_FAILURE);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st; (void)type; (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+    char counts[256] = "1,2,4,8,16,32,64,128,256";
+    int seconds = 2;
+    CommitConfig commit_config = { .mode = DURABILITY_GROUP, .max_batch = 64, .max_latency_us = 0 };
+    TxLoggerConfig logger_config = { .threaded = 1, .queue_capacity = 65536, .fsync_batches = 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--clients=", 10) == 0)          snprintf(counts, sizeof(counts), "%s", argv[i] + 10);
+        else if (strncmp(argv[i], "--seconds=", 10) == 0)     seconds = atoi(argv[i] + 10);
+        else if (strcmp(argv[i], "--same-account") == 0)      same_account = 1;
+        else if (strncmp(argv[i], "--durability=", 13) == 0) {
+            if (parse_durability_mode(argv[i] + 13, &commit_config.mode) != 0) usage(argv[0]);
+        }
+        else usage(argv[0]);
+    }
+    if (seconds <= 0) usage(argv[0]);
+
+    reply_fd = open("/dev/null", O_WRONLY);
+    if (reply_fd == -1) fail("/dev/null");
+    if (mkdir("depositbench.tmp", 0755) != 0 || chdir("depositbench.tmp") != 0 || mkdir("data", 0755) != 0)
+        fail("depositbench.tmp");
+    write_tables();
+    if (commit_init(&commit_config) != 0) fail("commit_init");
+    if (lock_data_dir() != 0) fail("lock_data_dir");
+    if (open_record_stores(0) != 0) fail("open_record_stores");
+    if (open_id_counters() != 0) fail("open_id_counters");
+    if (open_transaction_log() != 0) fail("open_transaction_log");
+    if (txlogger_start(&logger_config) != 0) fail("txlogger_start");
+    if (build_account_index() != 0) fail("build_account_index");
+
+    printf("%8s %12s %10s %14s\n", "clients", "deposits/s", "failed", "credited");
+    for (char *count = strtok(counts, ","); count != NULL; count = strtok(NULL, ",")) {
+        int clients = atoi(count);
+        if (clients <= 0 || clients > MAX_CLIENTS) usage(argv[0]);
+        run(clients, seconds);
+    }
+    if (checkpoint_transactions() != 0) fail("checkpoint_transactions");
+    if (chdir("..") != 0 || nftw("depositbench.tmp", remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0)
+        fail("removing depositbench.tmp");
+    return 0;
+}
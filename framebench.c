@@ -0,0 +1,161 @@
+/* Framing microbenchmark */
+/*                                                                       */
+/* Logs in one customer over one connection and times N BALANCE          */
+/* requests: framed, with up to --depth requests in flight, or one at a  */
+/* time over the text protocol (--text). Run against a live server.      */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "./include/frame.h"
+
+#define PORT 8080
+#define SERVER_IP "127.0.0.1"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s USER PASS [--requests=N] [--depth=D] [--text]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(const char *what) {
+    fprintf(stderr, "%s\n", what);
+    exit(EXIT_FAILURE);
+}
+
+// Framed replies received so far; counts FRAME_END frames in request order
+typedef struct {
+    char *data;
+    size_t len, capacity;
+    uint32_t next_id;        // id the next FRAME_END must carry
+} Replies;
+
+static uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Reads once and returns how many requests completed. The text of the
+// last reply completed goes to `last`, if given.
+static int read_replies(int sock, Replies *r, char *last, size_t last_len) {
+    if (r->capacity - r->len < 65536) {
+        r->capacity = r->capacity ? r->capacity * 2 : 1 << 20;
+        if ((r->data = realloc(r->data, r->capacity)) == NULL) fail("out of memory");
+    }
+    ssize_t n = read(sock, r->data + r->len, r->capacity - r->len);
+    if (n <= 0) fail("connection closed");
+    r->len += n;
+
+    int completed = 0;
+    size_t used = 0, text_len = 0;
+    while (r->len - used >= FRAME_REPLY_HEADER) {
+        const unsigned char *p = (const unsigned char *)r->data + used;
+        size_t size = 4 + (size_t)get_u32(p);
+        if (r->len - used < size) break;
+        if (p[8] == FRAME_DATA && last != NULL && text_len + size - FRAME_REPLY_HEADER < last_len) {
+            memcpy(last + text_len, p + FRAME_REPLY_HEADER, size - FRAME_REPLY_HEADER);
+            text_len += size - FRAME_REPLY_HEADER;
+            last[text_len] = '\0';
+        }
+        if (p[8] == FRAME_END) {
+            if (get_u32(p + 4) != r->next_id) fail("reply out of order");
+            r->next_id++;
+            completed++;
+        }
+        used += size;
+    }
+    memmove(r->data, r->data + used, r->len - used);
+    r->len -= used;
+    return completed;
+}
+
+static void send_frame(int sock, uint32_t id, uint16_t opcode, const char *const *fields, int count) {
+    char buf[512];
+    size_t len = frame_encode_request(buf, sizeof(buf), id, opcode, fields, count);
+    if (len == 0 || write(sock, buf, len) != (ssize_t)len) fail("write failed");
+}
+
+static double run_framed(int sock, const char *user, const char *pass, long requests, int depth) {
+    char login[160];
+    snprintf(login, sizeof(login), "CUSTOMER %s %s", user, pass);
+    const char *login_fields[] = { login };
+    Replies r = { NULL, 0, 0, 0 };
+    char reply[256] = "";
+    send_frame(sock, 0, OP_LOGIN, login_fields, 1);
+    while (read_replies(sock, &r, reply, sizeof(reply)) == 0)
+        ;
+    if (strstr(reply, "successful") == NULL) fail("login failed");
+
+    const char *none[] = { "" };
+    long sent = 0, done = 0;
+    double start = now_sec();
+    while (done < requests) {
+        while (sent < requests && sent - done < depth) {
+            send_frame(sock, (uint32_t)(sent + 1), OP_BALANCE, none, 1);
+            sent++;
+        }
+        done += read_replies(sock, &r, NULL, 0);
+    }
+    double elapsed = now_sec() - start;
+    // EXIT ends the session now, so the next run can log in again at once
+    send_frame(sock, (uint32_t)(sent + 1), OP_EXIT, none, 1);
+    while (read_replies(sock, &r, NULL, 0) == 0)
+        ;
+    free(r.data);
+    return elapsed;
+}
+
+static double run_text(int sock, const char *user, const char *pass, long requests) {
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "LOGIN CUSTOMER %s %s", user, pass);
+    ssize_t n;
+    if (write(sock, buf, strlen(buf)) < 0 || (n = read(sock, buf, sizeof(buf) - 1)) <= 0) fail("login failed");
+    buf[n] = '\0';
+    if (strstr(buf, "successful") == NULL) fail("login failed");
+    double start = now_sec();
+    for (long i = 0; i < requests; i++) {
+        if (write(sock, "BALANCE", 7) != 7 || read(sock, buf, sizeof(buf)) <= 0)
+            fail("connection closed");
+    }
+    double elapsed = now_sec() - start;
+    if (write(sock, "EXIT", 4) != 4 || read(sock, buf, sizeof(buf)) <= 0) fail("connection closed");
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    long requests = 100000;
+    int depth = 1, text = 0, positional = 0;
+    const char *user = NULL, *pass = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--requests=", 11) == 0) requests = atol(argv[i] + 11);
+        else if (strncmp(argv[i], "--depth=", 8) == 0) depth = atoi(argv[i] + 8);
+        else if (strcmp(argv[i], "--text") == 0)       text = 1;
+        else if (positional == 0 && ++positional)      user = argv[i];
+        else if (positional == 1 && ++positional)      pass = argv[i];
+        else usage(argv[0]);
+    }
+    if (positional != 2 || requests <= 0 || depth <= 0) usage(argv[0]);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(PORT) };
+    inet_pton(AF_INET, SERVER_IP, &addr.sin_addr);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) fail("connect failed");
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    double elapsed = text ? run_text(sock, user, pass, requests)
+                          : run_framed(sock, user, pass, requests, depth);
+    printf("%s depth %d: %ld requests in %.3f s, %.0f requests/s\n",
+           text ? "text" : "framed", text ? 1 : depth, requests, elapsed, requests / elapsed);
+    close(sock);
+    return 0;
+}
@@ -8,5 +8,7 @@ int viewAllUsers(int socket_fd);
 int deactivateUser(int admin_id, int socket_fd);
 int reactivateUser(int admin_id, int socket_fd);
 int viewSystemLogs(int socket_fd);
+int archiveTransactions(int socket_fd);
+int endOfDay(int socket_fd);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+#include <stddef.h>
+#include "types.h"
+#include "session.h"
+
+// Arguments a command takes on its command line, after the command word.
+// They are parsed once, in command_run(), before the handler is called.
+enum ArgSchema {
+    ARGS_NONE,                // anything after the word is ignored
+    ARGS_IDEMPOTENCY_KEY,     // optional KEY=<key>
+    ARGS_TWO_IDS,             // <id> <id>
+    ARGS_REST                 // the rest of the line, unparsed
+};
+
+typedef struct {
+    char key[64];             // ARGS_IDEMPOTENCY_KEY; "" without one
+    int ids[2];               // ARGS_TWO_IDS; 0 when missing
+    const char *rest;         // ARGS_REST; never NULL
+} CommandArgs;
+
+// Returns -1 once the session is over (EXIT), else 0
+typedef int (*CommandHandler)(ClientSession *s, const CommandArgs *args);
+
+typedef struct {
+    int opcode;               // enum Opcode; its name is the text command
+    unsigned roles;           // ROLE_BIT() of every role allowed to run it
+    enum ArgSchema args;
+    int inputs;               // further messages read, or SESSION_INTERACTIVE
+    CommandHandler handler;
+} Command;
+
+#define ROLE_BIT(role) (1u << (role))
+
+int commands_init(void);
+const Command *command_lookup(const char *name, size_t len, enum Role role);
+const Command *command_for_opcode(int opcode, enum Role role);
+int command_run(const Command *c, ClientSession *s, const char *args);
+
+#endif
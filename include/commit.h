@@ -0,0 +1,21 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+enum DurabilityMode {
+    DURABILITY_STRICT,   // fsync on the caller's thread, one per operation
+    DURABILITY_GROUP,    // committer thread batches concurrent fsyncs; caller waits
+    DURABILITY_ASYNC     // committer flushes in the background; caller does not wait
+};
+
+typedef struct {
+    enum DurabilityMode mode;
+    int max_batch;        // flush as soon as this many syncs are queued
+    int max_latency_us;   // longest a queued sync waits for the batch to fill
+} CommitConfig;
+
+int commit_init(const CommitConfig *config);
+enum DurabilityMode commit_mode(void);
+int commit_sync(int fd);
+int parse_durability_mode(const char *name, enum DurabilityMode *mode);
+
+#endif
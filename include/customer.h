@@ -3,10 +3,12 @@
 #include "types.h"
 
 int getBalance(int customer_id, int socket_fd);
+int getBalanceAt(int customer_id, int socket_fd);
 
 int addFeedback(int customer_id, int socket_fd);
 int applyLoan(int customer_id, int socket_fd);
 int viewTransactionHistory(int user_id, int socket_fd);
-int transferFunds(int customer_id, int socket_fd);
+int transferFunds(int customer_id, const char *recipient_username, double amount, int socket_fd);
 int exitCustomer(int customer_id, int socket_fd);
+int end_session(int user_id);
 #endif
\ No newline at end of file
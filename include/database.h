@@ -1,12 +1,45 @@
 #ifndef DATABASE_H
 #define DATABASE_H
+#include <sys/types.h>
 #include "types.h"
 
-int fetch_and_increment_id(int fd);
+// Tables with their own id sequence
+enum DbTable {
+    TABLE_USERS,
+    TABLE_ACCOUNTS,
+    TABLE_LOANS,
+    TABLE_FEEDBACK,
+    TABLE_COUNT
+};
+
+int lock_data_dir(void);
+int open_record_stores(int use_mmap);
+int save_user(const User *user);
+int save_account(const Account *account);
+int put_account(const Account *account);
+int read_account(int account_id, Account *out);
+int read_account_range(int first_id, int count, Account *out);
+int sync_accounts(void);
+int read_user_record(int idx, User *out);
+int append_loan(const Loan *loan);
+int read_loan_record(int idx, Loan *out);
+int save_loan_record(int idx, const Loan *loan);
+int append_feedback(const Feedback *feedback);
+int read_feedback_record(int idx, Feedback *out);
+int read_session_record(int idx, Session *out);
+int save_session_record(int idx, const Session *session);
+int open_id_counters(void);
+int fetch_and_increment_id(enum DbTable table);
+int table_record_count(enum DbTable table);
 Account *find_account_by_user_id(int user_id);
 User *find_user_by_username(const char *username);
 User *find_user_by_id(int id);
-int lock_file(const char *filename, int type);
-int unlock_file(int fd);
+User *lock_user_by_username(const char *username);
+int build_user_index(void);
+int index_user(const User *u);
+int unindex_username(const char *username);
+int build_account_index(void);
+int index_account(const Account *account);
+int account_id_for_user(int user_id);
 
 #endif
\ No newline at end of file
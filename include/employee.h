@@ -7,6 +7,7 @@ int editCustomerDetails(int socket_fd);
 int approveRejectLoans(int employee_id, int socket_fd);
 int viewAssignedLoanApplications(int employee_id, int socket_fd);
 int viewCustomerTransactions(int socket_fd);
+int viewBalanceAt(int socket_fd);
 
 int assignLoanToEmployee(int manager_id, int loan_id, int employee_id, int socket_fd);
 int viewAllFeedback(int socket_fd);
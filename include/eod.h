@@ -0,0 +1,27 @@
+#ifndef EOD_H
+#define EOD_H
+#include <stddef.h>
+
+// End-of-day batch: accrues a day's interest on every positive balance and
+// charges the maintenance fee, as one TXN_END_OF_DAY record per account.
+typedef struct {
+    int business_date;        // YYYYMMDD; each date is posted at most once
+    double annual_rate_pct;   // a day accrues rate / 365 of the balance
+    double fee;               // per account; never takes a balance below zero
+    int workers;              // 0 = one per CPU
+} EodConfig;
+
+typedef struct {
+    long accounts_total;
+    long accounts_done;
+    long postings;
+    double interest_total;
+    double fees_total;
+} EodProgress;
+
+typedef void (*eod_progress_fn)(const EodProgress *progress, void *arg);
+
+int run_end_of_day(const EodConfig *config, eod_progress_fn report, void *arg,
+                   EodProgress *result, char *error, size_t len);
+
+#endif
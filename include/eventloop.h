@@ -0,0 +1,10 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+// Event-loop I/O model: a few threads, each with its own epoll set, serve
+// every connection from non-blocking sockets instead of a thread apiece.
+// Once a connection's whole request has arrived it is queued for the
+// worker pool (workpool_start() first), or refused if the queue is full.
+int eventloop_run(int server_fd, int io_threads);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+#include <stddef.h>
+#include "types.h"
+#include "types_v1.h"
+
+// Display text for a v2 transaction record, which stores only its type
+void describe_transaction(const TransactionRecord *transaction, char *buf, size_t len);
+
+// v1 -> v2 record conversion, shared by ./migrate and dbdump
+void upgrade_user(const UserV1 *in, User *out);
+void upgrade_account(const AccountV1 *in, Account *out);
+void upgrade_transaction(const TransactionRecordV1 *in, TransactionRecord *out);
+void upgrade_loan(const LoanV1 *in, Loan *out);
+void upgrade_feedback(const FeedbackV1 *in, Feedback *out);
+void upgrade_session(const SessionV1 *in, Session *out);
+
+// Narrow v2 Account (16-bit version) -> current Account, for ./migrate and WAL replay
+void widen_account(const AccountV2Narrow *in, Account *out);
+
+#endif
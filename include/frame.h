@@ -0,0 +1,90 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Framed wire protocol. Integers are big-endian.
+//
+//   request:  u32 length | u32 request_id | u16 opcode | u16 field_count
+//             | field_count x (u32 field_length | bytes)
+//   reply:    u32 length | u32 request_id | u8 kind | bytes
+//
+// `length` counts the bytes after itself. Field 0 holds the arguments
+// that follow the command name in the text protocol ("CUSTOMER bob pw"
+// for LOGIN, "KEY=k1" or nothing for DEPOSIT); the other fields are the
+// inputs the command reads, in order. A request is answered by zero or
+// more FRAME_DATA replies, then one FRAME_END, all carrying its id.
+// Requests may be pipelined; a connection's requests run in order.
+//
+// A framed connection's first byte is the top byte of a length under
+// FRAME_MAX, so always 0; a text-protocol connection never starts with 0.
+#define FRAME_MAX (4 << 20)
+#define FRAME_MAX_FIELDS 8
+#define FRAME_REQUEST_HEADER 12
+#define FRAME_REPLY_HEADER 9
+
+enum FrameKind {
+    FRAME_DATA = 0,           // part of the reply text
+    FRAME_END = 1             // reply complete
+};
+
+enum Opcode {
+    OP_LOGIN = 1,
+    OP_EXIT,
+    OP_BALANCE,
+    OP_BALANCE_AT,
+    OP_DEPOSIT,
+    OP_WITHDRAW,
+    OP_TRANSFER,
+    OP_BEGIN,
+    OP_COMMIT,
+    OP_ABORT,
+    OP_TRANSFER_BATCH,
+    OP_LOAN,
+    OP_FEEDBACK,
+    OP_HISTORY,
+    OP_ADD_CUST,
+    OP_EDIT_CUST,
+    OP_LOAN_DECIDE,
+    OP_MY_LOANS,
+    OP_CUST_TRANS,
+    OP_ASSIGN_LOAN,
+    OP_VIEW_FEEDBACK,
+    OP_VIEW_USERS,
+    OP_ADD_EMP,
+    OP_ADD_MGR,
+    OP_DEACTIVATE,
+    OP_REACTIVATE,
+    OP_VIEW_LOGS,
+    OP_ARCHIVE_TXNS,
+    OP_EOD,
+    OP_COUNT
+};
+
+typedef struct {
+    uint32_t request_id;
+    uint16_t opcode;
+    int field_count;
+    const char *fields[FRAME_MAX_FIELDS];   // point into the buffer, not terminated
+    uint32_t field_lengths[FRAME_MAX_FIELDS];
+} Frame;
+
+// Bytes received on a framed connection, not yet handled
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} FrameBuffer;
+
+const char *opcode_name(int opcode);
+int frame_parse(const char *buf, size_t len, Frame *frame);
+size_t frame_encode_request(char *buf, size_t capacity, uint32_t request_id, uint16_t opcode,
+                            const char *const *fields, int field_count);
+void frame_encode_reply_header(char *header, uint32_t request_id, enum FrameKind kind,
+                               size_t payload_len);
+ssize_t frame_buffer_read(FrameBuffer *b, int fd);
+void frame_buffer_consume(FrameBuffer *b, size_t n);
+void frame_buffer_free(FrameBuffer *b);
+
+#endif
@@ -1,8 +1,36 @@
 #ifndef HELPERS_H
 #define HELPERS_H
+#include <stdint.h>
 #include "types.h"
 
+// Sent instead of running a request when the server has no room to queue it
+#define SERVER_BUSY_REPLY "Server busy, try again\n"
+
+// A response being assembled for one connection. Report functions add
+// their rows here and flush once at the end, so a long listing costs a
+// few large writes instead of one write per row.
+#define OUTBUF_SIZE 16384
+typedef struct {
+    int fd;
+    int raw;                  // write to fd even while replies are framed or captured
+    size_t used;
+    char data[OUTBUF_SIZE];
+} OutBuf;
+
+void outbuf_init(OutBuf *out, int socket_fd);
+void outbuf_puts(OutBuf *out, const char *text);
+void outbuf_printf(OutBuf *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+int outbuf_flush(OutBuf *out);
+
 void send_response(int socket_fd, const char *message);
+void flush_responses(void);
+void capture_responses(char *buf, size_t len);
+void stop_capture(void);
+void feed_input(const char *const *messages, int count);
+void stop_input(void);
+void frame_replies(int socket_fd, uint32_t request_id);
+void end_frame_replies(void);
 int read_username_from_socket(int socket_fd, char *username, size_t max_len);
 int read_string_from_socket(int socket_fd, char *buffer, size_t max_len);
 double read_amount_from_socket(int socket_fd);
@@ -0,0 +1,31 @@
+#ifndef IDEMPOTENCY_H
+#define IDEMPOTENCY_H
+#include <stddef.h>
+#include "types.h"
+
+// Replay cache for money-moving commands that carry a client-supplied key.
+// The first request with a (user, key) pair runs; any later one gets the
+// reply the first one got. The most recent IDEMPOTENCY_SLOTS keys are kept,
+// in memory and in data/idempotency.dat, so they survive a restart. A key
+// whose request moved money is also written in that commit's WAL entry.
+#define IDEMPOTENCY_SLOTS 16384
+
+enum IdempotencyStatus {
+    IDEMPOTENCY_NEW,        // caller runs the request, then calls idempotency_finish()
+    IDEMPOTENCY_REPLAY,     // already done: the stored reply was copied out
+    IDEMPOTENCY_CONFLICT,   // key was used for a different request
+    IDEMPOTENCY_BUSY        // every slot holds a running request; retry later
+};
+
+int idempotency_open(const char *path);
+int idempotency_valid_key(const char *key);
+enum IdempotencyStatus idempotency_begin(int user_id, const char *key, const char *request,
+                                         char *reply, size_t len);
+void idempotency_arm(int user_id, const char *key, const char *reply);
+const IdempotencyRecord *idempotency_take_armed(void);
+void idempotency_logged(void);
+int idempotency_put(const IdempotencyRecord *record);
+int idempotency_sync(void);
+int idempotency_finish(int user_id, const char *key, const char *reply);
+
+#endif
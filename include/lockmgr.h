@@ -0,0 +1,40 @@
+#ifndef LOCKMGR_H
+#define LOCKMGR_H
+
+// In-process locks shared by all handler threads. A table lock orders
+// whole-file work (inserts that must check uniqueness, full scans); a
+// record lock covers one id. The two are independent: record updates
+// rewrite a slot in place and never conflict with a table-level insert.
+// Lock order is record before table, never the reverse.
+enum LockTable {
+    LOCK_USERS,
+    LOCK_ACCOUNTS,
+    LOCK_LOANS,
+    LOCK_FEEDBACK,
+    LOCK_SESSIONS,
+    LOCK_TABLE_COUNT
+};
+
+// Record ids that are equal modulo LOCK_STRIPES share one lock. Bulk jobs
+// that split ids by stripe never contend with each other.
+#define LOCK_STRIPES 1024
+
+enum LockMode {
+    LOCK_SHARED,
+    LOCK_EXCLUSIVE
+};
+
+// Also mirror table locks as fcntl locks on the table's data file, so other
+// processes (dbdump) can wait for table-wide changes. Off by default.
+void lockmgr_use_file_locks(int enable);
+
+int lock_table(enum LockTable table, enum LockMode mode);
+int unlock_table(enum LockTable table);
+int lock_record(enum LockTable table, int id, enum LockMode mode);
+int unlock_record(enum LockTable table, int id);
+int lock_record_pair(enum LockTable table, int id1, int id2, enum LockMode mode);
+int unlock_record_pair(enum LockTable table, int id1, int id2);
+int lock_record_set(enum LockTable table, const int *ids, int count, enum LockMode mode);
+int unlock_record_set(enum LockTable table, const int *ids, int count);
+
+#endif
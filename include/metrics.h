@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Monotonic counters
+enum Metric {
+    METRIC_COMMITS,           // durable commits requested
+    METRIC_COMMIT_BATCHES,    // flushes issued by the committer thread
+    METRIC_VERSION_CONFLICTS, // optimistic account updates rebuilt after a lost race
+    METRIC_TXLOG_BATCHES,     // batches written by the transaction logger thread
+    METRIC_TXLOG_DROPS,       // records the logger queue had no room for (written inline)
+    METRIC_REQUESTS_REJECTED, // requests answered "server busy" by a full worker queue (either pool)
+    METRIC_COUNT
+};
+
+// Point-in-time values; reports show the latest and the highest seen
+enum Gauge {
+    GAUGE_TXLOG_QUEUE_DEPTH,  // records waiting for the transaction logger
+    GAUGE_CONNECTIONS,        // open client connections
+    GAUGE_REQUEST_QUEUE,      // requests waiting for a worker thread
+    GAUGE_INTERACTIVE_QUEUE,  // prompt-driven requests waiting for an interactive worker
+    GAUGE_COUNT
+};
+
+// Latency distributions, recorded in microseconds
+enum LatencyMetric {
+    LATENCY_COMMIT,           // commit_sync() call to durable
+    LATENCY_REQUEST,          // request fully received to handled
+    LATENCY_QUEUE_WAIT,       // request queued to picked up by a worker
+    LATENCY_COUNT
+};
+
+void metrics_add(enum Metric metric, long n);
+void metrics_set(enum Gauge gauge, long value);
+void metrics_gauge_add(enum Gauge gauge, long delta);
+void metrics_observe(enum LatencyMetric metric, long usec);
+void metrics_observe_command(int opcode, long usec);
+long metrics_now_usec(void);
+int metrics_report(char *buf, size_t len);
+int metrics_start_reporter(const char *path, int interval_sec);
+
+#endif
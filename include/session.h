@@ -0,0 +1,29 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include "types.h"
+#include "transactions.h"
+#include "frame.h"
+
+// One connection's protocol state, from LOGIN to EXIT. A handler thread
+// keeps it on its stack; the event loop keeps one per connection and
+// hands it one request at a time.
+typedef struct {
+    int fd;
+    int logged_in;
+    int user_id;
+    enum Role role;
+    MultiTxn txn;            // operations queued since BEGIN
+    int in_transaction;
+} ClientSession;
+
+// session_input_fields() result for requests that reply before reading
+// their input (prompts, TRANSFER_BATCH bodies)
+#define SESSION_INTERACTIVE -1
+
+void session_init(ClientSession *s, int fd);
+int session_input_fields(const ClientSession *s, const char *request);
+int session_handle(ClientSession *s, char *request);
+int session_handle_frame(ClientSession *s, const Frame *frame);
+void session_close(ClientSession *s, int disconnected);
+
+#endif
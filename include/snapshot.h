@@ -0,0 +1,14 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <time.h>
+
+// Periodic snapshots of every account's balance, and point-in-time balance
+// queries answered from the nearest earlier snapshot plus the account's
+// transactions committed after it.
+int snapshot_open(const char *dir);
+int snapshot_take(void);
+int snapshot_start(int interval_sec, int keep);
+int balance_at(int account_id, time_t when, double *balance);
+int parse_point_in_time(const char *text, time_t *when);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef STORE_H
+#define STORE_H
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Fixed-record file: a header followed by an array of equally sized records.
+// In mmap mode the file is mapped MAP_SHARED and records are read by pointer;
+// otherwise every access is a pread/pwrite on the long-lived fd.
+typedef struct {
+    int fd;
+    size_t header_size;
+    size_t record_size;
+    int use_mmap;
+    char *map;              // mmap mode only
+    size_t map_len;         // reserved mapping length (>= file_size)
+    off_t file_size;        // last known size of the file
+    pthread_rwlock_t lock;  // guards map/map_len/file_size against remaps
+} RecordStore;
+
+int store_open(RecordStore *s, const char *path, size_t header_size, size_t record_size, int use_mmap);
+void store_close(RecordStore *s);
+int store_count(RecordStore *s);
+int store_read(RecordStore *s, int idx, void *out);
+int store_read_range(RecordStore *s, int idx, int count, void *out);
+int store_put(RecordStore *s, int idx, const void *record);
+int store_write(RecordStore *s, int idx, const void *record);
+int store_append(RecordStore *s, const void *record);
+int store_sync(RecordStore *s);
+
+#endif
@@ -1,11 +1,50 @@
 #ifndef TRANSACTIONS_H
 #define TRANSACTIONS_H
+#include "types.h"
 
 int withdraw(int user_id, double amount, int socket_fd);
 int deposit(int user_id, double amount, int socket_fd);
-int log_transaction(int account_id, const char *description, double amount, double new_balance);
-int transferFunds(int customer_id, int socket_fd);
-int update_account(int fd, Account *account, double new_balance);
+int log_transaction(int account_id, enum TransactionType type, double amount, double new_balance);
+int transferFunds(int customer_id, const char *recipient_username, double amount, int socket_fd);
+int transferBatch(int customer_id, int socket_fd, const char *pending);
+int open_transaction_log(void);
+void prepare_transaction(TransactionRecord *transaction, int account_id,
+                         enum TransactionType type, double amount, double new_balance);
+int commit_postings(Account *accounts, int account_count,
+                    TransactionRecord *transactions, int transaction_count);
+int build_history_index(void);
+int transaction_ids_for_account(int account_id, int **ids);
+int transaction_ids_after(int account_id, int after_id, int **ids);
+int read_transaction(int transaction_id, TransactionRecord *out);
+int archive_transactions(time_t cutoff);
+int checkpoint_transactions(void);
+int at_commit_boundary(int (*fn)(int last_transaction_id, void *arg), void *arg);
+
+// Operations queued between BEGIN and COMMIT. COMMIT applies them in
+// order, all or nothing, as one WAL entry.
+#define MULTI_TXN_MAX_OPS 4096     // 2 records per transfer must fit one WAL entry
+
+typedef struct {
+    enum TransactionType type;     // TXN_DEPOSIT, TXN_WITHDRAWAL or TXN_TRANSFER_OUT
+    int account_id;
+    int counterparty_id;           // payee of a transfer, -1 otherwise
+    double amount;
+} TxnOperation;
+
+typedef struct {
+    TxnOperation *ops;
+    int count;
+    int capacity;
+} MultiTxn;
+
+void multi_txn_init(MultiTxn *txn);
+void multi_txn_clear(MultiTxn *txn);
+int multi_txn_add(MultiTxn *txn, enum TransactionType type, int account_id,
+                  int counterparty_id, double amount);
+int multi_txn_commit(const MultiTxn *txn, char *error, size_t len);
+int queueOperation(MultiTxn *txn, int customer_id, const char *cmd,
+                   const char *recipient_username, double amount, int socket_fd);
+int commitTransaction(MultiTxn *txn, int socket_fd);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef TXLOG_H
+#define TXLOG_H
+#include <time.h>
+#include "types.h"
+
+// Segmented transaction log. Transaction #n lives at a fixed slot of
+// segment n / TXN_SEGMENT_RECORDS; every segment below the one holding
+// next_id is sealed at a checkpoint and never written again.
+#define TXLOG_ANY_ACCOUNT -1
+
+typedef int (*txlog_visit_fn)(const TransactionRecord *transaction, void *arg);
+
+int txlog_open(const char *dir);
+int txlog_next_id(void);
+int txlog_last_id(void);
+int txlog_write(const TransactionRecord *transaction);
+int txlog_write_batch(const TransactionRecord *transactions, int count);
+int txlog_read(int transaction_id, TransactionRecord *out);
+int txlog_sync(void);
+int txlog_seal(void);
+int txlog_scan(time_t from, time_t to, int account_id, txlog_visit_fn visit, void *arg);
+int txlog_archive_before(time_t cutoff);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TXLOGGER_H
+#define TXLOGGER_H
+#include "types.h"
+
+// Writes committed TransactionRecords to the segment log. The WAL already
+// holds every record, so this only decides which thread pays for the
+// history I/O and how soon the segment files reach disk.
+typedef struct {
+    int threaded;         // 0: write on the committing thread; 1: logger thread
+    int queue_capacity;   // records the queue holds (rounded up to a power of two)
+    int fsync_batches;    // fsync the segments after every batch, not just at checkpoints
+} TxLoggerConfig;
+
+int txlogger_start(const TxLoggerConfig *config);
+int txlogger_submit(const TransactionRecord *transactions, int count);
+int txlogger_drain(void);
+long txlogger_depth(void);
+
+#endif
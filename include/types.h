@@ -2,11 +2,11 @@
 #define TYPES_H
 
 #include <time.h>
+#include <stdint.h>
 
 #define MAX_USERNAME_LEN 50
 #define MAX_PASSWORD_LEN 64  // For hashed password
 #define MAX_FEEDBACK_LEN 100
-#define MAX_DESCRIPTION_LEN 100
 
 enum Role {
     ROLE_CUSTOMER,
@@ -21,30 +21,43 @@ enum LoanStatus {
     LOAN_REJECTED
 };
 
-// TRANSACTION [unused]
+// Stored instead of a description; the text is rendered for display only
+enum TransactionType {
+    TXN_DEPOSIT,
+    TXN_WITHDRAWAL,
+    TXN_TRANSFER_OUT,        // debit half of a transfer; counterpartyID is the payee
+    TXN_TRANSFER_IN,         // credit half of a transfer; counterpartyID is the payer
+    TXN_END_OF_DAY           // net interest less fees; counterpartyID is the business date (YYYYMMDD)
+};
+
+/* On-disk format v2 (v1 layouts live in types_v1.h, for ./migrate).      */
+/* Every headed data file starts with a FileHeader; records are packed    */
+/* with the widest fields first and carry no padding beyond alignment.    */
+#define DB_MAGIC 0x42444D42u          // "BMDB"
+#define DB_FORMAT_VERSION 2
+
+#define RECORD_IN_USE 0x01            // flags: slot holds a written record
+
 typedef struct {
-    time_t timestamp;
-    char description[100];  // e.g., "Deposit 1000"
-    double amount;
-    double new_balance;
-} Transaction;
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;    // sizeof the file's record type, checked on open
+    int next_id;             // For auto-increment
+    int record_count;
+} FileHeader;
 
 // USER
 typedef struct {
+    time_t last_login;       // Timestamp for session tracking
     int id;                  // Unique auto-incrementing ID (Primary key)
+    uint8_t role;            // enum Role
+    uint8_t active;          // 1 = active, 0 = deactivated (for managers)
+    uint8_t flags;
     char username[MAX_USERNAME_LEN];
     char password_hash[MAX_PASSWORD_LEN];
-    enum Role role;
-    int active;              // 1 = active, 0 = deactivated (for managers)
-    time_t last_login;       // Timestamp for session tracking
-    char reserved[100];      // Padding for future use
 } User;
 
-// USER File Header (written at start of file)
-typedef struct {
-    int next_id;             // For auto-increment
-    int record_count;
-} UserHeader;
+typedef FileHeader UserHeader;
 
 // ACCOUNTS
 typedef struct {
@@ -52,71 +65,148 @@ typedef struct {
     int userID;             // Foreign key
     double balance;
     int transaction_count;
-    char reserved[100];      // Padding
+    uint8_t flags;
+    uint32_t version;       // bumped by every commit; too wide to wrap back to a stale snapshot's
+    uint32_t opened;        // creation time, Unix seconds; 0 for accounts opened before it was kept
 } Account;
 
-// ACCOUNT File Header
+// Account as written before version was widened (record_size 24). Found in
+// older v2 accounts.dat files, which ./migrate widens, and in WAL2/WAL3
+// entries, which replay widens with widen_account().
 typedef struct {
-    int next_id;
-    int record_count;
-} AccountHeader;
+    int accountID;
+    int userID;
+    double balance;
+    int transaction_count;
+    uint8_t flags;
+    uint16_t version;
+} AccountV2Narrow;
+
+typedef FileHeader AccountHeader;
 
 // TRANSACTIONS RECORD
 typedef struct {
     int transactionID;      // Unique global ID
     int accountID;          // Foreign key
     time_t timestamp;
-    char description[MAX_DESCRIPTION_LEN];  // e.g., "Deposit 1000"
     double amount;
     double new_balance;
-    char reserved[100];      // Padding
+    uint8_t type;           // enum TransactionType
+    uint8_t flags;
+    int counterpartyID;     // other account of a transfer, -1 if none
 } TransactionRecord;
 
-// TRANSACTIONS File Header
+// TRANSACTION LOG SEGMENTS (data/txlog/seg-NNNNNN.dat)
+// Segment n holds transactions n * TXN_SEGMENT_RECORDS onwards, one
+// TransactionRecord per slot after the header.
+#define TXN_SEGMENT_RECORDS 65536
+#define TXN_SEGMENT_MAGIC 0x32474553u   // "SEG2"
+
 typedef struct {
-    int next_id;
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    int segment_no;
+    int sealed;              // 1 once no further record can be written
     int record_count;
-} TransactionHeader;
+    time_t min_timestamp;    // bounds over the segment's records, for pruning
+    time_t max_timestamp;
+    int min_accountID;
+    int max_accountID;
+} SegmentHeader;
 
 // LOANS
 typedef struct {
     int loanID;             // Unique ID
     int custID;    // Foreign key to Users (customer)
     double amount;
-    enum LoanStatus status;
-    int assigned_employeeID; // Foreign key to Users (employee), 0 if unassigned
     time_t application_date;
     time_t decision_date;
-    char reserved[100];
+    int assigned_employeeID; // Foreign key to Users (employee), 0 if unassigned
+    uint8_t status;          // enum LoanStatus
+    uint8_t flags;
 } Loan;
 
-// LOANS File Header
-typedef struct {
-    int next_id;
-    int record_count;
-} LoanHeader;
+typedef FileHeader LoanHeader;
 
 // FEEDBACK
 typedef struct {
+    time_t timestamp;
     int feedbackID;         // Unique ID
     int custID;
-    time_t timestamp;
     char message[MAX_FEEDBACK_LEN];
-    char reserved[100];      // Padding
 } Feedback;
 
-// File Header
-typedef struct {
-    int next_id;
-    int record_count;
-} FeedbackHeader;
+typedef FileHeader FeedbackHeader;
 
-// SESSION
+// SESSION (sessions.dat has no header)
 typedef struct {
-    int user_id;
     time_t login_time;
-    int session_active;      // 1 = active
-    char reserved[100];      // Padding
+    int user_id;
+    uint8_t session_active;  // 1 = active
 } Session;
 
+// IDEMPOTENCY KEYS (data/idempotency.dat)
+// A ring of the most recent keyed money-moving requests and the reply each
+// one got. Slot i holds the record whose sequence % slot count == i.
+#define IDEMPOTENCY_KEY_LEN 33        // 32 characters plus the terminator
+#define IDEMPOTENCY_REQUEST_LEN 80
+#define IDEMPOTENCY_REPLY_LEN 64
+
+typedef struct {
+    uint64_t sequence;       // order in which keys were first seen
+    time_t created;
+    int userID;              // keys are scoped to the user who sent them
+    uint8_t flags;
+    char key[IDEMPOTENCY_KEY_LEN];
+    char request[IDEMPOTENCY_REQUEST_LEN];   // command and arguments, to refuse a reused key
+    char reply[IDEMPOTENCY_REPLY_LEN];
+} IdempotencyRecord;
+
+typedef FileHeader IdempotencyHeader;
+
+// END-OF-DAY STATE (data/eod.dat)
+// The last end-of-day run and, while one is unfinished, how far each of
+// its workers got, so a restarted run resumes instead of posting twice.
+#define EOD_MAGIC 0x32444F45u         // "EOD2"
+#define EOD_MAX_WORKERS 64
+
+enum EodRunState {
+    EOD_IDLE,
+    EOD_RUNNING,
+    EOD_DONE
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t workers;        // partition count of the run; a resume keeps it
+    int business_date;       // YYYYMMDD
+    int state;               // enum EodRunState
+    double annual_rate_pct;
+    double fee;
+    int next_block[EOD_MAX_WORKERS];   // per worker: first block not yet posted
+} EodState;
+
+// BALANCE SNAPSHOT (data/snapshots/balances-<unix time>.dat)
+// Every account's balance at one commit boundary; record i is account i.
+// A point-in-time query starts from the newest snapshot taken before the
+// time asked for and replays only the account's later transactions.
+#define SNAPSHOT_MAGIC 0x31534E42u    // "BNS1"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;    // sizeof(BalanceRecord)
+    time_t taken;
+    int last_transactionID;  // newest transaction reflected, -1 if none
+    int record_count;
+} SnapshotHeader;
+
+typedef struct {
+    double balance;
+    int accountID;
+    uint8_t flags;           // RECORD_IN_USE if the account existed
+} BalanceRecord;
+
 #endif
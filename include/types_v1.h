@@ -0,0 +1,96 @@
+#ifndef TYPES_V1_H
+#define TYPES_V1_H
+
+// On-disk format version 1, kept for the migrate tool and dbdump only.
+// v1 files have no magic: each starts with {next_id, record_count} and
+// every record carries a 100-byte reserved pad.
+#include <time.h>
+
+#define V1_MAX_USERNAME_LEN 50
+#define V1_MAX_PASSWORD_LEN 64
+#define V1_MAX_FEEDBACK_LEN 100
+#define V1_MAX_DESCRIPTION_LEN 100
+
+typedef struct {
+    int next_id;
+    int record_count;
+} HeaderV1;
+
+typedef struct {
+    int id;
+    char username[V1_MAX_USERNAME_LEN];
+    char password_hash[V1_MAX_PASSWORD_LEN];
+    int role;                // enum Role
+    int active;
+    time_t last_login;
+    char reserved[100];
+} UserV1;
+
+typedef struct {
+    int accountID;
+    int userID;
+    double balance;
+    int transaction_count;
+    char reserved[100];
+} AccountV1;
+
+typedef struct {
+    int transactionID;
+    int accountID;
+    time_t timestamp;
+    char description[V1_MAX_DESCRIPTION_LEN];  // e.g., "Deposit 1000.00"
+    double amount;
+    double new_balance;
+    char reserved[100];
+} TransactionRecordV1;
+
+#define V1_SEGMENT_MAGIC 0x31474553u   // "SEG1"
+
+typedef struct {
+    unsigned int magic;
+    int segment_no;
+    int sealed;
+    int record_count;
+    time_t min_timestamp;
+    time_t max_timestamp;
+    int min_accountID;
+    int max_accountID;
+} SegmentHeaderV1;
+
+typedef struct {
+    int loanID;
+    int custID;
+    double amount;
+    int status;              // enum LoanStatus
+    int assigned_employeeID;
+    time_t application_date;
+    time_t decision_date;
+    char reserved[100];
+} LoanV1;
+
+typedef struct {
+    int feedbackID;
+    int custID;
+    time_t timestamp;
+    char message[V1_MAX_FEEDBACK_LEN];
+    char reserved[100];
+} FeedbackV1;
+
+typedef struct {
+    int user_id;
+    time_t login_time;
+    int session_active;
+    char reserved[100];
+} SessionV1;
+
+// v1 WAL entry: header, then AccountV1[], then TransactionRecordV1[]
+#define V1_WAL_MAGIC 0x314C4157u       // "WAL1"
+
+typedef struct {
+    unsigned int magic;
+    unsigned int account_count;
+    unsigned int transaction_count;
+    unsigned int checksum;   // FNV-1a over the payload
+} WalEntryHeaderV1;
+
+#endif
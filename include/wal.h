@@ -0,0 +1,21 @@
+#ifndef WAL_H
+#define WAL_H
+#include "types.h"
+
+// One WAL entry carries every record image a single operation changes:
+// the new Account images, the TransactionRecords that explain them and,
+// for a request sent with an idempotency key, that key and its reply.
+typedef int (*wal_apply_fn)(const Account *accounts, int account_count,
+                            const TransactionRecord *transactions, int transaction_count,
+                            const IdempotencyRecord *key);
+
+int wal_open(const char *path);
+int wal_append(const Account *accounts, int account_count,
+               const TransactionRecord *transactions, int transaction_count,
+               const IdempotencyRecord *key);
+int wal_sync(void);
+int wal_replay(wal_apply_fn apply);
+int wal_truncate(void);
+long wal_size(void);
+
+#endif
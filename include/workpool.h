@@ -0,0 +1,17 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+// Fixed sets of worker threads, each fed by a bounded queue. A full queue
+// turns new work away rather than letting it pile up behind the data locks.
+typedef void (*work_fn)(void *arg);
+
+enum WorkPool {
+    POOL_REQUESTS,      // requests whose input has fully arrived
+    POOL_INTERACTIVE,   // prompt-driven requests, which wait on their client
+    POOL_COUNT
+};
+
+int workpool_start(enum WorkPool pool, int workers, int queue_depth);
+int workpool_submit(enum WorkPool pool, work_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,404 @@
+/* Offline migration of a data/ directory from on-disk format v1 to v2 */
+/*                                                                       */
+/* Run from the directory holding data/, with the server stopped. Each   */
+/* file is converted into a temporary copy that is renamed into place;   */
+/* the original is kept as <name>.v1. users.dat is switched last, so a   */
+/* run that is interrupted can simply be repeated.                       */
+/*                                                                       */
+/* On a v2 tree it widens an accounts.dat written before the account     */
+/* version grew to 32 bits (record_size 24), keeping it as               */
+/* accounts.dat.narrow. A WAL left beside it needs nothing: the server   */
+/* widens the images of older WAL entries as it replays them.            */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include "./include/types.h"
+#include "./include/format.h"
+
+#define DATA_DIR "data"
+
+typedef struct {
+    const char *filename;
+    size_t v1_record_size;
+    size_t record_size;
+    void (*upgrade)(const void *, void *);
+    int has_header;                 // sessions.dat has none
+    int takes_wal_images;           // accounts.dat: apply the v1 WAL's images
+} Table;
+
+/* ------------------------------------------------------------------ */
+/* v1 WAL: its account images and records were committed but may not  */
+/* have reached the data files, so they are folded into the new files. */
+/* ------------------------------------------------------------------ */
+static AccountV1 *wal_accounts = NULL;
+static int wal_account_count = 0;
+static TransactionRecordV1 *wal_transactions = NULL;
+static int wal_transaction_count = 0;
+
+static unsigned int wal_checksum(const unsigned char *data, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int load_wal(void) {
+    int fd = open(DATA_DIR "/wal.log", O_RDONLY);
+    if (fd == -1) return errno == ENOENT ? 0 : -1;
+
+    WalEntryHeaderV1 hdr;
+    off_t offset = 0;
+    while (pread(fd, &hdr, sizeof(hdr), offset) == sizeof(hdr) && hdr.magic == V1_WAL_MAGIC) {
+        size_t account_bytes = (size_t)hdr.account_count * sizeof(AccountV1);
+        size_t payload = account_bytes + (size_t)hdr.transaction_count * sizeof(TransactionRecordV1);
+        unsigned char *data = malloc(payload ? payload : 1);
+        if (data == NULL) break;
+        // Like replay, stop at the torn tail of an interrupted append
+        if (pread(fd, data, payload, offset + sizeof(hdr)) != (ssize_t)payload ||
+            wal_checksum(data, payload) != hdr.checksum) {
+            free(data);
+            break;
+        }
+        wal_accounts = realloc(wal_accounts, (wal_account_count + hdr.account_count) * sizeof(AccountV1));
+        wal_transactions = realloc(wal_transactions,
+            (wal_transaction_count + hdr.transaction_count) * sizeof(TransactionRecordV1));
+        memcpy(wal_accounts + wal_account_count, data, account_bytes);
+        memcpy(wal_transactions + wal_transaction_count, data + account_bytes, payload - account_bytes);
+        wal_account_count += hdr.account_count;
+        wal_transaction_count += hdr.transaction_count;
+        offset += sizeof(hdr) + payload;
+        free(data);
+    }
+    close(fd);
+    printf("wal.log: %d account image(s), %d transaction(s) to fold in\n",
+           wal_account_count, wal_transaction_count);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Fixed-record tables                                                 */
+/* ------------------------------------------------------------------ */
+static int is_v2(const char *path) {
+    FileHeader hdr;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return 0;
+    int v2 = read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == DB_MAGIC;
+    close(fd);
+    return v2;
+}
+
+// Writes out as path.tmp, then keeps the original as path + backup_suffix
+static int replace_file(const char *path, const char *backup_suffix, const void *data, size_t len) {
+    char tmp[256], old[256];
+    // A truncated name could clobber another file; refuse instead
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp) ||
+        snprintf(old, sizeof(old), "%s%s", path, backup_suffix) >= (int)sizeof(old))
+        return -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return -1;
+    int ok = write(fd, data, len) == (ssize_t)len && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(path, old) != 0 || rename(tmp, path) != 0) return -1;
+    return 0;
+}
+
+static int migrate_table(const Table *t) {
+    char path[256];
+    if (snprintf(path, sizeof(path), "%s/%s", DATA_DIR, t->filename) >= (int)sizeof(path)) return -1;
+    if (t->has_header && is_v2(path)) {
+        printf("%s: already v2\n", t->filename);
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return errno == ENOENT ? 0 : -1;
+
+    HeaderV1 hdr = { 0, 0 };
+    if (t->has_header && read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) hdr.next_id = 0;
+    struct stat st;
+    fstat(fd, &st);
+    off_t body = st.st_size - (t->has_header ? (off_t)sizeof(HeaderV1) : 0);
+    int count = body > 0 ? body / t->v1_record_size : 0;
+
+    // Room for account images in the WAL beyond the end of the file
+    int capacity = count;
+    if (t->takes_wal_images)
+        for (int i = 0; i < wal_account_count; i++)
+            if (wal_accounts[i].accountID >= capacity) capacity = wal_accounts[i].accountID + 1;
+
+    size_t header_size = t->has_header ? sizeof(FileHeader) : 0;
+    char *out = calloc(1, header_size + (size_t)capacity * t->record_size);
+    char *v1 = malloc(t->v1_record_size);
+    if (out == NULL || v1 == NULL) {
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < count && read(fd, v1, t->v1_record_size) == (ssize_t)t->v1_record_size; i++)
+        t->upgrade(v1, out + header_size + (size_t)i * t->record_size);
+    close(fd);
+
+    if (capacity > count) {
+        count = capacity;
+        if (hdr.next_id < count) hdr.next_id = count;
+        if (hdr.record_count < count) hdr.record_count = count;
+    }
+    if (t->takes_wal_images)
+        for (int i = 0; i < wal_account_count; i++)
+            upgrade_account(&wal_accounts[i],
+                            (Account *)(out + header_size) + wal_accounts[i].accountID);
+
+    if (t->has_header) {
+        FileHeader h = { .magic = DB_MAGIC, .version = DB_FORMAT_VERSION,
+                         .record_size = t->record_size,
+                         .next_id = hdr.next_id, .record_count = hdr.record_count };
+        memcpy(out, &h, sizeof(h));
+    }
+    int result = replace_file(path, ".v1", out, header_size + (size_t)count * t->record_size);
+    free(out);
+    free(v1);
+    if (result == 0)
+        printf("%s: %d record(s), %zu -> %zu bytes each\n",
+               t->filename, count, t->v1_record_size, t->record_size);
+    return result;
+}
+
+/* ------------------------------------------------------------------ */
+/* v2 accounts.dat with 16-bit versions -> 32-bit versions             */
+/* ------------------------------------------------------------------ */
+static int widen_accounts(void) {
+    const char *path = DATA_DIR "/accounts.dat";
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return errno == ENOENT ? 0 : -1;
+    FileHeader hdr;
+    struct stat st;
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || fstat(fd, &st) != 0 ||
+        (hdr.record_size != sizeof(AccountV2Narrow) && hdr.record_size != sizeof(Account))) {
+        close(fd);
+        return -1;
+    }
+    if (hdr.record_size == sizeof(Account)) {
+        close(fd);
+        printf("accounts.dat: already %zu bytes per record\n", sizeof(Account));
+        return 0;
+    }
+
+    int count = (st.st_size - sizeof(FileHeader)) / sizeof(AccountV2Narrow);
+    size_t len = sizeof(FileHeader) + (size_t)count * sizeof(Account);
+    char *out = calloc(1, len);
+    AccountV2Narrow *in = malloc(count > 0 ? count * sizeof(AccountV2Narrow) : 1);
+    int result = out != NULL && in != NULL &&
+                 read(fd, in, count * sizeof(AccountV2Narrow)) == (ssize_t)(count * sizeof(AccountV2Narrow))
+                 ? 0 : -1;
+    close(fd);
+    if (result == 0) {
+        for (int i = 0; i < count; i++)
+            widen_account(&in[i], (Account *)(out + sizeof(FileHeader)) + i);
+        hdr.record_size = sizeof(Account);
+        memcpy(out, &hdr, sizeof(hdr));
+        result = replace_file(path, ".narrow", out, len);
+    }
+    if (result == 0)
+        printf("accounts.dat: %d record(s), %zu -> %zu bytes each\n",
+               count, sizeof(AccountV2Narrow), sizeof(Account));
+    free(out);
+    free(in);
+    return result;
+}
+
+/* ------------------------------------------------------------------ */
+/* Transaction log: transactions.dat and/or v1 segments -> v2 segments */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    int fd;
+    SegmentHeader header;
+} OutSegment;
+
+static OutSegment *out_segments[2] = { NULL, NULL };   // [0] live, [1] archive
+static int out_capacity[2] = { 0, 0 };
+static int next_transaction_id = 0;
+
+static OutSegment *out_segment(int segment_no, int archived) {
+    if (segment_no >= out_capacity[archived]) {
+        int capacity = out_capacity[archived] ? out_capacity[archived] : 16;
+        while (capacity <= segment_no) capacity *= 2;
+        OutSegment *table = realloc(out_segments[archived], capacity * sizeof(OutSegment));
+        if (table == NULL) return NULL;
+        for (int i = out_capacity[archived]; i < capacity; i++) table[i].fd = -1;
+        out_segments[archived] = table;
+        out_capacity[archived] = capacity;
+    }
+    OutSegment *seg = &out_segments[archived][segment_no];
+    if (seg->fd == -1) {
+        char path[256];
+        snprintf(path, sizeof(path), archived ? "%s/txlog.v2/archive/seg-%06d.dat"
+                                              : "%s/txlog.v2/seg-%06d.dat", DATA_DIR, segment_no);
+        seg->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (seg->fd == -1) return NULL;
+        SegmentHeader h = { .magic = TXN_SEGMENT_MAGIC, .version = DB_FORMAT_VERSION,
+                            .record_size = sizeof(TransactionRecord), .segment_no = segment_no };
+        seg->header = h;
+    }
+    return seg;
+}
+
+static int put_transaction(const TransactionRecordV1 *in, int archived) {
+    TransactionRecord t;
+    upgrade_transaction(in, &t);
+    if (!(t.flags & RECORD_IN_USE) || t.transactionID < 0) return 0;
+
+    OutSegment *seg = out_segment(t.transactionID / TXN_SEGMENT_RECORDS, archived);
+    if (seg == NULL) return -1;
+    off_t offset = sizeof(SegmentHeader) +
+                   (off_t)(t.transactionID % TXN_SEGMENT_RECORDS) * sizeof(TransactionRecord);
+    if (pwrite(seg->fd, &t, sizeof(t), offset) != sizeof(t)) return -1;
+
+    SegmentHeader *h = &seg->header;
+    int used = t.transactionID % TXN_SEGMENT_RECORDS + 1;
+    if (h->record_count == 0 || t.timestamp < h->min_timestamp) h->min_timestamp = t.timestamp;
+    if (h->record_count == 0 || t.timestamp > h->max_timestamp) h->max_timestamp = t.timestamp;
+    if (h->record_count == 0 || t.accountID < h->min_accountID) h->min_accountID = t.accountID;
+    if (h->record_count == 0 || t.accountID > h->max_accountID) h->max_accountID = t.accountID;
+    if (used > h->record_count) h->record_count = used;
+    if (t.transactionID >= next_transaction_id) next_transaction_id = t.transactionID + 1;
+    return 0;
+}
+
+static int copy_records(int fd, off_t offset, int archived) {
+    TransactionRecordV1 batch[128];
+    ssize_t n;
+    while ((n = pread(fd, batch, sizeof(batch), offset)) >= (ssize_t)sizeof(TransactionRecordV1)) {
+        int count = n / sizeof(TransactionRecordV1);
+        for (int i = 0; i < count; i++)
+            if (put_transaction(&batch[i], archived) != 0) return -1;
+        offset += (off_t)count * sizeof(TransactionRecordV1);
+    }
+    return n < 0 ? -1 : 0;
+}
+
+static int copy_segments(const char *pattern, int archived) {
+    glob_t files;
+    if (glob(pattern, 0, NULL, &files) != 0) return 0;
+    int result = 0;
+    for (size_t i = 0; i < files.gl_pathc && result == 0; i++) {
+        int fd = open(files.gl_pathv[i], O_RDONLY);
+        SegmentHeaderV1 hdr;
+        if (fd == -1 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != V1_SEGMENT_MAGIC) {
+            fprintf(stderr, "%s: not a v1 segment\n", files.gl_pathv[i]);
+            result = -1;
+        } else {
+            result = copy_records(fd, sizeof(hdr), archived);
+        }
+        if (fd != -1) close(fd);
+    }
+    globfree(&files);
+    return result;
+}
+
+static int finish_segments(void) {
+    int active = next_transaction_id / TXN_SEGMENT_RECORDS;
+    for (int archived = 0; archived < 2; archived++) {
+        for (int i = 0; i < out_capacity[archived]; i++) {
+            OutSegment *seg = &out_segments[archived][i];
+            if (seg->fd == -1) continue;
+            seg->header.sealed = archived || i < active;
+            if (pwrite(seg->fd, &seg->header, sizeof(SegmentHeader), 0) != sizeof(SegmentHeader) ||
+                fsync(seg->fd) != 0)
+                return -1;
+            close(seg->fd);
+            seg->fd = -1;
+        }
+    }
+    return 0;
+}
+
+static int migrate_transactions(void) {
+    const char *legacy = DATA_DIR "/transactions.dat";
+    struct stat st;
+    int have_legacy = stat(legacy, &st) == 0;
+    glob_t v1_segments;
+    int have_segments = glob(DATA_DIR "/txlog/seg-*.dat", 0, NULL, &v1_segments) == 0;
+    if (have_segments) {
+        // A tree whose segments are already v2 has nothing left to convert
+        int fd = open(v1_segments.gl_pathv[0], O_RDONLY);
+        unsigned int magic = 0;
+        if (fd != -1) {
+            read(fd, &magic, sizeof(magic));
+            close(fd);
+        }
+        globfree(&v1_segments);
+        if (magic == TXN_SEGMENT_MAGIC && !have_legacy) {
+            printf("txlog: already v2\n");
+            return 0;
+        }
+    }
+
+    mkdir(DATA_DIR "/txlog.v2", 0755);
+    mkdir(DATA_DIR "/txlog.v2/archive", 0755);
+    int result = 0;
+    if (have_legacy) {
+        int fd = open(legacy, O_RDONLY);
+        if (fd == -1) return -1;
+        result = copy_records(fd, sizeof(HeaderV1), 0);
+        close(fd);
+    }
+    if (result == 0) result = copy_segments(DATA_DIR "/txlog/seg-*.dat", 0);
+    if (result == 0) result = copy_segments(DATA_DIR "/txlog/archive/seg-*.dat", 1);
+    for (int i = 0; result == 0 && i < wal_transaction_count; i++)
+        result = put_transaction(&wal_transactions[i], 0);
+    if (result == 0) result = finish_segments();
+    if (result != 0) return -1;
+
+    if (stat(DATA_DIR "/txlog", &st) == 0 && rename(DATA_DIR "/txlog", DATA_DIR "/txlog.v1") != 0)
+        return -1;
+    if (rename(DATA_DIR "/txlog.v2", DATA_DIR "/txlog") != 0) return -1;
+    if (have_legacy && rename(legacy, DATA_DIR "/transactions.dat.v1") != 0) return -1;
+    printf("txlog: %d transaction id(s) in v2 segments\n", next_transaction_id);
+    return 0;
+}
+
+int main(void) {
+    const Table tables[] = {
+        { "accounts.dat", sizeof(AccountV1),  sizeof(Account),
+          (void(*)(const void*, void*))upgrade_account,  1, 1 },
+        { "loans.dat",    sizeof(LoanV1),     sizeof(Loan),
+          (void(*)(const void*, void*))upgrade_loan,     1, 0 },
+        { "feedback.dat", sizeof(FeedbackV1), sizeof(Feedback),
+          (void(*)(const void*, void*))upgrade_feedback, 1, 0 },
+        { "sessions.dat", sizeof(SessionV1),  sizeof(Session),
+          (void(*)(const void*, void*))upgrade_session, 0, 0 },
+        { "users.dat",    sizeof(UserV1),     sizeof(User),
+          (void(*)(const void*, void*))upgrade_user,     1, 0 },   // last: marks the tree v2
+    };
+
+    if (is_v2(DATA_DIR "/users.dat")) {
+        if (widen_accounts() != 0) {
+            fprintf(stderr, "Failed to widen accounts.dat\n");
+            return 1;
+        }
+        printf("%s is in format v%d\n", DATA_DIR, DB_FORMAT_VERSION);
+        return 0;
+    }
+    if (load_wal() != 0 || migrate_transactions() != 0) {
+        perror("Failed to migrate the transaction log");
+        return 1;
+    }
+    for (int i = 0; i < 5; i++) {
+        // The WAL is folded in once accounts.dat is v2; retire it before users.dat flips
+        if (i == 4 && rename(DATA_DIR "/wal.log", DATA_DIR "/wal.log.v1") != 0 && errno != ENOENT) {
+            perror("Failed to retire wal.log");
+            return 1;
+        }
+        if (migrate_table(&tables[i]) != 0) {
+            fprintf(stderr, "Failed to migrate %s\n", tables[i].filename);
+            return 1;
+        }
+    }
+    printf("Migration to format v%d complete\n", DB_FORMAT_VERSION);
+    return 0;
+}
@@ -7,8 +7,11 @@
 #include <time.h>
 #include "types.h"
 #include "database.h"
+#include "lockmgr.h"
+#include "transactions.h"
 #include "helpers.h"
 #include "admin.h"
+#include "eod.h"
 
 /* --------------------------------------------------------------------- */
 /* 1. Add Employee                                                       */
@@ -37,37 +40,35 @@ int addEmployee(int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) {
+    // Exclusive: the uniqueness check and the insert must not interleave
+    if (lock_table(LOCK_USERS, LOCK_EXCLUSIVE) != 0) {
         send_response(socket_fd, "Failed to lock users.dat\n");
         return -1;
     }
 
     if (find_user_by_username(username) != NULL) {
-        unlock_file(users_fd);
+        unlock_table(LOCK_USERS);
         send_response(socket_fd, "Username already exists\n");
         return -1;
     }
 
-    UserHeader hdr;
-    read(users_fd, &hdr, sizeof(UserHeader));
-
     User new_user = {0};
-    new_user.id = hdr.next_id++;
-    hdr.record_count++;
+    new_user.id = fetch_and_increment_id(TABLE_USERS);
+    if (new_user.id < 0) {
+        unlock_table(LOCK_USERS);
+        send_response(socket_fd, "Failed to allocate user ID\n");
+        return -1;
+    }
     strncpy(new_user.username, username, MAX_USERNAME_LEN - 1);
     strncpy(new_user.password_hash, password, MAX_PASSWORD_LEN - 1);
     new_user.role = ROLE_EMPLOYEE;
     new_user.active = 1;
     new_user.last_login = 0;
-    memset(new_user.reserved, 0, sizeof(new_user.reserved));
+    new_user.flags = RECORD_IN_USE;
 
-    lseek(users_fd, 0, SEEK_SET);
-    write(users_fd, &hdr, sizeof(UserHeader));
-    lseek(users_fd, 0, SEEK_END);
-    write(users_fd, &new_user, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    save_user(&new_user);
+    index_user(&new_user);
+    unlock_table(LOCK_USERS);
 
     send_response(socket_fd, "Employee added successfully!\n");
     return 0;
@@ -100,37 +101,35 @@ int addManager(int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) {
+    // Exclusive: the uniqueness check and the insert must not interleave
+    if (lock_table(LOCK_USERS, LOCK_EXCLUSIVE) != 0) {
         send_response(socket_fd, "Failed to lock users.dat\n");
         return -1;
     }
 
     if (find_user_by_username(username) != NULL) {
-        unlock_file(users_fd);
+        unlock_table(LOCK_USERS);
         send_response(socket_fd, "Username already exists\n");
         return -1;
     }
 
-    UserHeader hdr;
-    read(users_fd, &hdr, sizeof(UserHeader));
-
     User new_user = {0};
-    new_user.id = hdr.next_id++;
-    hdr.record_count++;
+    new_user.id = fetch_and_increment_id(TABLE_USERS);
+    if (new_user.id < 0) {
+        unlock_table(LOCK_USERS);
+        send_response(socket_fd, "Failed to allocate user ID\n");
+        return -1;
+    }
     strncpy(new_user.username, username, MAX_USERNAME_LEN - 1);
     strncpy(new_user.password_hash, password, MAX_PASSWORD_LEN - 1);
     new_user.role = ROLE_MANAGER;
     new_user.active = 1;
     new_user.last_login = 0;
-    memset(new_user.reserved, 0, sizeof(new_user.reserved));
+    new_user.flags = RECORD_IN_USE;
 
-    lseek(users_fd, 0, SEEK_SET);
-    write(users_fd, &hdr, sizeof(UserHeader));
-    lseek(users_fd, 0, SEEK_END);
-    write(users_fd, &new_user, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    save_user(&new_user);
+    index_user(&new_user);
+    unlock_table(LOCK_USERS);
 
     send_response(socket_fd, "Manager added successfully\n");
     return 0;
@@ -140,26 +139,22 @@ int addManager(int socket_fd) {
 /* 3. View All Users                                                     */
 /* --------------------------------------------------------------------- */
 int viewAllUsers(int socket_fd) {
-    int fd = lock_file("data/users.dat", F_RDLCK);
-    if (fd == -1) {
+    if (lock_table(LOCK_USERS, LOCK_SHARED) != 0) {
         send_response(socket_fd, "Failed to lock users.dat\n");
         return -1;
     }
 
-    UserHeader hdr;
-    read(fd, &hdr, sizeof(UserHeader));
-
-    char line[256];
-    snprintf(line, sizeof(line),
-             "All Users (%d total):\n"
-             "%-6s %-15s %-10s %-6s %-12s\n",
-             hdr.record_count, "ID", "Username", "Role", "Active", "Last Login");
-    send_response(socket_fd, line);
-    snprintf(line, sizeof(line), "------------------------------------------------------\n");
-    send_response(socket_fd, line);
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_printf(&out,
+                  "All Users (%d total):\n"
+                  "%-6s %-15s %-10s %-6s %-12s\n",
+                  table_record_count(TABLE_USERS), "ID", "Username", "Role", "Active", "Last Login");
+    outbuf_puts(&out, "------------------------------------------------------\n");
 
     User user;
-    while (read(fd, &user, sizeof(User)) == sizeof(User)) {
+    for (int i = 0; read_user_record(i, &user) == 0; i++) {
+        if (!(user.flags & RECORD_IN_USE)) continue;   // id allocated, never saved
         const char *role_str = (user.role == ROLE_CUSTOMER) ? "Customer" :
                                (user.role == ROLE_EMPLOYEE) ? "Employee" :
                                (user.role == ROLE_MANAGER)  ? "Manager"  : "Admin";
@@ -168,13 +163,13 @@ int viewAllUsers(int socket_fd) {
             struct tm *tm_info = localtime(&user.last_login);
             strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
         }
-        snprintf(line, sizeof(line), "%-6d %-15s %-10s %-6s %-12s\n",
-                 user.id, user.username, role_str,
-                 user.active ? "Yes" : "No", time_str);
-        send_response(socket_fd, line);
+        outbuf_printf(&out, "%-6d %-15s %-10s %-6s %-12s\n",
+                      user.id, user.username, role_str,
+                      user.active ? "Yes" : "No", time_str);
     }
-    unlock_file(fd);
-        send_response(socket_fd, "--- End of User List ---\n"); 
+    unlock_table(LOCK_USERS);
+    outbuf_puts(&out, "--- End of User List ---\n");
+    outbuf_flush(&out);
     return 0;
 }
 
@@ -189,35 +184,25 @@ int deactivateUser(int admin_id, int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) {
-        send_response(socket_fd, "Failed to lock users.dat\n");
-        return -1;
-    }
-
-    User *u = find_user_by_username(username);
+    User *u = lock_user_by_username(username);
     if (u == NULL) {
-        unlock_file(users_fd);
         send_response(socket_fd, "User not found\n");
         return -1;
     }
     if (u->id == admin_id) {
-        unlock_file(users_fd);
+        unlock_record(LOCK_USERS, u->id);
         send_response(socket_fd, "Cannot deactivate self\n");
         return -1;
     }
     if (u->role == ROLE_ADMIN) {
-        unlock_file(users_fd);
+        unlock_record(LOCK_USERS, u->id);
         send_response(socket_fd, "Cannot deactivate another admin\n");
         return -1;
     }
 
     u->active = 0;
-    
-    lseek(users_fd, sizeof(UserHeader) + (u->id) * sizeof(User), SEEK_SET);
-    write(users_fd, u, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    save_user(u);
+    unlock_record(LOCK_USERS, u->id);
 
     send_response(socket_fd, "User deactivated\n");
     return 0;
@@ -233,30 +218,20 @@ int reactivateUser(int admin_id, int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) {
-        send_response(socket_fd, "Failed to lock users.dat\n");
-        return -1;
-    }
-
-    User *u = find_user_by_username(username);
+    User *u = lock_user_by_username(username);
     if (u == NULL) {
-        unlock_file(users_fd);
         send_response(socket_fd, "User not found\n");
         return -1;
     }
     if (u->active) {
-        unlock_file(users_fd);
+        unlock_record(LOCK_USERS, u->id);
         send_response(socket_fd, "User already active\n");
         return -1;
     }
 
     u->active = 1;
-    // lseek(users_fd, sizeof(UserHeader) + (u->id - 1) * sizeof(User), SEEK_SET);
-    lseek(users_fd, sizeof(UserHeader) + (u->id) * sizeof(User), SEEK_SET);
-    write(users_fd, u, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    save_user(u);
+    unlock_record(LOCK_USERS, u->id);
 
     send_response(socket_fd, "User reactivated\n");
     return 0;
@@ -273,11 +248,73 @@ int viewSystemLogs(int socket_fd) {
     }
 
     char line[512];
-    send_response(socket_fd, "=== Server Log ===\n");
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_puts(&out, "=== Server Log ===\n");
     while (fgets(line, sizeof(line), log)) {
-        send_response(socket_fd, line);
+        outbuf_puts(&out, line);
     }
-    send_response(socket_fd, "=== End of Log ===\n");
+    outbuf_puts(&out, "=== End of Log ===\n");
+    outbuf_flush(&out);
     fclose(log);
     return 0;
-}
\ No newline at end of file
+}
+/* --------------------------------------------------------------------- */
+/* 7. Archive Old Transactions                                           */
+/* --------------------------------------------------------------------- */
+int archiveTransactions(int socket_fd) {
+    char days_str[32];
+    if (read_line_from_socket(socket_fd, days_str, sizeof(days_str)) != 0) {
+        send_response(socket_fd, "Error reading age\n");
+        return -1;
+    }
+    int days = atoi(days_str);
+    if (days <= 0) {
+        send_response(socket_fd, "Invalid age in days\n");
+        return -1;
+    }
+
+    int archived = archive_transactions(time(NULL) - (time_t)days * 24 * 60 * 60);
+    if (archived < 0) {
+        send_response(socket_fd, "Failed to archive transactions\n");
+        return -1;
+    }
+    char msg[80];
+    snprintf(msg, sizeof(msg), "Archived %d transaction segment(s)\n", archived);
+    send_response(socket_fd, msg);
+    return 0;
+}
+/* --------------------------------------------------------------------- */
+/* 8. End-of-Day Batch                                                   */
+/* --------------------------------------------------------------------- */
+static void report_eod_progress(const EodProgress *progress, void *arg) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Posted %ld of %ld accounts\n",
+             progress->accounts_done, progress->accounts_total);
+    send_response(*(int *)arg, msg);
+    flush_responses();
+}
+
+int endOfDay(int socket_fd) {
+    char line[96];
+    EodConfig config = { .workers = 0 };
+    if (read_line_from_socket(socket_fd, line, sizeof(line)) != 0 ||
+        sscanf(line, "%d %lf %lf", &config.business_date, &config.annual_rate_pct, &config.fee) != 3) {
+        send_response(socket_fd, "Usage: <YYYYMMDD> <annual rate %> <fee>\n--- End of EOD ---\n");
+        return -1;
+    }
+
+    EodProgress result;
+    char error[128], msg[256];
+    if (run_end_of_day(&config, report_eod_progress, &socket_fd, &result, error, sizeof(error)) != 0) {
+        snprintf(msg, sizeof(msg), "End of day %d failed: %s\n--- End of EOD ---\n",
+                 config.business_date, error);
+        send_response(socket_fd, msg);
+        return -1;
+    }
+    snprintf(msg, sizeof(msg), "End of day %d posted: %ld accounts, %ld postings, "
+             "interest %.2f, fees %.2f\n--- End of EOD ---\n", config.business_date,
+             result.accounts_done, result.postings, result.interest_total, result.fees_total);
+    send_response(socket_fd, msg);
+    return 0;
+}
@@ -21,6 +21,13 @@ static int read_line(int sock, char *buf, size_t max)
     return 0;
 }
 
+// True once `buffer` holds the last part of a multi-part reply: its end
+// marker, or a busy server's refusal
+static int reply_ended(const char *buffer, const char *marker)
+{
+    return strstr(buffer, marker) != NULL || strstr(buffer, SERVER_BUSY_REPLY) != NULL;
+}
+
 /* --------------------------------------------------------------- */
 /* Customer menu                                                   */
 /* --------------------------------------------------------------- */
@@ -29,7 +36,9 @@ static void customer_menu(int sock)
     while (1) {
         printf("\n=== CUSTOMER MENU ===\n");
         printf("1. View Balance\n2. Deposit\n3. Withdraw\n4. Transfer Funds\n");
-        printf("5. Apply for Loan\n6. Add Feedback\n7. View Transaction History\n8. Exit\n");
+        printf("5. Apply for Loan\n6. Add Feedback\n7. View Transaction History\n");
+        printf("8. Transfer Batch (from file)\n9. Transaction (from file)\n");
+        printf("10. Balance At Time\n11. Exit\n");
         printf("Choice: ");
 
         int choice;
@@ -120,12 +129,119 @@ static void customer_menu(int sock)
                 write(sock, buffer, strlen(buffer));
                 while (read_line(sock, buffer, sizeof(buffer)) == 0) {
                     printf("%s", buffer);
-                    if (strstr(buffer, "--- End of Transaction History ---") != NULL)
+                    if (reply_ended(buffer, "--- End of Transaction History ---"))
                         break;
                 }
                 continue;
 
-            case 8: // EXIT
+            case 8: { // TRANSFER_BATCH
+                // File format: one "<recipient> <amount>" line per leg
+                char path[256];
+                printf("Batch file: ");
+                if (fgets(path, sizeof(path), stdin) == NULL) continue;
+                path[strcspn(path, "\n")] = '\0';
+                FILE *batch = fopen(path, "r");
+                if (batch == NULL) {
+                    printf("Cannot open %s\n", path);
+                    continue;
+                }
+                size_t body_len = 0, body_cap = 4096;
+                char *body = malloc(body_cap);
+                char leg[128];
+                int legs = 0;
+                while (body != NULL && fgets(leg, sizeof(leg), batch) != NULL) {
+                    char recip[MAX_USERNAME_LEN];
+                    double amt;
+                    if (sscanf(leg, "%49s %lf", recip, &amt) != 2) continue;
+                    if (body_cap - body_len < sizeof(leg)) {
+                        body_cap *= 2;
+                        char *grown = realloc(body, body_cap);
+                        if (grown == NULL) { free(body); body = NULL; break; }
+                        body = grown;
+                    }
+                    body_len += snprintf(body + body_len, body_cap - body_len, "%s %.2f\n", recip, amt);
+                    legs++;
+                }
+                fclose(batch);
+                if (body == NULL || legs == 0) {
+                    printf("No transfers in %s\n", path);
+                    free(body);
+                    continue;
+                }
+
+                snprintf(buffer, sizeof(buffer), "TRANSFER_BATCH");
+                write(sock, buffer, strlen(buffer)); // 1. Send command
+
+                snprintf(buffer, sizeof(buffer), "%d\n", legs);
+                write(sock, buffer, strlen(buffer)); // 2. Send leg count
+                write(sock, body, body_len);         // 3. Send legs
+                free(body);
+
+                // Summary, one result per leg, then the end marker
+                while (read_line(sock, buffer, sizeof(buffer)) == 0) {
+                    printf("%s", buffer);
+                    if (reply_ended(buffer, "--- End of Batch ---"))
+                        break;
+                }
+                continue;
+            }
+
+            case 9: { // BEGIN ... COMMIT
+                // File format: one operation per line, applied all or nothing:
+                // "DEPOSIT <amount>", "WITHDRAW <amount>" or "TRANSFER <recipient> <amount>"
+                char path[256], line[128];
+                printf("Transaction file: ");
+                if (fgets(path, sizeof(path), stdin) == NULL) continue;
+                path[strcspn(path, "\n")] = '\0';
+                FILE *ops = fopen(path, "r");
+                if (ops == NULL) {
+                    printf("Cannot open %s\n", path);
+                    continue;
+                }
+
+                write(sock, "BEGIN", strlen("BEGIN"));
+                if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                    printf("%s", buffer);
+                while (fgets(line, sizeof(line), ops) != NULL) {
+                    char op[16], recip[MAX_USERNAME_LEN];
+                    double amt;
+                    if (sscanf(line, "%15s", op) != 1) continue;
+                    if (strcmp(op, "TRANSFER") == 0 &&
+                        sscanf(line, "%*s %49s %lf", recip, &amt) == 2) {
+                        write(sock, op, strlen(op));
+                        snprintf(buffer, sizeof(buffer), "%s\n", recip);
+                        write(sock, buffer, strlen(buffer));
+                    } else if ((strcmp(op, "DEPOSIT") == 0 || strcmp(op, "WITHDRAW") == 0) &&
+                               sscanf(line, "%*s %lf", &amt) == 1) {
+                        write(sock, op, strlen(op));
+                    } else {
+                        printf("Skipping: %s", line);
+                        continue;
+                    }
+                    snprintf(buffer, sizeof(buffer), "%.2f", amt);
+                    write(sock, buffer, strlen(buffer));
+                    if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                        printf("%s", buffer); // "Queued ..." or why the operation was refused
+                }
+                fclose(ops);
+
+                write(sock, "COMMIT", strlen("COMMIT"));
+                if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                    printf("%s", buffer);
+                continue;
+            }
+
+            case 10: // BALANCE_AT
+                printf("Time (YYYY-MM-DD [HH:MM[:SS]]): ");
+                fgets(buffer, sizeof(buffer), stdin);
+
+                write(sock, "BALANCE_AT", strlen("BALANCE_AT")); // 1. Send command
+                write(sock, buffer, strlen(buffer)); // 2. Send time
+                if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                    printf("%s", buffer);
+                continue;
+
+            case 11: // EXIT
                 snprintf(buffer, sizeof(buffer), "EXIT");
                 write(sock, buffer, strlen(buffer));
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
@@ -138,22 +254,10 @@ static void customer_menu(int sock)
                 continue; // Skip the read
         }
         
-        // General response read for cases 1-7
+        // General response read for cases 1-7 (TRANSFER answers with one line too)
         if (choice >= 1 && choice <= 7) {
             if (read_line(sock, buffer, sizeof(buffer)) == 0)
                 printf("%s", buffer);
-            
-            // Handle TRANSFER's extra responses
-            // deposit() -> "Deposit successful"
-            // withdraw() -> "Withdrawal successful"
-            // transferFunds() -> "Transfer successful"
-            // All 3 functions are called
-            if (choice == 4) {
-                if (read_line(sock, buffer, sizeof(buffer)) == 0)
-                    printf("%s", buffer); // Read 2nd response
-                if (read_line(sock, buffer, sizeof(buffer)) == 0)
-                    printf("%s", buffer); // Read 3rd response
-            }
         }
     }
 }
@@ -167,7 +271,8 @@ static void admin_menu(int sock)
         printf("\n=== ADMIN MENU ===\n");
         printf("1. Add Employee\n2. Add Manager\n");
         printf("3. View All Users\n4. Deactivate User\n");
-        printf("5. Reactivate User\n6. View Logs\n7. Exit\n");
+        printf("5. Reactivate User\n6. View Logs\n");
+        printf("7. Archive Old Transactions\n8. End-of-Day Batch\n9. Exit\n");
         printf("Choice: ");
 
         int choice;
@@ -209,7 +314,7 @@ static void admin_menu(int sock)
                 
                 while (read_line(sock, buffer, sizeof(buffer)) == 0) {
                     printf("%s", buffer);    
-                    if (strstr(buffer, "--- End of User List ---") != NULL)
+                    if (reply_ended(buffer, "--- End of User List ---"))
                         break;
                 }
                 continue;
@@ -236,12 +341,33 @@ static void admin_menu(int sock)
                 while (read_line(sock, buffer, sizeof(buffer)) == 0) {
                     printf("%s", buffer);
                     // viewSystemLogs already sends an "End of Log" token
-                    if (strstr(buffer, "=== End of Log ===") != NULL)
+                    if (reply_ended(buffer, "=== End of Log ==="))
                         break;
                 }
                 continue;
 
-            case 7: // EXIT
+            case 7: // ARCHIVE_TXNS
+                printf("Archive segments older than (days): ");
+                fgets(buffer, sizeof(buffer), stdin);
+
+                write(sock, "ARCHIVE_TXNS", strlen("ARCHIVE_TXNS")); // 1. Send command
+                write(sock, buffer, strlen(buffer)); // 2. Send age in days
+                break;
+
+            case 8: // EOD
+                printf("Business date (YYYYMMDD), annual rate %%, fee: ");
+                fgets(buffer, sizeof(buffer), stdin);
+
+                write(sock, "EOD", strlen("EOD"));
+                write(sock, buffer, strlen(buffer));
+                while (read_line(sock, buffer, sizeof(buffer)) == 0) {
+                    printf("%s", buffer);
+                    if (reply_ended(buffer, "--- End of EOD ---"))
+                        break;
+                }
+                continue;
+
+            case 9: // EXIT
                 snprintf(buffer, sizeof(buffer), "EXIT");
                 write(sock, buffer, strlen(buffer));
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
@@ -254,8 +380,8 @@ static void admin_menu(int sock)
                 continue; // Skip the write/read block
         }
 
-        // Common read block for cases 1,2,4,5
-        if (choice == 1 || choice == 2 || choice == 4 || choice == 5) {
+        // Common read block for cases 1,2,4,5,7
+        if (choice == 1 || choice == 2 || choice == 4 || choice == 5 || choice == 7) {
             if (read_line(sock, buffer, sizeof(buffer)) == 0)
                 printf("%s", buffer);
         }
@@ -271,7 +397,7 @@ static void employee_menu(int sock)
         printf("\n=== EMPLOYEE MENU ===\n");
         printf("1. Add Customer\n2. Edit Customer\n");
         printf("3. View My Assigned Loans\n4. Approve/Reject Loan\n");
-        printf("5. View Customer Transactions\n6. Exit\n");
+        printf("5. View Customer Transactions\n6. Customer Balance At Time\n7. Exit\n");
         printf("Choice: ");
 
         int choice;
@@ -345,7 +471,7 @@ static void employee_menu(int sock)
                 write(sock, buffer, strlen(buffer));
                 while (read_line(sock, buffer, sizeof(buffer)) == 0) {
                     printf("%s", buffer);
-                    if (strstr(buffer, "--- End of Loan List ---") != NULL)
+                    if (reply_ended(buffer, "--- End of Loan List ---"))
                         break;
                 }
                 continue;
@@ -357,7 +483,7 @@ static void employee_menu(int sock)
                 // Server sends list of loans
                 while (read_line(sock, buffer, sizeof(buffer)) == 0) {
                     printf("%s", buffer);
-                    if (strstr(buffer, "--- End of Loan List ---") != NULL)
+                    if (reply_ended(buffer, "--- End of Loan List ---"))
                         break;
                 }
                 printf("Enter Loan ID to decide on: ");
@@ -371,14 +497,10 @@ static void employee_menu(int sock)
                 fgets(buffer, sizeof(buffer), stdin);
                 write(sock, buffer, strlen(buffer)); // 3. Send choice (A/R)
 
-                // Server sends final "Loan decision recorded"
-                // (It might also send "Deposit successful" first if approved)
+                // Server sends final "Loan decision recorded" (approval
+                // credits the customer in the same step)
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
                     printf("%s", buffer);
-                if (strstr(buffer, "Deposit successful") != NULL) {
-                     if (read_line(sock, buffer, sizeof(buffer)) == 0)
-                        printf("%s", buffer);
-                }
                 
                 break; // Done with this case
             }
@@ -395,7 +517,21 @@ static void employee_menu(int sock)
                     
                 break; // Done with this case
             }
-            case 6: // EXIT
+            case 6: { // BALANCE_AT
+                printf("Enter customer username: ");
+                fgets(buffer, sizeof(buffer), stdin);
+                write(sock, "BALANCE_AT", strlen("BALANCE_AT")); // 1. Send command
+                write(sock, buffer, strlen(buffer)); // 2. Send username
+
+                printf("Time (YYYY-MM-DD [HH:MM[:SS]]): ");
+                fgets(buffer, sizeof(buffer), stdin);
+                write(sock, buffer, strlen(buffer)); // 3. Send time
+
+                if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                    printf("%s", buffer);
+                break;
+            }
+            case 7: // EXIT
                 snprintf(buffer, sizeof(buffer), "EXIT");
                 write(sock, buffer, strlen(buffer));
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
@@ -425,7 +561,8 @@ static void manager_menu(int sock)
         printf("6. Assign Loan to Employee\n");
         printf("7. View All Feedback\n");
         printf("8. View All Users\n");
-        printf("9. Exit\n");
+        printf("9. Customer Balance At Time\n");
+        printf("10. Exit\n");
         printf("Choice: ");
 
         int choice;
@@ -513,13 +650,9 @@ static void manager_menu(int sock)
                 fgets(buffer, sizeof(buffer), stdin);
                 write(sock, buffer, strlen(buffer)); // 3. Send choice (A/R)
 
-                // Read responses
+                // Read response
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
                     printf("%s", buffer);
-                if (strstr(buffer, "Deposit successful") != NULL) {
-                     if (read_line(sock, buffer, sizeof(buffer)) == 0)
-                        printf("%s", buffer);
-                }
                 break;
             }
             case 5: { // CUST_TRANS (Interactive)
@@ -560,7 +693,21 @@ static void manager_menu(int sock)
                     printf("%s", buffer);
                 break;
 
-            case 9: // EXIT
+            case 9: { // BALANCE_AT
+                printf("Enter customer username: ");
+                fgets(buffer, sizeof(buffer), stdin);
+                write(sock, "BALANCE_AT", strlen("BALANCE_AT")); // 1. Send command
+                write(sock, buffer, strlen(buffer)); // 2. Send username
+
+                printf("Time (YYYY-MM-DD [HH:MM[:SS]]): ");
+                fgets(buffer, sizeof(buffer), stdin);
+                write(sock, buffer, strlen(buffer)); // 3. Send time
+
+                if (read_line(sock, buffer, sizeof(buffer)) == 0)
+                    printf("%s", buffer);
+                break;
+            }
+            case 10: // EXIT
                 snprintf(buffer, sizeof(buffer), "EXIT");
                 write(sock, buffer, strlen(buffer));
                 if (read_line(sock, buffer, sizeof(buffer)) == 0)
@@ -0,0 +1,295 @@
+/* src/commands.c */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "commands.h"
+#include "frame.h"
+#include "helpers.h"
+#include "metrics.h"
+#include "customer.h"
+#include "employee.h"
+#include "admin.h"
+#include "transactions.h"
+#include "idempotency.h"
+
+#define STAFF_ROLES (ROLE_BIT(ROLE_EMPLOYEE) | ROLE_BIT(ROLE_MANAGER))
+#define HASH_SLOTS 64           // power of two, above OP_COUNT
+#define HASH_MAX_SEED 100000
+
+// Runs DEPOSIT, WITHDRAW or TRANSFER once its input has been read. With a
+// key the request runs at most once per user: a retry gets the reply of
+// the first attempt, which is held back until the key is durable. A key
+// whose request moves money is logged in the same WAL entry, so no crash
+// can leave the money moved and the key forgotten.
+static void run_money_command(int user_id, const char *key, const char *cmd,
+                              const char *recipient, double amount, int client_fd) {
+    char request[IDEMPOTENCY_REQUEST_LEN];
+    char reply[IDEMPOTENCY_REPLY_LEN];
+    if (key[0] != '\0') {
+        if (!idempotency_valid_key(key)) {
+            send_response(client_fd, "Invalid idempotency key\n");
+            return;
+        }
+        // The exact amount: 10.004 and 10.001 are different requests
+        if (snprintf(request, sizeof(request), "%s %s %.17g", cmd, recipient, amount) >= (int)sizeof(request)) {
+            send_response(client_fd, "Request too long for an idempotency key\n");
+            return;
+        }
+        switch (idempotency_begin(user_id, key, request, reply, sizeof(reply))) {
+            case IDEMPOTENCY_REPLAY:
+                send_response(client_fd, reply);
+                return;
+            case IDEMPOTENCY_CONFLICT:
+                send_response(client_fd, "Idempotency key already used for another request\n");
+                return;
+            case IDEMPOTENCY_BUSY:
+                send_response(client_fd, SERVER_BUSY_REPLY);
+                return;
+            case IDEMPOTENCY_NEW:
+                break;
+        }
+        capture_responses(reply, sizeof(reply));
+        // If the request commits, its key and this reply commit with it
+        idempotency_arm(user_id, key, strcmp(cmd, "DEPOSIT") == 0  ? "Deposit successful\n"
+                                    : strcmp(cmd, "WITHDRAW") == 0 ? "Withdrawal successful\n"
+                                    :                                "Transfer successful\n");
+    }
+
+    if (strcmp(cmd, "DEPOSIT") == 0)       deposit(user_id, amount, client_fd);
+    else if (strcmp(cmd, "WITHDRAW") == 0) withdraw(user_id, amount, client_fd);
+    else                                   transferFunds(user_id, recipient, amount, client_fd);
+
+    if (key[0] != '\0') {
+        stop_capture();
+        idempotency_finish(user_id, key, reply);
+        send_response(client_fd, reply);
+    }
+}
+
+// Inside BEGIN ... COMMIT the operation is queued instead of run
+static void money_command(ClientSession *s, const CommandArgs *args, const char *cmd,
+                          const char *recipient, double amount) {
+    if (!s->in_transaction)
+        run_money_command(s->user_id, args->key, cmd, recipient, amount, s->fd);
+    else if (args->key[0] != '\0')
+        send_response(s->fd, "Idempotency keys are not allowed inside a transaction\n");
+    else
+        queueOperation(&s->txn, s->user_id, cmd, recipient, amount, s->fd);
+}
+
+static int cmd_deposit(ClientSession *s, const CommandArgs *args) {
+    money_command(s, args, "DEPOSIT", "", read_amount_from_socket(s->fd));
+    return 0;
+}
+
+static int cmd_withdraw(ClientSession *s, const CommandArgs *args) {
+    money_command(s, args, "WITHDRAW", "", read_amount_from_socket(s->fd));
+    return 0;
+}
+
+static int cmd_transfer(ClientSession *s, const CommandArgs *args) {
+    char recipient[MAX_USERNAME_LEN];
+    if (read_line_from_socket(s->fd, recipient, sizeof(recipient)) != 0) {
+        send_response(s->fd, "Error reading recipient username\n");
+        return 0;
+    }
+    money_command(s, args, "TRANSFER", recipient, read_amount_from_socket(s->fd));
+    return 0;
+}
+
+static int cmd_begin(ClientSession *s, const CommandArgs *args) {
+    (void)args;
+    if (s->in_transaction) {
+        send_response(s->fd, "Transaction already open\n");
+    } else {
+        s->in_transaction = 1;
+        send_response(s->fd, "Transaction started\n");
+    }
+    return 0;
+}
+
+static int cmd_commit(ClientSession *s, const CommandArgs *args) {
+    (void)args;
+    if (!s->in_transaction) {
+        send_response(s->fd, "No open transaction\n");
+        return 0;
+    }
+    commitTransaction(&s->txn, s->fd);
+    s->in_transaction = 0;
+    return 0;
+}
+
+static int cmd_abort(ClientSession *s, const CommandArgs *args) {
+    (void)args;
+    if (!s->in_transaction) {
+        send_response(s->fd, "No open transaction\n");
+        return 0;
+    }
+    multi_txn_clear(&s->txn);
+    s->in_transaction = 0;
+    send_response(s->fd, "Transaction aborted\n");
+    return 0;
+}
+
+// The leg list may have arrived in the same read as the command
+static int cmd_transfer_batch(ClientSession *s, const CommandArgs *args) {
+    transferBatch(s->user_id, s->fd, args->rest);
+    return 0;
+}
+
+static int cmd_assign_loan(ClientSession *s, const CommandArgs *args) {
+    assignLoanToEmployee(s->user_id, args->ids[0], args->ids[1], s->fd);
+    return 0;
+}
+
+static int cmd_exit(ClientSession *s, const CommandArgs *args) {
+    (void)args;
+    exitCustomer(s->user_id, s->fd);
+    return -1;
+}
+
+// Handlers that need nothing but the caller and the socket
+#define USER_COMMAND(name, call) \
+    static int name(ClientSession *s, const CommandArgs *args) { (void)args; call(s->user_id, s->fd); return 0; }
+#define FD_COMMAND(name, call) \
+    static int name(ClientSession *s, const CommandArgs *args) { (void)args; call(s->fd); return 0; }
+
+USER_COMMAND(cmd_balance, getBalance)
+USER_COMMAND(cmd_balance_at, getBalanceAt)
+USER_COMMAND(cmd_loan, applyLoan)
+USER_COMMAND(cmd_feedback, addFeedback)
+USER_COMMAND(cmd_history, viewTransactionHistory)
+USER_COMMAND(cmd_loan_decide, approveRejectLoans)
+USER_COMMAND(cmd_my_loans, viewAssignedLoanApplications)
+USER_COMMAND(cmd_deactivate, deactivateUser)
+USER_COMMAND(cmd_reactivate, reactivateUser)
+FD_COMMAND(cmd_add_cust, addNewCustomer)
+FD_COMMAND(cmd_edit_cust, editCustomerDetails)
+FD_COMMAND(cmd_cust_trans, viewCustomerTransactions)
+FD_COMMAND(cmd_staff_balance_at, viewBalanceAt)
+FD_COMMAND(cmd_view_feedback, viewAllFeedback)
+FD_COMMAND(cmd_view_users, viewAllUsers)
+FD_COMMAND(cmd_add_emp, addEmployee)
+FD_COMMAND(cmd_add_mgr, addManager)
+FD_COMMAND(cmd_view_logs, viewSystemLogs)
+FD_COMMAND(cmd_archive_txns, archiveTransactions)
+FD_COMMAND(cmd_eod, endOfDay)
+
+// Every command a logged-in session can run, grouped by opcode. A command
+// whose roles differ in what it does (BALANCE_AT) has one entry per
+// variant. `inputs` is how many further messages it reads after the
+// command line: the event loop runs a request once all of them have
+// arrived, so its handler never waits on the socket. LOGIN is handled
+// before a session has a role and is not listed.
+static const Command commands[] = {
+    { OP_EXIT,           ~0u,                     ARGS_NONE,            0, cmd_exit },
+    { OP_BALANCE,        ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            0, cmd_balance },
+    { OP_BALANCE_AT,     ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            1, cmd_balance_at },
+    { OP_BALANCE_AT,     STAFF_ROLES,             ARGS_NONE,            2, cmd_staff_balance_at },  // username, time
+    { OP_DEPOSIT,        ROLE_BIT(ROLE_CUSTOMER), ARGS_IDEMPOTENCY_KEY, 1, cmd_deposit },
+    { OP_WITHDRAW,       ROLE_BIT(ROLE_CUSTOMER), ARGS_IDEMPOTENCY_KEY, 1, cmd_withdraw },
+    { OP_TRANSFER,       ROLE_BIT(ROLE_CUSTOMER), ARGS_IDEMPOTENCY_KEY, 2, cmd_transfer },          // recipient, amount
+    { OP_BEGIN,          ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            0, cmd_begin },
+    { OP_COMMIT,         ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            0, cmd_commit },
+    { OP_ABORT,          ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            0, cmd_abort },
+    { OP_TRANSFER_BATCH, ROLE_BIT(ROLE_CUSTOMER), ARGS_REST,            SESSION_INTERACTIVE, cmd_transfer_batch },
+    { OP_LOAN,           ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            1, cmd_loan },
+    { OP_FEEDBACK,       ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            1, cmd_feedback },
+    { OP_HISTORY,        ROLE_BIT(ROLE_CUSTOMER), ARGS_NONE,            0, cmd_history },
+    { OP_ADD_CUST,       STAFF_ROLES,             ARGS_NONE,            3, cmd_add_cust },          // username, password, balance
+    { OP_EDIT_CUST,      STAFF_ROLES,             ARGS_NONE,            SESSION_INTERACTIVE, cmd_edit_cust },
+    { OP_LOAN_DECIDE,    STAFF_ROLES,             ARGS_NONE,            SESSION_INTERACTIVE, cmd_loan_decide },
+    { OP_MY_LOANS,       STAFF_ROLES,             ARGS_NONE,            0, cmd_my_loans },
+    { OP_CUST_TRANS,     STAFF_ROLES,             ARGS_NONE,            1, cmd_cust_trans },
+    { OP_ASSIGN_LOAN,    ROLE_BIT(ROLE_MANAGER),  ARGS_TWO_IDS,         0, cmd_assign_loan },       // loan id, employee id
+    { OP_VIEW_FEEDBACK,  ROLE_BIT(ROLE_MANAGER),  ARGS_NONE,            0, cmd_view_feedback },
+    { OP_VIEW_USERS,     ROLE_BIT(ROLE_MANAGER) | ROLE_BIT(ROLE_ADMIN), ARGS_NONE, 0, cmd_view_users },
+    { OP_ADD_EMP,        ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            2, cmd_add_emp },
+    { OP_ADD_MGR,        ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            2, cmd_add_mgr },
+    { OP_DEACTIVATE,     ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            1, cmd_deactivate },
+    { OP_REACTIVATE,     ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            1, cmd_reactivate },
+    { OP_VIEW_LOGS,      ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            0, cmd_view_logs },
+    { OP_ARCHIVE_TXNS,   ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            1, cmd_archive_txns },
+    { OP_EOD,            ROLE_BIT(ROLE_ADMIN),    ARGS_NONE,            SESSION_INTERACTIVE, cmd_eod },  // long-running, streams progress
+};
+#define COMMAND_COUNT (int)(sizeof(commands) / sizeof(commands[0]))
+
+// Index of each opcode's first entry in commands[], or -1
+static int first_command[OP_COUNT];
+
+// Text commands are found by a perfect hash of their names: the seed is
+// chosen at startup so that no two names share a slot, and a lookup is
+// one hash and one compare
+static uint32_t hash_seed;
+static uint8_t hash_slots[HASH_SLOTS];   // opcode, or 0 for an empty slot
+
+static uint32_t name_hash(uint32_t seed, const char *name, size_t len) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return (h ^ (h >> 15)) & (HASH_SLOTS - 1);
+}
+
+static int try_seed(uint32_t seed) {
+    memset(hash_slots, 0, sizeof(hash_slots));
+    for (int op = 1; op < OP_COUNT; op++) {
+        const char *name = opcode_name(op);
+        uint32_t slot = name_hash(seed, name, strlen(name));
+        if (hash_slots[slot] != 0) return -1;
+        hash_slots[slot] = (uint8_t)op;
+    }
+    return 0;
+}
+
+// Builds the opcode index and the name hash. Returns -1 if the table is
+// out of order or no collision-free seed exists (grow HASH_SLOTS).
+int commands_init(void) {
+    for (int op = 0; op < OP_COUNT; op++) first_command[op] = -1;
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        int op = commands[i].opcode;
+        if (first_command[op] == -1) first_command[op] = i;
+        else if (commands[i - 1].opcode != op) return -1;
+    }
+    for (hash_seed = 0; hash_seed < HASH_MAX_SEED; hash_seed++)
+        if (try_seed(hash_seed) == 0) return 0;
+    return -1;
+}
+
+// The entry the role may run for an opcode, or NULL
+const Command *command_for_opcode(int opcode, enum Role role) {
+    if (opcode <= 0 || opcode >= OP_COUNT || first_command[opcode] == -1) return NULL;
+    for (int i = first_command[opcode]; i < COMMAND_COUNT && commands[i].opcode == opcode; i++)
+        if (commands[i].roles & ROLE_BIT(role)) return &commands[i];
+    return NULL;
+}
+
+// The entry the role may run for a text command word, or NULL
+const Command *command_lookup(const char *name, size_t len, enum Role role) {
+    int op = hash_slots[name_hash(hash_seed, name, len)];
+    const char *expected = opcode_name(op);
+    if (expected == NULL || strlen(expected) != len || memcmp(expected, name, len) != 0)
+        return NULL;
+    return command_for_opcode(op, role);
+}
+
+// Parses the command-line arguments after the command word as the
+// command's schema says, then runs it. Every command passes through here.
+int command_run(const Command *c, ClientSession *s, const char *args) {
+    CommandArgs parsed = { .key = "", .ids = { 0, 0 }, .rest = args };
+    char word[64];
+    switch (c->args) {
+        case ARGS_IDEMPOTENCY_KEY:
+            if (sscanf(args, "%63s", word) == 1 && strncmp(word, "KEY=", 4) == 0)
+                snprintf(parsed.key, sizeof(parsed.key), "%s", word + 4);
+            break;
+        case ARGS_TWO_IDS:
+            sscanf(args, "%d %d", &parsed.ids[0], &parsed.ids[1]);
+            break;
+        case ARGS_NONE:
+        case ARGS_REST:
+            break;
+    }
+    long started = metrics_now_usec();
+    int status = c->handler(s, &parsed);
+    metrics_observe_command(c->opcode, metrics_now_usec() - started);
+    return status;
+}
@@ -0,0 +1,213 @@
+/* src/commit.c */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "commit.h"
+#include "metrics.h"
+
+// A queued fsync. Group-mode requests live on the caller's stack and the
+// caller waits for `done`; async requests are heap-allocated, own a dup()
+// of the fd, and are freed by the committer.
+typedef struct {
+    int fd;
+    int owned;
+    int done;
+    int result;
+    long queued_usec;
+} SyncRequest;
+
+static CommitConfig config = { DURABILITY_STRICT, 1, 0 };
+static SyncRequest **pending = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond;      // CLOCK_MONOTONIC, set up by commit_init()
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+int parse_durability_mode(const char *name, enum DurabilityMode *mode) {
+    if (strcmp(name, "strict") == 0)      *mode = DURABILITY_STRICT;
+    else if (strcmp(name, "group") == 0)  *mode = DURABILITY_GROUP;
+    else if (strcmp(name, "async") == 0)  *mode = DURABILITY_ASYNC;
+    else return -1;
+    return 0;
+}
+
+enum DurabilityMode commit_mode(void) {
+    return config.mode;
+}
+
+// fsyncs each distinct file in the batch once, however many fds point at it
+static void flush_batch(SyncRequest **batch, int count) {
+    dev_t *devs = malloc(count * sizeof(dev_t));
+    ino_t *inos = malloc(count * sizeof(ino_t));
+    int *results = malloc(count * sizeof(int));
+    int synced = 0;
+
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (devs == NULL || inos == NULL || results == NULL || fstat(batch[i]->fd, &st) == -1) {
+            batch[i]->result = fsync(batch[i]->fd);
+            continue;
+        }
+        int j;
+        for (j = 0; j < synced; j++)
+            if (devs[j] == st.st_dev && inos[j] == st.st_ino) break;
+        if (j == synced) {
+            devs[synced] = st.st_dev;
+            inos[synced] = st.st_ino;
+            results[synced] = fsync(batch[i]->fd);
+            synced++;
+        }
+        batch[i]->result = results[j];
+    }
+    free(devs);
+    free(inos);
+    free(results);
+}
+
+// Wakes every request in the batch with `result`; async ones are freed.
+// Called with commit_lock held.
+static void finish_batch(SyncRequest **batch, int count, int result) {
+    long now = metrics_now_usec();
+    for (int i = 0; i < count; i++) {
+        if (result != 0) batch[i]->result = result;
+        if (batch[i]->owned) {
+            metrics_observe(LATENCY_COMMIT, now - batch[i]->queued_usec);
+            close(batch[i]->fd);
+            free(batch[i]);
+        } else {
+            batch[i]->done = 1;
+        }
+    }
+    pthread_cond_broadcast(&done_cond);
+}
+
+static void *committer_main(void *arg) {
+    (void)arg;
+    SyncRequest **batch = NULL;
+    int batch_capacity = 0;
+
+    pthread_mutex_lock(&commit_lock);
+    while (1) {
+        while (pending_count == 0)
+            pthread_cond_wait(&work_cond, &commit_lock);
+
+        // Give the batch a chance to fill, bounded by max_latency_us
+        if (config.max_latency_us > 0 && pending_count < config.max_batch) {
+            // Both sides are CLOCK_MONOTONIC: queued_usec and work_cond
+            long deadline_us = pending[0]->queued_usec + config.max_latency_us;
+            if (deadline_us > metrics_now_usec()) {
+                struct timespec until = { .tv_sec = deadline_us / 1000000,
+                                          .tv_nsec = (deadline_us % 1000000) * 1000 };
+                while (pending_count < config.max_batch &&
+                       pthread_cond_timedwait(&work_cond, &commit_lock, &until) != ETIMEDOUT)
+                    ;
+            }
+        }
+
+        if (batch_capacity < pending_count) {
+            SyncRequest **grown = realloc(batch, pending_capacity * sizeof(SyncRequest *));
+            if (grown == NULL) {
+                // Nothing was flushed: every queued caller sees the failure
+                finish_batch(pending, pending_count, -1);
+                pending_count = 0;
+                continue;
+            }
+            batch = grown;
+            batch_capacity = pending_capacity;
+        }
+        int count = pending_count;
+        memcpy(batch, pending, count * sizeof(SyncRequest *));
+        pending_count = 0;
+        pthread_mutex_unlock(&commit_lock);
+
+        flush_batch(batch, count);
+        metrics_add(METRIC_COMMIT_BATCHES, 1);
+
+        pthread_mutex_lock(&commit_lock);
+        finish_batch(batch, count, 0);
+    }
+    return NULL;
+}
+
+int commit_init(const CommitConfig *new_config) {
+    config = *new_config;
+    if (config.max_batch < 1) config.max_batch = 1;
+    if (config.max_latency_us < 0) config.max_latency_us = 0;
+    if (config.mode == DURABILITY_STRICT) return 0;
+
+    // The batch deadline is computed from metrics_now_usec()'s clock
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0 ||
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+        pthread_cond_init(&work_cond, &attr) != 0)
+        return -1;
+    pthread_condattr_destroy(&attr);
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, committer_main, NULL) != 0) return -1;
+    pthread_detach(th);
+    return 0;
+}
+
+// Drop-in replacement for fsync() on every mutation path. What "durable on
+// return" means depends on the configured DurabilityMode.
+int commit_sync(int fd) {
+    long start = metrics_now_usec();
+    metrics_add(METRIC_COMMITS, 1);
+
+    if (config.mode == DURABILITY_STRICT) {
+        int result = fsync(fd);
+        metrics_observe(LATENCY_COMMIT, metrics_now_usec() - start);
+        return result;
+    }
+
+    SyncRequest local = { .fd = fd, .owned = 0, .done = 0, .result = 0, .queued_usec = start };
+    SyncRequest *request = &local;
+    if (config.mode == DURABILITY_ASYNC) {
+        // The caller may close its fd before the flush, so hand over a copy
+        request = malloc(sizeof(SyncRequest));
+        if (request == NULL) return fsync(fd);
+        *request = local;
+        request->owned = 1;
+        request->fd = dup(fd);
+        if (request->fd == -1) {
+            free(request);
+            return fsync(fd);
+        }
+    }
+
+    pthread_mutex_lock(&commit_lock);
+    if (pending_count == pending_capacity) {
+        int capacity = pending_capacity ? pending_capacity * 2 : 64;
+        SyncRequest **grown = realloc(pending, capacity * sizeof(SyncRequest *));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&commit_lock);
+            if (request->owned) {
+                close(request->fd);
+                free(request);
+            }
+            return fsync(fd);
+        }
+        pending = grown;
+        pending_capacity = capacity;
+    }
+    pending[pending_count++] = request;
+    if (pending_count == 1 || pending_count >= config.max_batch)
+        pthread_cond_signal(&work_cond);
+
+    if (config.mode == DURABILITY_ASYNC) {
+        pthread_mutex_unlock(&commit_lock);
+        return 0;
+    }
+    while (!local.done)
+        pthread_cond_wait(&done_cond, &commit_lock);
+    pthread_mutex_unlock(&commit_lock);
+
+    metrics_observe(LATENCY_COMMIT, metrics_now_usec() - start);
+    return local.result;
+}
@@ -14,19 +14,20 @@ getTransactionHistory().    //transactions
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include "types.h"
 #include "helpers.h"
 #include "database.h"
+#include "transactions.h"
+#include "commit.h"
+#include "lockmgr.h"
+#include "format.h"
+#include "snapshot.h"
 
 int getBalance(int customer_id, int socket_fd) {
-    int accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-    if (accounts_fd == -1) {
-        send_response(socket_fd, "Failed to lock accounts file\n");
-        return -1;
-    }
+    // Lock-free: the account seqlock guarantees a consistent copy
     Account *account=find_account_by_user_id(customer_id);
     if (account == NULL) {
-        unlock_file(accounts_fd);
         send_response(socket_fd, "Account not found\n");
         return -1;
     }
@@ -34,7 +35,29 @@ int getBalance(int customer_id, int socket_fd) {
     char message[50];
     snprintf(message,sizeof(message), "Your balance is %.2f\n", balance);
     send_response(socket_fd, message);
-    unlock_file(accounts_fd);
+    return 0;
+}
+
+// Reads a point in time and replies with the account's balance as of then
+int getBalanceAt(int customer_id, int socket_fd) {
+    char text[64];
+    time_t when;
+    if (read_line_from_socket(socket_fd, text, sizeof(text)) != 0 ||
+        parse_point_in_time(text, &when) != 0) {
+        send_response(socket_fd, "Invalid time; use YYYY-MM-DD [HH:MM[:SS]]\n");
+        return -1;
+    }
+    Account *account = find_account_by_user_id(customer_id);
+    double balance;
+    if (account == NULL || balance_at(account->accountID, when, &balance) != 0) {
+        send_response(socket_fd, "Balance history unavailable\n");
+        return -1;
+    }
+    char stamp[32], message[96];
+    struct tm tm;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&when, &tm));
+    snprintf(message, sizeof(message), "Balance at %s was %.2f\n", stamp, balance);
+    send_response(socket_fd, message);
     return 0;
 }
 
@@ -49,51 +72,26 @@ int addFeedback(int customer_id, int socket_fd){
     Feedback fdbk = {
         .custID = customer_id,
         .timestamp = time(NULL),
-        .message = {0},
-        .reserved = {0}
+        .message = {0}
     };
     strncpy(fdbk.message, msg, MAX_FEEDBACK_LEN - 1);
-    //open file
-    int fd = open("data/feedback.dat", O_RDWR|O_CREAT, 0644);
-    if (fd == -1) {
-        send_response(socket_fd, "Failed to open feedback file\n");
+    fdbk.feedbackID = fetch_and_increment_id(TABLE_FEEDBACK);
+    if (fdbk.feedbackID < 0) {
+        send_response(socket_fd, "Failed to allocate feedback ID\n");
         return -1;
     }
-    // Lock
-    struct flock lock = { 
-        .l_type = F_WRLCK,
-        .l_whence = SEEK_SET,
-        .l_start = 0,
-        .l_len = 0
-    };
-    if (fcntl(fd, F_SETLKW, &lock) == -1) {
-        send_response(socket_fd, "Failed to lock feedback file\n");
-        close(fd);
+    // Each append claims its own slot, so no table lock
+    if (append_feedback(&fdbk) < 0) {
+        send_response(socket_fd, "Failed to save feedback\n");
         return -1;
     }
-    // Fetch ID and update header
-    FeedbackHeader header;
-    read(fd, &header, sizeof(FeedbackHeader));
-    fdbk.feedbackID = header.next_id++;
-    header.record_count++;
-    lseek(fd, 0, SEEK_SET);
-    write(fd, &header, sizeof(FeedbackHeader));
-    // add in feedback table
-    lseek(fd, 0, SEEK_END);
-    write(fd, &fdbk, sizeof(Feedback));
-    fsync(fd);
-    // Unlock
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
     send_response(socket_fd, "Feedback submitted successfully\n");
     return 0;
 }
 
 int applyLoan(int customer_id, int socket_fd) {
     if (customer_id <= 0) {
-        char *err_msg = "Invalid customer ID\n";
-        write(socket_fd, err_msg, strlen(err_msg));
+        send_response(socket_fd, "Invalid customer ID\n");
         return -1;
     }
     double loanAmt;
@@ -109,126 +107,83 @@ int applyLoan(int customer_id, int socket_fd) {
         .assigned_employeeID = 0,
         .application_date = time(NULL),
         .decision_date = 0,
-        .reserved = {0}
+        .flags = RECORD_IN_USE
     };
 
-    // Open file
-    int fd;
-    fd = open("data/loans.dat", O_RDWR | O_CREAT, 0644);
-    if (fd == -1) {
-        send_response(socket_fd, "Failed to open loans file\n");
+    new_loan.loanID = fetch_and_increment_id(TABLE_LOANS);
+    if (new_loan.loanID < 0) {
+        send_response(socket_fd, "Failed to allocate loan ID\n");
         return -1;
     }
-    // LOCK
-    struct flock lock;
-    lock.l_type = F_WRLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    if (fcntl(fd, F_SETLKW, &lock) == -1) {
-        send_response(socket_fd, "Failed to lock loans file\n");
-        close(fd);
+    // Each append claims its own slot, so no table lock
+    if (append_loan(&new_loan) < 0) {
+        send_response(socket_fd, "Failed to save loan application\n");
         return -1;
     }
-    new_loan.loanID = fetch_and_increment_id(fd);
-    // Append loan
-    lseek(fd, 0, SEEK_END);
-    write(fd, &new_loan, sizeof(Loan));
-    fsync(fd);
-    // Unlock file
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
     send_response(socket_fd, "Loan application submitted successfully\n");
     return 0;
 }
 
 int viewTransactionHistory(int user_id, int socket_fd) {
-    int accounts_fd, transactions_fd;
     Account *account;
     TransactionRecord transaction;
-    char buffer[1024]; // Buffer for formatting output
-    int bytes_written;
-
-    // Lock accounts.dat to get account_id
-    accounts_fd = lock_file("data/accounts.dat", F_RDLCK);
-    if (accounts_fd == -1) {
-        send_response(socket_fd, "Failed to lock accounts file\n");
-        return -1;
-    }
 
     // Find account
     account = find_account_by_user_id(user_id);
     if (account == NULL) {
-        unlock_file(accounts_fd);
         send_response(socket_fd, "Account not found\n");
         return -1;
     }
     int account_id = account->accountID;
-    unlock_file(accounts_fd);
 
-    // Lock transactions.dat for reading
-    transactions_fd = lock_file("data/transactions.dat", F_RDLCK);
-    if (transactions_fd == -1) {
-        send_response(socket_fd, "Failed to lock transactions file\n");
-        return -1;
-    }
+    // Rows collect in `out` and go out in a few large writes
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_printf(&out, "Transaction History for Account ID %d:\n", account_id);
+    outbuf_printf(&out, "%-20s %-30s %-10s %-10s\n", "Date", "Description", "Amount", "Balance");
+    outbuf_puts(&out, "------------------------------------------------------------\n");
 
-    // Send header (display)
-    snprintf(buffer, sizeof(buffer), "Transaction History for Account ID %d:\n", account_id);
-    send_response(socket_fd, buffer);
-    snprintf(buffer, sizeof(buffer), "%-20s %-30s %-10s %-10s\n", "Date", "Description", "Amount", "Balance");
-    send_response(socket_fd, buffer);
-    snprintf(buffer, sizeof(buffer), "------------------------------------------------------------\n");
-    send_response(socket_fd, buffer);
+    // Read only this account's records, located through the history index
+    int *ids;
+    int count = transaction_ids_for_account(account_id, &ids);
+    for (int i = 0; i < count; i++) {
+        if (read_transaction(ids[i], &transaction) != 0 || transaction.accountID != account_id)
+            continue;
+        // Format transaction
+        char time_str[26], description[64];
+        ctime_r(&transaction.timestamp, time_str);
+        time_str[strlen(time_str) - 1] = '\0'; // Remove newline
+        describe_transaction(&transaction, description, sizeof(description));
+        outbuf_printf(&out, "%-20s %-30s $%-9.2f $%-9.2f\n",
+                      time_str, description, transaction.amount, transaction.new_balance);
+    }
+    free(ids);
 
-    // Read transactions
-    TransactionHeader header;
-    if (read(transactions_fd, &header, sizeof(TransactionHeader)) != sizeof(TransactionHeader)) {
-        unlock_file(transactions_fd);
-        send_response(socket_fd, "Error reading transactions header\n");
-        return -1;
-    }
+    outbuf_puts(&out, "--- End of Transaction History ---\n");
+    outbuf_flush(&out);
+    return 0;
+}
 
-    lseek(transactions_fd, sizeof(TransactionHeader), SEEK_SET);
-    while (read(transactions_fd, &transaction, sizeof(TransactionRecord)) == sizeof(TransactionRecord)) {
-        if (transaction.accountID == account_id) {
-            // Format transaction
-            char time_str[26];
-            ctime_r(&transaction.timestamp, time_str);
-            time_str[strlen(time_str) - 1] = '\0'; // Remove newline
-            snprintf(buffer, sizeof(buffer), "%-20s %-30s $%-9.2f $%-9.2f\n",
-                     time_str, transaction.description, transaction.amount, transaction.new_balance);
-            send_response(socket_fd, buffer);
+// Marks the user's active sessions closed, so they can log in again
+int end_session(int user_id) {
+    if (lock_table(LOCK_SESSIONS, LOCK_EXCLUSIVE) != 0) return -1;
+    Session session;
+    for (int i = 0; read_session_record(i, &session) == 0; i++) {
+        if (session.user_id == user_id && session.session_active) {
+            session.session_active = 0;
+            save_session_record(i, &session);
+            // break;
         }
     }
-
-    // Unlock transactions.dat
-    unlock_file(transactions_fd);
-
-    // Send footer
-    snprintf(buffer, sizeof(buffer), "--- End of Transaction History ---\n");
-    send_response(socket_fd, buffer);
+    unlock_table(LOCK_SESSIONS);
     return 0;
 }
 
 int exitCustomer(int customer_id, int socket_fd) {
-    int fd = lock_file("data/sessions.dat", F_WRLCK);
-    if (fd == -1) {
+    if (end_session(customer_id) != 0) {
         send_response(socket_fd, "Failed to lock sessions file\n");
         return -1;
     }
-    Session session;
-    while (read(fd, &session, sizeof(Session)) == sizeof(Session)) {
-        if (session.user_id == customer_id && session.session_active) {
-            session.session_active = 0;
-            lseek(fd, -sizeof(Session), SEEK_CUR);
-            write(fd, &session, sizeof(Session));
-            fsync(fd);
-            // break;
-        }
-    }
-    unlock_file(fd);
     send_response(socket_fd, "Session terminated\n");
     return 0;
 }
\ No newline at end of file
@@ -2,107 +2,536 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/file.h>
 #include "database.h"
+#include "commit.h"
+#include "store.h"
+#include "lockmgr.h"
 #include "types.h"
 
-static Account account_buffer;
-static User user_buffer;
-int fetch_and_increment_id(int fd) {
-    LoanHeader header;
-    ssize_t bytes_read = read(fd, &header, sizeof(LoanHeader));
-    if (bytes_read != sizeof(LoanHeader)) {
-        // Handle error (file empty or corrupt)
-        header.next_id = 1;
-        header.record_count = 0;
+// Per-thread so concurrent handlers never see each other's lookups
+static __thread Account account_buffer;
+static __thread User user_buffer;
+
+/* ------------------------------------------------------------------ */
+/* Record stores for the fixed-record tables                          */
+/* Every data file is opened once here and only accessed by offset    */
+/* afterwards, so handlers never pay for open/close or a path lookup. */
+/* ------------------------------------------------------------------ */
+static RecordStore user_store = { .fd = -1 };
+static RecordStore account_store = { .fd = -1 };
+static RecordStore loan_store = { .fd = -1 };
+static RecordStore feedback_store = { .fd = -1 };
+static RecordStore session_store = { .fd = -1 };
+
+// Holds an exclusive flock on data/server.lock for the life of the
+// process, so the server and offline tools that write data/ (./eod) never
+// run against the same files at once
+int lock_data_dir(void) {
+    int fd = open("data/server.lock", O_RDWR | O_CREAT, 0644);
+    if (fd == -1) return -1;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return -1;
     }
-    int id = header.next_id;
-    
-    // Updation
-    header.next_id++;
-    header.record_count++;
-    lseek(fd, 0, SEEK_SET);
-    write(fd, &header, sizeof(LoanHeader));
-    fsync(fd);
-    return id;
+    return 0;   // fd stays open: the lock lasts until exit
 }
 
-User *find_user_by_username(const char *username)
-{
-    int fd = open("data/users.dat", O_RDONLY);
-    if (fd == -1) return NULL;
-    lseek(fd, sizeof(UserHeader), SEEK_SET);
-    User u;
-    while (read(fd, &u, sizeof(User)) == sizeof(User)) {
-        if (strcmp(u.username, username) == 0) {
-            user_buffer = u;
-            close(fd);
-            return &user_buffer;
+int open_record_stores(int use_mmap) {
+    // Only the hot slot tables are mapped; the rest are appended and scanned
+    if (store_open(&user_store, "data/users.dat", sizeof(UserHeader), sizeof(User), use_mmap) != 0 ||
+        store_open(&account_store, "data/accounts.dat", sizeof(AccountHeader), sizeof(Account), use_mmap) != 0 ||
+        store_open(&loan_store, "data/loans.dat", sizeof(LoanHeader), sizeof(Loan), 0) != 0 ||
+        store_open(&feedback_store, "data/feedback.dat", sizeof(FeedbackHeader), sizeof(Feedback), 0) != 0 ||
+        store_open(&session_store, "data/sessions.dat", 0, sizeof(Session), 0) != 0) {
+        store_close(&user_store);
+        store_close(&account_store);
+        store_close(&loan_store);
+        store_close(&feedback_store);
+        return -1;
+    }
+    return 0;
+}
+
+// Record #n of users.dat is the user with id n, likewise for accounts.dat
+static void cache_user(const User *user);
+static void note_written(enum DbTable table, int slot);
+
+// Writes the record and refreshes the index's copy of an indexed user;
+// a new user is added by index_user() once saved
+int save_user(const User *user) {
+    int result = store_write(&user_store, user->id, user);
+    if (result == 0) {
+        note_written(TABLE_USERS, user->id);
+        cache_user(user);
+    }
+    return result;
+}
+
+/* ------------------------------------------------------------------ */
+/* Account seqlock: readers never lock                                */
+/* Each account has a sequence number that is odd while its record is */
+/* being rewritten. A reader copies the record and retries if the     */
+/* sequence changed meanwhile or was odd. Writers already hold the    */
+/* record lock, so only readers need this. Sequences live in fixed    */
+/* chunks that are never moved, so lock-free readers can index them   */
+/* while new chunks are published. The chunk directory covers every   */
+/* possible account id; an account with no sequence is never read or */
+/* written, since nothing would protect the copy.                     */
+/* ------------------------------------------------------------------ */
+#define SEQ_CHUNK 65536
+#define SEQ_CHUNKS (INT_MAX / SEQ_CHUNK + 1)   // every non-negative int id
+
+static _Atomic(atomic_uint *) account_seq[SEQ_CHUNKS];
+static pthread_mutex_t account_seq_grow = PTHREAD_MUTEX_INITIALIZER;
+
+// Returns NULL only for a negative id or if a chunk cannot be allocated
+static atomic_uint *seq_for(int account_id) {
+    if (account_id < 0) return NULL;
+    _Atomic(atomic_uint *) *chunk = &account_seq[account_id / SEQ_CHUNK];
+    atomic_uint *seqs = atomic_load(chunk);
+    if (seqs == NULL) {
+        pthread_mutex_lock(&account_seq_grow);
+        seqs = atomic_load(chunk);
+        if (seqs == NULL && (seqs = calloc(SEQ_CHUNK, sizeof(atomic_uint))) != NULL)
+            atomic_store(chunk, seqs);
+        pthread_mutex_unlock(&account_seq_grow);
+    }
+    return seqs ? &seqs[account_id % SEQ_CHUNK] : NULL;
+}
+
+static void seq_write_begin(atomic_uint *seq) {
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);   // odd: readers retry
+    atomic_thread_fence(memory_order_release);
+}
+
+static void seq_write_end(atomic_uint *seq) {
+    atomic_thread_fence(memory_order_release);
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+}
+
+// Consistent copy of account #account_id without taking its record lock
+int read_account(int account_id, Account *out) {
+    atomic_uint *seq = seq_for(account_id);
+    if (seq == NULL) return -1;
+    while (1) {
+        unsigned before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
         }
+        if (store_read(&account_store, account_id, out) != 0) return -1;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == before) return 0;
     }
-    close(fd);
-    return NULL;
 }
 
-Account *find_account_by_user_id(int user_id) {
-    int fd = open("data/accounts.dat", O_RDONLY);
-    if (fd == -1) return NULL;
+// Bulk read for a caller that holds the record locks of every account in
+// the range, so no seqlock retry is needed
+int read_account_range(int first_id, int count, Account *out) {
+    return store_read_range(&account_store, first_id, count, out);
+}
+
+int save_account(const Account *account) {
+    atomic_uint *seq = seq_for(account->accountID);
+    if (seq == NULL) return -1;
+    seq_write_begin(seq);
+    int result = store_write(&account_store, account->accountID, account);
+    seq_write_end(seq);
+    if (result == 0) note_written(TABLE_ACCOUNTS, account->accountID);
+    return result;
+}
 
-    struct flock lock = { 
-        .l_type = F_RDLCK,
-        .l_whence = SEEK_SET, 
-        .l_start = 0,
-        .l_len = 0 
-    };
-    fcntl(fd, F_SETLKW, &lock);
+// For changes already made durable by the WAL: no flush until sync_accounts()
+int put_account(const Account *account) {
+    atomic_uint *seq = seq_for(account->accountID);
+    if (seq == NULL) return -1;
+    seq_write_begin(seq);
+    int result = store_put(&account_store, account->accountID, account);
+    seq_write_end(seq);
+    if (result == 0) note_written(TABLE_ACCOUNTS, account->accountID);
+    return result;
+}
 
-    AccountHeader header;
-    read(fd, &header, sizeof(AccountHeader));
-    lseek(fd, sizeof(AccountHeader), SEEK_SET);
+int sync_accounts(void) {
+    return store_sync(&account_store);
+}
 
-    Account account;
-    while (read(fd, &account, sizeof(Account)) == sizeof(Account)) {
-        if (account.userID == user_id) {
-            account_buffer = account;
-            unlock_file(fd);
-            close(fd);
-            return &account_buffer;
+int read_user_record(int idx, User *out) {
+    return store_read(&user_store, idx, out);
+}
+
+// Loans and feedback are appended, so their slot index is not their id
+int append_loan(const Loan *loan) {
+    int slot = store_append(&loan_store, loan);
+    if (slot >= 0) note_written(TABLE_LOANS, slot);
+    return slot;
+}
+
+int read_loan_record(int idx, Loan *out) {
+    return store_read(&loan_store, idx, out);
+}
+
+int save_loan_record(int idx, const Loan *loan) {
+    return store_write(&loan_store, idx, loan);
+}
+
+int append_feedback(const Feedback *feedback) {
+    int slot = store_append(&feedback_store, feedback);
+    if (slot >= 0) note_written(TABLE_FEEDBACK, slot);
+    return slot;
+}
+
+int read_feedback_record(int idx, Feedback *out) {
+    return store_read(&feedback_store, idx, out);
+}
+
+// sessions.dat has no header; callers hold the LOCK_SESSIONS table lock
+int read_session_record(int idx, Session *out) {
+    return store_read(&session_store, idx, out);
+}
+
+int save_session_record(int idx, const Session *session) {
+    return store_write(&session_store, idx, session);
+}
+
+
+/* ------------------------------------------------------------------ */
+/* In-memory user index                                               */
+/* id       -> User (dense array, ids are auto-increment)             */
+/* username -> id   (open addressing, keyed by FNV-1a hash)           */
+/* Built once at startup from users.dat, then kept in sync by         */
+/* save_user() and by every path that appends or renames a user, so   */
+/* lookups never read users.dat.                                      */
+/* ------------------------------------------------------------------ */
+#define SLOT_EMPTY     -1
+#define SLOT_TOMBSTONE -2
+
+typedef struct {
+    uint32_t hash;
+    int id;
+} NameSlot;
+
+static NameSlot *name_slots = NULL;
+static size_t name_capacity = 0;      // always a power of two
+static size_t name_used = 0;          // live entries + tombstones
+static User *users = NULL;            // users[id]; RECORD_IN_USE once indexed
+static size_t user_capacity = 0;
+static pthread_rwlock_t user_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint32_t hash_username(const char *username) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void name_insert_slot(NameSlot *slots, size_t capacity, uint32_t hash, int id) {
+    size_t i = hash & (capacity - 1);
+    while (slots[i].id >= 0)
+        i = (i + 1) & (capacity - 1);
+    slots[i].hash = hash;
+    slots[i].id = id;
+}
+
+static int name_grow(void) {
+    size_t new_capacity = name_capacity ? name_capacity * 2 : 1024;
+    NameSlot *slots = malloc(new_capacity * sizeof(NameSlot));
+    if (slots == NULL) return -1;
+    for (size_t i = 0; i < new_capacity; i++) slots[i].id = SLOT_EMPTY;
+
+    name_used = 0;
+    for (size_t i = 0; i < name_capacity; i++) {
+        if (name_slots[i].id >= 0) {
+            name_insert_slot(slots, new_capacity, name_slots[i].hash, name_slots[i].id);
+            name_used++;
         }
     }
-    unlock_file(fd);
-    close(fd);
+    free(name_slots);
+    name_slots = slots;
+    name_capacity = new_capacity;
+    return 0;
+}
+
+// Doubles, or sizes to fit `id` exactly when that is further, so the
+// startup build of a large table allocates it once
+static int user_grow(int id) {
+    size_t new_capacity = user_capacity ? user_capacity * 2 : 1024;
+    if (new_capacity <= (size_t)id) new_capacity = (size_t)id + 1024;
+    User *grown = realloc(users, new_capacity * sizeof(User));
+    if (grown == NULL) return -1;
+    memset(grown + user_capacity, 0, (new_capacity - user_capacity) * sizeof(User));
+    users = grown;
+    user_capacity = new_capacity;
+    return 0;
+}
+
+static int cached(int id) {
+    return id >= 0 && (size_t)id < user_capacity && (users[id].flags & RECORD_IN_USE);
+}
+
+static int index_user_locked(const User *u) {
+    if (u->id < 0) return -1;
+    if ((name_used + 1) * 10 >= name_capacity * 7 && name_grow() != 0)
+        return -1;
+    if ((size_t)u->id >= user_capacity && user_grow(u->id) != 0)
+        return -1;
+
+    name_insert_slot(name_slots, name_capacity, hash_username(u->username), u->id);
+    name_used++;
+    users[u->id] = *u;
+    users[u->id].flags |= RECORD_IN_USE;
+    return 0;
+}
+
+// Finds the slot holding `username`
+static NameSlot *name_lookup_locked(const char *username) {
+    if (name_capacity == 0) return NULL;
+    uint32_t hash = hash_username(username);
+    size_t i = hash & (name_capacity - 1);
+    while (name_slots[i].id != SLOT_EMPTY) {
+        if (name_slots[i].id >= 0 && name_slots[i].hash == hash &&
+            strcmp(users[name_slots[i].id].username, username) == 0)
+            return &name_slots[i];
+        i = (i + 1) & (name_capacity - 1);
+    }
     return NULL;
 }
-User *find_user_by_id(int id) {
-    int fd = lock_file("data/users.dat", F_RDLCK);
-    if (fd == -1) return NULL;
-    lseek(fd, sizeof(UserHeader), SEEK_SET);
-    User user;
-    while (read(fd, &user, sizeof(User)) == sizeof(User)) {
-        if (user.id == id) {
-            user_buffer = user;
-            unlock_file(fd);
-            return &user_buffer;
+
+int build_user_index(void) {
+    if (lock_table(LOCK_USERS, LOCK_SHARED) != 0) return -1;
+    int count = store_count(&user_store);
+
+    pthread_rwlock_wrlock(&user_index_lock);
+    free(name_slots);
+    free(users);
+    name_slots = NULL;
+    users = NULL;
+    name_capacity = name_used = user_capacity = 0;
+
+    int result = name_grow();
+    if (result == 0 && count > 0) result = user_grow(count - 1);
+    User u;
+    for (int i = 0; result == 0 && i < count && read_user_record(i, &u) == 0; i++)
+        if (u.flags & RECORD_IN_USE)   // skip ids allocated but never saved
+            result = index_user_locked(&u);
+    pthread_rwlock_unlock(&user_index_lock);
+    unlock_table(LOCK_USERS);
+    return result;
+}
+
+static void cache_user(const User *user) {
+    pthread_rwlock_wrlock(&user_index_lock);
+    if (cached(user->id)) {
+        users[user->id] = *user;
+        users[user->id].flags |= RECORD_IN_USE;
+    }
+    pthread_rwlock_unlock(&user_index_lock);
+}
+
+int index_user(const User *u) {
+    pthread_rwlock_wrlock(&user_index_lock);
+    int result = index_user_locked(u);
+    pthread_rwlock_unlock(&user_index_lock);
+    return result;
+}
+
+int unindex_username(const char *username) {
+    pthread_rwlock_wrlock(&user_index_lock);
+    NameSlot *slot = name_lookup_locked(username);
+    if (slot) slot->id = SLOT_TOMBSTONE;
+    pthread_rwlock_unlock(&user_index_lock);
+    return slot ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------ */
+/* Per-table id allocation                                            */
+/* Ids come from an in-memory atomic counter. The header's next_id is */
+/* only a reservation: it is moved ID_BLOCK ids ahead (and fsynced)   */
+/* once per block, so restarting from it never reissues an id. Slot   */
+/* tables (record #n has id n) restart from their slot count instead, */
+/* which leaves no holes behind an unused reservation.                */
+/* ------------------------------------------------------------------ */
+#define ID_BLOCK 64
+
+typedef struct {
+    RecordStore *store;
+    int slotted;
+    atomic_int next_id;
+    atomic_int record_count;      // slots written, see note_written()
+    atomic_int reserved;          // header next_id on disk; ids below it are safe
+    pthread_mutex_t reserve_lock;
+} IdCounter;
+
+static IdCounter id_counters[TABLE_COUNT] = {
+    [TABLE_USERS]    = { &user_store,     1, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+    [TABLE_ACCOUNTS] = { &account_store,  1, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+    [TABLE_LOANS]    = { &loan_store,     0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+    [TABLE_FEEDBACK] = { &feedback_store, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+};
+
+// Call once at startup, after open_record_stores()
+int open_id_counters(void) {
+    for (int t = 0; t < TABLE_COUNT; t++) {
+        IdCounter *c = &id_counters[t];
+        FileHeader header;
+        if (pread(c->store->fd, &header, sizeof(header), 0) != sizeof(header))
+            return -1;
+        int count = store_count(c->store);
+        int next = (c->slotted || header.next_id < count) ? count : header.next_id;
+        atomic_store(&c->next_id, next);
+        atomic_store(&c->record_count, count);
+        atomic_store(&c->reserved, next);
+    }
+    return 0;
+}
+
+// Returns a fresh id for the table, or -1
+int fetch_and_increment_id(enum DbTable table) {
+    IdCounter *c = &id_counters[table];
+    int id = atomic_fetch_add(&c->next_id, 1);
+    if (id < atomic_load(&c->reserved)) return id;
+
+    pthread_mutex_lock(&c->reserve_lock);
+    int result = id;
+    if (id >= atomic_load(&c->reserved)) {
+        FileHeader header;
+        if (pread(c->store->fd, &header, sizeof(header), 0) != sizeof(header)) {
+            result = -1;
+        } else {
+            header.next_id = id + ID_BLOCK;
+            header.record_count = atomic_load(&c->record_count);
+            if (pwrite(c->store->fd, &header, sizeof(header), 0) != sizeof(header) ||
+                commit_sync(c->store->fd) != 0)
+                result = -1;
+            else
+                atomic_store(&c->reserved, header.next_id);
         }
     }
-    unlock_file(fd);
-    return NULL;
+    pthread_mutex_unlock(&c->reserve_lock);
+    return result;
 }
 
-int lock_file(const char *filename, int type) {
-    int fd = open(filename, O_RDWR | O_CREAT, 0644);
-    if (fd == -1) return -1;
+// Counts slot `slot` as written. The count moves only once a record is
+// on file, so an id handed out but never saved is not counted.
+static void note_written(enum DbTable table, int slot) {
+    atomic_int *count = &id_counters[table].record_count;
+    int seen = atomic_load(count);
+    while (seen <= slot && !atomic_compare_exchange_weak(count, &seen, slot + 1))
+        ;
+}
 
-    struct flock lock = { .l_type = type, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0, .l_pid=getpid() };
-    if (fcntl(fd, F_SETLKW, &lock) == -1) {
-        close(fd);
-        return -1;
+// Slots written: one past the highest written id for users and accounts,
+// the number of records for loans and feedback
+int table_record_count(enum DbTable table) {
+    return atomic_load(&id_counters[table].record_count);
+}
+
+/* ------------------------------------------------------------------ */
+/* In-memory account index: userID -> accountID                       */
+/* accounts.dat stores Account #n at sizeof(AccountHeader) + n *      */
+/* sizeof(Account), so the accountID alone locates the record.        */
+/* ------------------------------------------------------------------ */
+static int *user_accounts = NULL;     // indexed by userID, -1 if none
+static size_t user_accounts_capacity = 0;
+static pthread_rwlock_t account_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int index_account_locked(int user_id, int account_id) {
+    if (user_id < 0) return -1;
+    if ((size_t)user_id >= user_accounts_capacity) {
+        size_t new_capacity = user_accounts_capacity ? user_accounts_capacity : 1024;
+        while (new_capacity <= (size_t)user_id) new_capacity *= 2;
+        int *ids = realloc(user_accounts, new_capacity * sizeof(int));
+        if (ids == NULL) return -1;
+        for (size_t i = user_accounts_capacity; i < new_capacity; i++) ids[i] = -1;
+        user_accounts = ids;
+        user_accounts_capacity = new_capacity;
     }
-    return fd;
+    user_accounts[user_id] = account_id;
+    return 0;
+}
+
+int build_account_index(void) {
+    if (lock_table(LOCK_ACCOUNTS, LOCK_SHARED) != 0) return -1;
+    int count = store_count(&account_store);
+
+    pthread_rwlock_wrlock(&account_index_lock);
+    free(user_accounts);
+    user_accounts = NULL;
+    user_accounts_capacity = 0;
+
+    int result = 0;
+    Account account;
+    for (int i = 0; result == 0 && i < count && store_read(&account_store, i, &account) == 0; i++)
+        if (account.flags & RECORD_IN_USE)
+            result = index_account_locked(account.userID, account.accountID);
+    pthread_rwlock_unlock(&account_index_lock);
+    unlock_table(LOCK_ACCOUNTS);
+    return result;
 }
 
-int unlock_file(int fd) {
-    struct flock lock = { .l_type = F_UNLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
-    int result = fcntl(fd, F_SETLK, &lock);
-    close(fd);
+int index_account(const Account *account) {
+    pthread_rwlock_wrlock(&account_index_lock);
+    int result = index_account_locked(account->userID, account->accountID);
+    pthread_rwlock_unlock(&account_index_lock);
     return result;
 }
+
+int account_id_for_user(int user_id) {
+    int account_id = -1;
+    pthread_rwlock_rdlock(&account_index_lock);
+    if (user_id >= 0 && (size_t)user_id < user_accounts_capacity)
+        account_id = user_accounts[user_id];
+    pthread_rwlock_unlock(&account_index_lock);
+    return account_id;
+}
+
+User *find_user_by_username(const char *username)
+{
+    pthread_rwlock_rdlock(&user_index_lock);
+    NameSlot *slot = name_lookup_locked(username);
+    if (slot != NULL) user_buffer = users[slot->id];
+    pthread_rwlock_unlock(&user_index_lock);
+    return slot != NULL ? &user_buffer : NULL;
+}
+
+Account *find_account_by_user_id(int user_id) {
+    int account_id = account_id_for_user(user_id);
+    if (account_id < 0) return NULL;
+
+    Account account;
+    if (read_account(account_id, &account) != 0 || account.userID != user_id)
+        return NULL;
+    account_buffer = account;
+    return &account_buffer;
+}
+User *find_user_by_id(int id) {
+    pthread_rwlock_rdlock(&user_index_lock);
+    int found = cached(id) && users[id].id == id;
+    if (found) user_buffer = users[id];
+    pthread_rwlock_unlock(&user_index_lock);
+    return found ? &user_buffer : NULL;
+}
+
+// Looks up a user and takes its record lock exclusively. The record is
+// re-read under the lock so the caller sees the latest version.
+// Release with unlock_record(LOCK_USERS, user->id).
+User *lock_user_by_username(const char *username) {
+    User *u = find_user_by_username(username);
+    if (u == NULL) return NULL;
+    int id = u->id;
+    if (lock_record(LOCK_USERS, id, LOCK_EXCLUSIVE) != 0) return NULL;
+    u = find_user_by_id(id);
+    if (u == NULL || strcmp(u->username, username) != 0) {
+        unlock_record(LOCK_USERS, id);
+        return NULL;
+    }
+    return u;
+}
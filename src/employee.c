@@ -9,15 +9,18 @@
 #include "types.h"
 #include "helpers.h"
 #include "database.h"
+#include "commit.h"
 #include "transactions.h"
 #include "customer.h"
 #include "employee.h"
+#include "lockmgr.h"
 
 // addNewCustomer()
 // editCustomerDetails()
 // approveRejectLoans()
 // viewAssignedLoanApplications()
 // viewCustomerTransactions()
+// viewBalanceAt()
 
 
 // 1. Add New Customer
@@ -52,53 +55,44 @@ int addNewCustomer(int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) { send_response(socket_fd, "Lock users.dat failed\n"); return -1; }
+    if (lock_table(LOCK_USERS, LOCK_EXCLUSIVE) != 0) { send_response(socket_fd, "Lock users.dat failed\n"); return -1; }
 
     if (find_user_by_username(username) != NULL) {
-        unlock_file(users_fd);
+        unlock_table(LOCK_USERS);
         send_response(socket_fd, "Username already exists\n");
         return -1;
     }
 
-    UserHeader uhdr;
-    read(users_fd, &uhdr, sizeof(UserHeader));
     User new_user = {0};
-    new_user.id = uhdr.next_id++;
+    new_user.id = fetch_and_increment_id(TABLE_USERS);
+    if (new_user.id < 0) {
+        unlock_table(LOCK_USERS);
+        send_response(socket_fd, "Failed to allocate user ID\n");
+        return -1;
+    }
     strncpy(new_user.username, username, MAX_USERNAME_LEN-1);
     strncpy(new_user.password_hash, password, MAX_PASSWORD_LEN-1); 
     new_user.role = ROLE_CUSTOMER;
     new_user.active = 1;
     new_user.last_login = 0;
-    memset(new_user.reserved, 0, sizeof(new_user.reserved));
+    new_user.flags = RECORD_IN_USE;
 
-    lseek(users_fd, 0, SEEK_SET);
-    write(users_fd, &uhdr, sizeof(UserHeader));
-    lseek(users_fd, 0, SEEK_END);
-    write(users_fd, &new_user, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    save_user(&new_user);
+    index_user(&new_user);
+    unlock_table(LOCK_USERS);
 
     /* ---- accounts.dat ---- */
-    int accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-    if (accounts_fd == -1) { send_response(socket_fd, "Lock accounts.dat failed\n"); return -1; }
-
-    AccountHeader ahdr;
-    read(accounts_fd, &ahdr, sizeof(AccountHeader));
     Account new_acc = {0};
-    new_acc.accountID = ahdr.next_id++;
-    ahdr.record_count++;
+    new_acc.accountID = fetch_and_increment_id(TABLE_ACCOUNTS);
+    if (new_acc.accountID < 0) { send_response(socket_fd, "Failed to allocate account ID\n"); return -1; }
     new_acc.userID   = new_user.id;
     new_acc.balance  = initial_balance;
     new_acc.transaction_count = 0;
-    memset(new_acc.reserved, 0, sizeof(new_acc.reserved));
+    new_acc.flags = RECORD_IN_USE;
+    new_acc.opened = (uint32_t)time(NULL);
 
-    lseek(accounts_fd, 0, SEEK_SET);
-    write(accounts_fd, &ahdr, sizeof(AccountHeader));
-    lseek(accounts_fd, 0, SEEK_END);
-    write(accounts_fd, &new_acc, sizeof(Account));
-    fsync(accounts_fd);
-    unlock_file(accounts_fd);
+    save_account(&new_acc);
+    index_account(&new_acc);
 
     send_response(socket_fd, "Customer added successfully\n");
     return 0;
@@ -113,12 +107,16 @@ int editCustomerDetails(int socket_fd) {
         return -1;
     }
 
-    int users_fd = lock_file("data/users.dat", F_WRLCK);
-    if (users_fd == -1) { send_response(socket_fd, "Lock users.dat failed\n"); return -1; }
-
-    User *u = find_user_by_username(username);
-    if (u == NULL || u->role != ROLE_CUSTOMER) {
-        unlock_file(users_fd);
+    User *found = lock_user_by_username(username);
+    if (found == NULL) {
+        send_response(socket_fd, "Customer not found\n");
+        return -1;
+    }
+    /* Work on a copy: later lookups reuse the buffer behind `found` */
+    User customer = *found;
+    User *u = &customer;
+    if (u->role != ROLE_CUSTOMER) {
+        unlock_record(LOCK_USERS, u->id);
         send_response(socket_fd, "Customer not found\n");
         return -1;
     }
@@ -131,39 +129,69 @@ int editCustomerDetails(int socket_fd) {
     send_response(socket_fd, buf);
 
     char new_user[MAX_USERNAME_LEN];
-    if (read_line_from_socket(socket_fd, new_user, MAX_USERNAME_LEN) != 0 ||
-        new_user[0] != '.') {
+    char old_username[MAX_USERNAME_LEN];
+    strncpy(old_username, u->username, sizeof(old_username) - 1);
+    old_username[sizeof(old_username) - 1] = '\0';
+    int renamed = 0;
+    if (read_line_from_socket(socket_fd, new_user, MAX_USERNAME_LEN) != 0) {
+        unlock_record(LOCK_USERS, u->id);
+        send_response(socket_fd, "Error reading new username\n");
+        return -1;
+    }
+    if (new_user[0] != '.') {
         /* change username */
         if (find_user_by_username(new_user) != NULL) {
-            unlock_file(users_fd);
+            unlock_record(LOCK_USERS, u->id);
             send_response(socket_fd, "New username already taken\n");
             return -1;
         }
         strncpy(u->username, new_user, MAX_USERNAME_LEN-1);
+        renamed = 1;
     }
 
     send_response(socket_fd, "Enter new password (or . to keep): ");
     char new_pass[MAX_PASSWORD_LEN];
-    if (read_line_from_socket(socket_fd, new_pass, MAX_PASSWORD_LEN) != 0 ||
-        new_pass[0] != '.') {
+    if (read_line_from_socket(socket_fd, new_pass, MAX_PASSWORD_LEN) != 0) {
+        unlock_record(LOCK_USERS, u->id);
+        send_response(socket_fd, "Error reading new password\n");
+        return -1;
+    }
+    if (new_pass[0] != '.') {
         strncpy(u->password_hash, new_pass, MAX_PASSWORD_LEN-1);
     }
 
     send_response(socket_fd, "Set active (1/0): ");
-    int active;
     char act_buf[8];
-    if (read_line_from_socket(socket_fd, act_buf, sizeof(act_buf)) == 0)
-        active = atoi(act_buf);
-    else
-        active = u->active;
-    u->active = (active == 0) ? 0 : 1;
+    if (read_line_from_socket(socket_fd, act_buf, sizeof(act_buf)) != 0) {
+        unlock_record(LOCK_USERS, u->id);
+        send_response(socket_fd, "Error reading active flag\n");
+        return -1;
+    }
+    u->active = (atoi(act_buf) == 0) ? 0 : 1;
 
     /* rewrite the record */
-    // lseek(users_fd, sizeof(UserHeader) + (u->id-1)*sizeof(User), SEEK_SET);
-    lseek(users_fd, sizeof(UserHeader) + (u->id)*sizeof(User), SEEK_SET);
-    write(users_fd, u, sizeof(User));
-    fsync(users_fd);
-    unlock_file(users_fd);
+    if (renamed) {
+        // Re-check under the table lock: the name may have been taken
+        // while this session was waiting on input
+        if (lock_table(LOCK_USERS, LOCK_EXCLUSIVE) != 0) {
+            unlock_record(LOCK_USERS, u->id);
+            send_response(socket_fd, "Lock users.dat failed\n");
+            return -1;
+        }
+        if (find_user_by_username(u->username) != NULL) {
+            unlock_table(LOCK_USERS);
+            unlock_record(LOCK_USERS, u->id);
+            send_response(socket_fd, "New username already taken\n");
+            return -1;
+        }
+        unindex_username(old_username);
+    }
+    save_user(u);
+    if (renamed) {
+        index_user(u);
+        unlock_table(LOCK_USERS);
+    }
+    unlock_record(LOCK_USERS, u->id);
 
     send_response(socket_fd, "Customer details updated\n");
     return 0;
@@ -185,24 +213,23 @@ int approveRejectLoans(int employee_id, int socket_fd) {
     }
     loan_id = atoi(buf);
 
-    int loans_fd = lock_file("data/loans.dat", F_WRLCK);
-    if (loans_fd == -1) { send_response(socket_fd, "Lock loans.dat failed\n"); return -1; }
-
-    LoanHeader lhdr;
-    read(loans_fd, &lhdr, sizeof(LoanHeader));
+    /* Lock only this loan's record; other loans stay available */
+    if (lock_record(LOCK_LOANS, loan_id, LOCK_EXCLUSIVE) != 0) {
+        send_response(socket_fd, "Loan not found or not assigned to you\n");
+        return -1;
+    }
     Loan loan;
     int found = 0;
-    off_t pos = sizeof(LoanHeader);
-    while (read(loans_fd, &loan, sizeof(Loan)) == sizeof(Loan)) {
+    int slot = 0;
+    for (; read_loan_record(slot, &loan) == 0; slot++) {
         if (loan.loanID == loan_id && loan.assigned_employeeID == employee_id &&
             loan.status == LOAN_NEW) {
             found = 1;
             break;
         }
-        pos += sizeof(Loan);
     }
     if (!found) {
-        unlock_file(loans_fd);
+        unlock_record(LOCK_LOANS, loan_id);
         send_response(socket_fd, "Loan not found or not assigned to you\n");
         return -1;
     }
@@ -210,33 +237,56 @@ int approveRejectLoans(int employee_id, int socket_fd) {
     send_response(socket_fd, "Enter A (approve) or R (reject): ");
     char choice[8];
     if (read_string_from_socket(socket_fd, choice, sizeof(choice)) != 0) {
-        unlock_file(loans_fd);
+        unlock_record(LOCK_LOANS, loan_id);
         send_response(socket_fd, "Error reading choice\n");
         return -1;
     }
 
     if (choice[0] == 'A' || choice[0] == 'a') {
+        // No account to pay into: refuse, and the loan stays LOAN_NEW
+        int account_id = account_id_for_user(loan.custID);
+        if (account_id < 0) {
+            unlock_record(LOCK_LOANS, loan_id);
+            send_response(socket_fd, "Customer has no account; loan left pending\n");
+            return -1;
+        }
         loan.status = LOAN_APPROVED;
-        /* OPTIONAL: credit the amount to the customer's account */
-        Account *acc = find_account_by_user_id(loan.custID);
-        if (acc) {
-            deposit(loan.custID, loan.amount, socket_fd);   // reuse deposit logic
+        loan.decision_date = time(NULL);
+        // The approval is recorded before the disbursement commits: a crash
+        // in between leaves an approved loan without its credit, never a
+        // loan that is still pending after it has been paid out
+        if (save_loan_record(slot, &loan) != 0) {
+            unlock_record(LOCK_LOANS, loan_id);
+            send_response(socket_fd, "Failed to record loan decision\n");
+            return -1;
+        }
+        MultiTxn disbursement;
+        char error[96];
+        multi_txn_init(&disbursement);
+        int result = multi_txn_add(&disbursement, TXN_DEPOSIT, account_id, -1, loan.amount);
+        if (result == 0) result = multi_txn_commit(&disbursement, error, sizeof(error));
+        multi_txn_clear(&disbursement);
+        if (result != 0) {
+            loan.status = LOAN_NEW;
+            loan.decision_date = 0;
+            save_loan_record(slot, &loan);
+            unlock_record(LOCK_LOANS, loan_id);
+            send_response(socket_fd, "Loan disbursement failed; loan left pending\n");
+            return -1;
         }
     } else if (choice[0] == 'R' || choice[0] == 'r') {
         loan.status = LOAN_REJECTED;
         // send_response(socket_fd, "Enter rejection reason: ");
         // read_string_from_socket(socket_fd, loan.reason, sizeof(loan.reason));
     } else {
-        unlock_file(loans_fd);
+        unlock_record(LOCK_LOANS, loan_id);
         send_response(socket_fd, "Invalid choice\n");
         return -1;
     }
 
     loan.decision_date = time(NULL);
-    lseek(loans_fd, pos, SEEK_SET);
-    write(loans_fd, &loan, sizeof(Loan));
-    fsync(loans_fd);
-    unlock_file(loans_fd);
+    save_loan_record(slot, &loan);
+    unlock_record(LOCK_LOANS, loan_id);
 
     send_response(socket_fd, "Loan decision recorded\n");
     return 0;
@@ -246,37 +296,32 @@ int approveRejectLoans(int employee_id, int socket_fd) {
 /* 4. View Assigned Loan Applications                                    */
 /* --------------------------------------------------------------------- */
 int viewAssignedLoanApplications(int employee_id, int socket_fd) {
-    int fd = lock_file("data/loans.dat", F_RDLCK);
-    if (fd == -1) { send_response(socket_fd, "Lock loans.dat failed\n"); return -1; }
-
-    LoanHeader hdr;
-    read(fd, &hdr, sizeof(LoanHeader));
+    if (lock_table(LOCK_LOANS, LOCK_SHARED) != 0) { send_response(socket_fd, "Lock loans.dat failed\n"); return -1; }
 
-    char line[256];
-    snprintf(line, sizeof(line),
-             "Assigned Pending Loans (Employee %d):\n"
-             "%-8s %-12s %-10s %-12s\n",
-             employee_id, "LoanID", "CustomerID", "Amount", "Applied");
-    send_response(socket_fd, line);
-    snprintf(line, sizeof(line), "-----------------------------------------\n");
-    send_response(socket_fd, line);
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_printf(&out,
+                  "Assigned Pending Loans (Employee %d):\n"
+                  "%-8s %-12s %-10s %-12s\n",
+                  employee_id, "LoanID", "CustomerID", "Amount", "Applied");
+    outbuf_puts(&out, "-----------------------------------------\n");
 
     Loan loan;
     int count = 0;
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan)) {
+    for (int i = 0; read_loan_record(i, &loan) == 0; i++) {
         if (loan.assigned_employeeID == employee_id && loan.status == LOAN_NEW) {
             char tbuf[30];
             struct tm *tm_info = localtime(&loan.application_date);
             strftime(tbuf, sizeof(tbuf), "%Y-%m-%d", tm_info);
-            snprintf(line, sizeof(line), "%-8d %-12d $%-9.2f %-12s\n",
-                     loan.loanID, loan.custID, loan.amount, tbuf);
-            send_response(socket_fd, line);
+            outbuf_printf(&out, "%-8d %-12d $%-9.2f %-12s\n",
+                          loan.loanID, loan.custID, loan.amount, tbuf);
             count++;
         }
     }
-    if (count == 0) send_response(socket_fd, "(none)\n");
-    send_response(socket_fd, "--- End of Loan List ---\n");
-    unlock_file(fd);
+    if (count == 0) outbuf_puts(&out, "(none)\n");
+    outbuf_puts(&out, "--- End of Loan List ---\n");
+    unlock_table(LOCK_LOANS);
+    outbuf_flush(&out);
     return 0;
 }
 
@@ -300,6 +345,22 @@ int viewCustomerTransactions(int socket_fd) {
     return viewTransactionHistory(u->id, socket_fd);
 }
 
+// Employee/manager: a customer's balance at a point in time, for audits
+int viewBalanceAt(int socket_fd) {
+    char username[MAX_USERNAME_LEN];
+    if (read_line_from_socket(socket_fd, username, MAX_USERNAME_LEN) != 0) {
+        send_response(socket_fd, "Error reading username\n");
+        return -1;
+    }
+
+    User *u = find_user_by_username(username);
+    if (u == NULL || u->role != ROLE_CUSTOMER) {
+        send_response(socket_fd, "Customer not found\n");
+        return -1;
+    }
+    return getBalanceAt(u->id, socket_fd);
+}
+
 /* -----------------------------------------*/
 /* 6. (Manager) Assign Loan to Employee     */
 /* -----------------------------------------*/
@@ -317,32 +378,28 @@ int assignLoanToEmployee(int manager_id, int loan_id, int employee_id, int socke
         return -1;
     }
 
-    int fd = lock_file("data/loans.dat", F_WRLCK);
-    if (fd == -1) { send_response(socket_fd, "Lock loans.dat failed\n"); return -1; }
-
-    LoanHeader hdr;
-    read(fd, &hdr, sizeof(LoanHeader));
+    if (lock_record(LOCK_LOANS, loan_id, LOCK_EXCLUSIVE) != 0) {
+        send_response(socket_fd, "Loan not found or not pending\n");
+        return -1;
+    }
     Loan loan;
     int found = 0;
-    off_t pos = sizeof(LoanHeader);
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan)) {
+    int slot = 0;
+    for (; read_loan_record(slot, &loan) == 0; slot++) {
         if (loan.loanID == loan_id && loan.status == LOAN_NEW) {
             loan.assigned_employeeID = employee_id;
             found = 1;
             break;
         }
-        pos += sizeof(Loan);
     }
     if (!found) {
-        unlock_file(fd);
+        unlock_record(LOCK_LOANS, loan_id);
         send_response(socket_fd, "Loan not found or not pending\n");
         return -1;
     }
 
-    lseek(fd, pos, SEEK_SET);
-    write(fd, &loan, sizeof(Loan));
-    fsync(fd);
-    unlock_file(fd);
+    save_loan_record(slot, &loan);
+    unlock_record(LOCK_LOANS, loan_id);
 
     char msg[128];
     snprintf(msg, sizeof(msg), "Loan %d assigned to employee %d\n", loan_id, employee_id);
@@ -354,30 +411,25 @@ int assignLoanToEmployee(int manager_id, int loan_id, int employee_id, int socke
 /* 7. View All Feedback                                                  */
 /* --------------------------------------------------------------------- */
 int viewAllFeedback(int socket_fd) {
-    int fd = lock_file("data/feedback.dat", F_RDLCK);
-    if (fd == -1) { send_response(socket_fd, "Lock feedback.dat failed\n"); return -1; }
-
-    FeedbackHeader hdr;
-    read(fd, &hdr, sizeof(FeedbackHeader));
+    if (lock_table(LOCK_FEEDBACK, LOCK_SHARED) != 0) { send_response(socket_fd, "Lock feedback.dat failed\n"); return -1; }
 
-    char line[256];
-    snprintf(line, sizeof(line),
-             "Customer Feedback (%d entries):\n"
-             "%-8s %-12s %-20s %s\n",
-             hdr.record_count, "ID", "CustID", "Date", "Message");
-    send_response(socket_fd, line);
-    snprintf(line, sizeof(line), "------------------------------------------------------------\n");
-    send_response(socket_fd, line);
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_printf(&out,
+                  "Customer Feedback (%d entries):\n"
+                  "%-8s %-12s %-20s %s\n",
+                  table_record_count(TABLE_FEEDBACK), "ID", "CustID", "Date", "Message");
+    outbuf_puts(&out, "------------------------------------------------------------\n");
 
     Feedback fb;
-    while (read(fd, &fb, sizeof(Feedback)) == sizeof(Feedback)) {
+    for (int i = 0; read_feedback_record(i, &fb) == 0; i++) {
         char tbuf[30];
         struct tm *tm_info = localtime(&fb.timestamp);
         strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M", tm_info);
-        snprintf(line, sizeof(line), "%-8d %-12d %-20s %.80s\n",
-                 fb.feedbackID, fb.custID, tbuf, fb.message);
-        send_response(socket_fd, line);
+        outbuf_printf(&out, "%-8d %-12d %-20s %.80s\n",
+                      fb.feedbackID, fb.custID, tbuf, fb.message);
     }
-    unlock_file(fd);
+    unlock_table(LOCK_FEEDBACK);
+    outbuf_flush(&out);
     return 0;
 }
\ No newline at end of file
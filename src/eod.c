@@ -0,0 +1,311 @@
+/* src/eod.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "eod.h"
+#include "types.h"
+#include "database.h"
+#include "transactions.h"
+#include "lockmgr.h"
+#include "commit.h"
+#include "metrics.h"
+
+#define EOD_STATE_PATH "data/eod.dat"
+#define EOD_CHUNK_ACCOUNTS 4096    // accounts per commit; one WAL entry each
+#define EOD_REPORT_USEC 1000000
+
+/* ------------------------------------------------------------------ */
+/* Partitioning: worker w owns a fixed slice of the record-lock        */
+/* stripes, i.e. the ids whose id % LOCK_STRIPES falls in its slice.   */
+/* Workers therefore never wait on each other's locks, only on         */
+/* customer traffic. A worker walks accounts.dat in blocks of          */
+/* LOCK_STRIPES ids, takes its slice of several blocks at a time as a  */
+/* chunk, and commits each chunk as a single WAL entry.                */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    int index;
+    int stripe_lo, stripe_hi;   // [lo, hi)
+    int total;                  // accounts with a smaller id are posted
+    int resume;                 // the first chunk may be committed already
+    int failed;
+    pthread_t thread;
+} Worker;
+
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;   // one run at a time
+static int state_fd = -1;
+static EodState state;
+
+static atomic_long accounts_done;
+static atomic_long postings_done;
+static atomic_long interest_cents;
+static atomic_long fee_cents;
+static atomic_int workers_running;
+
+static int save_state(void) {
+    if (pwrite(state_fd, &state, sizeof(state), 0) != sizeof(state)) return -1;
+    return commit_sync(state_fd);
+}
+
+// Records that every block below next_block is posted for this worker.
+// Workers own separate slots, so these writes need no lock.
+static int save_progress(int worker, int next_block) {
+    state.next_block[worker] = next_block;
+    off_t offset = offsetof(EodState, next_block) + (off_t)worker * sizeof(int);
+    if (pwrite(state_fd, &next_block, sizeof(int), offset) != sizeof(int)) return -1;
+    return commit_sync(state_fd);
+}
+
+// A crash between a chunk's commit and its save_progress() leaves the
+// chunk looking unposted. It was committed as one WAL entry, so it is
+// posted if any of its accounts already has this date's record.
+static int chunk_already_posted(const Account *accounts, int count, int business_date) {
+    for (int i = 0; i < count; i++) {
+        if (!(accounts[i].flags & RECORD_IN_USE)) continue;
+        int *ids;
+        int n = transaction_ids_for_account(accounts[i].accountID, &ids);
+        int posted = 0;
+        for (int j = n - 1; j >= 0; j--) {
+            TransactionRecord t;
+            if (read_transaction(ids[j], &t) != 0 || t.type != TXN_END_OF_DAY) continue;
+            posted = t.counterpartyID == business_date;
+            break;
+        }
+        free(ids);
+        if (posted) return 1;
+    }
+    return 0;
+}
+
+static long to_cents(double value) {
+    return (long)(value < 0 ? value - 0.5 : value + 0.5);
+}
+
+// Builds the chunk's postings from the locked account images and commits
+// them. Returns the number of postings, or -1.
+static int post_chunk(const Account *accounts, int count, Account *images,
+                      TransactionRecord *transactions) {
+    int postings = 0;
+    long interest_sum = 0, fee_sum = 0;
+    for (int i = 0; i < count; i++) {
+        const Account *account = &accounts[i];
+        if (!(account->flags & RECORD_IN_USE)) continue;
+
+        // Whole cents throughout: balance * pct / 365 is a day's interest in cents
+        long balance = to_cents(account->balance * 100);
+        long interest = balance > 0 ? to_cents(account->balance * state.annual_rate_pct / 365.0) : 0;
+        long fee = to_cents(state.fee * 100);
+        if (fee > balance + interest) fee = balance + interest > 0 ? balance + interest : 0;
+        if (interest == 0 && fee == 0) continue;
+
+        Account *image = &images[postings];
+        *image = *account;
+        image->balance = (balance + interest - fee) / 100.0;
+        image->transaction_count++;
+        TransactionRecord *t = &transactions[postings];
+        prepare_transaction(t, image->accountID, TXN_END_OF_DAY, (interest - fee) / 100.0, image->balance);
+        t->counterpartyID = state.business_date;
+        postings++;
+        interest_sum += interest;
+        fee_sum += fee;
+    }
+    if (postings > 0 && commit_postings(images, postings, transactions, postings) != 0) return -1;
+    atomic_fetch_add(&interest_cents, interest_sum);
+    atomic_fetch_add(&fee_cents, fee_sum);
+    return postings;
+}
+
+static void *eod_worker(void *arg) {
+    Worker *w = arg;
+    int width = w->stripe_hi - w->stripe_lo;
+    int chunk_blocks = EOD_CHUNK_ACCOUNTS / width > 0 ? EOD_CHUNK_ACCOUNTS / width : 1;
+    int blocks = (w->total + LOCK_STRIPES - 1) / LOCK_STRIPES;
+    int capacity = chunk_blocks * width;
+    int *ids = malloc(capacity * sizeof(int));
+    Account *accounts = malloc(capacity * sizeof(Account));
+    Account *images = malloc(capacity * sizeof(Account));
+    TransactionRecord *transactions = malloc(capacity * sizeof(TransactionRecord));
+    if (ids == NULL || accounts == NULL || images == NULL || transactions == NULL) w->failed = 1;
+
+    for (int block = state.next_block[w->index]; !w->failed && block < blocks; block += chunk_blocks) {
+        int end_block = block + chunk_blocks < blocks ? block + chunk_blocks : blocks;
+        int count = 0;
+        for (int b = block; b < end_block; b++)
+            for (int s = w->stripe_lo; s < w->stripe_hi && b * LOCK_STRIPES + s < w->total; s++)
+                ids[count++] = b * LOCK_STRIPES + s;
+        if (count == 0) continue;
+
+        if (lock_record_set(LOCK_ACCOUNTS, ids, count, LOCK_EXCLUSIVE) != 0) {
+            w->failed = 1;
+            break;
+        }
+        // The slice of each block is a run of adjacent records: one read per block
+        for (int b = block, at = 0; b < end_block && at < count; b++) {
+            int first = b * LOCK_STRIPES + w->stripe_lo;
+            int run = w->stripe_hi - w->stripe_lo;
+            if (first + run > w->total) run = w->total - first;
+            if (run <= 0) break;
+            // An account still being opened may not be written yet; read one
+            // by one, and a slot that cannot be read is left unused
+            if (read_account_range(first, run, &accounts[at]) != 0)
+                for (int i = 0; i < run; i++)
+                    if (read_account(first + i, &accounts[at + i]) != 0)
+                        memset(&accounts[at + i], 0, sizeof(Account));
+            at += run;
+        }
+        int posted = 0;
+        if (!(w->resume && chunk_already_posted(accounts, count, state.business_date)))
+            posted = post_chunk(accounts, count, images, transactions);
+        unlock_record_set(LOCK_ACCOUNTS, ids, count);
+
+        if (posted < 0 || save_progress(w->index, end_block) != 0) {
+            w->failed = 1;
+            break;
+        }
+        w->resume = 0;
+        atomic_fetch_add(&accounts_done, count);
+        atomic_fetch_add(&postings_done, posted);
+    }
+    free(ids);
+    free(accounts);
+    free(images);
+    free(transactions);
+    atomic_fetch_sub(&workers_running, 1);
+    return NULL;
+}
+
+static void snapshot_progress(long total, EodProgress *out) {
+    out->accounts_total = total;
+    out->accounts_done = atomic_load(&accounts_done);
+    out->postings = atomic_load(&postings_done);
+    out->interest_total = atomic_load(&interest_cents) / 100.0;
+    out->fees_total = atomic_load(&fee_cents) / 100.0;
+}
+
+// Loads data/eod.dat and decides whether this is a fresh run or the
+// resumption of an unfinished one. Caller holds run_lock.
+static int prepare_run(const EodConfig *config, int *resume, char *error, size_t len) {
+    if (state_fd == -1 && (state_fd = open(EOD_STATE_PATH, O_RDWR | O_CREAT, 0644)) == -1) {
+        snprintf(error, len, "cannot open %s", EOD_STATE_PATH);
+        return -1;
+    }
+    ssize_t n = pread(state_fd, &state, sizeof(state), 0);
+    if (n == 0) {
+        memset(&state, 0, sizeof(state));
+    } else if (n != sizeof(state) || state.magic != EOD_MAGIC || state.version != DB_FORMAT_VERSION ||
+               state.workers < 1 || state.workers > EOD_MAX_WORKERS) {
+        snprintf(error, len, "%s is damaged", EOD_STATE_PATH);
+        return -1;
+    }
+
+    *resume = state.state == EOD_RUNNING;
+    if (*resume) {
+        if (state.business_date != config->business_date ||
+            state.annual_rate_pct != config->annual_rate_pct || state.fee != config->fee) {
+            snprintf(error, len, "run for %d is unfinished; finish it first (rate %g%%, fee %.2f)",
+                     state.business_date, state.annual_rate_pct, state.fee);
+            return -1;
+        }
+        return 0;
+    }
+    if (state.state == EOD_DONE && config->business_date <= state.business_date) {
+        snprintf(error, len, "already posted through %d", state.business_date);
+        return -1;
+    }
+
+    int workers = config->workers > 0 ? config->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > EOD_MAX_WORKERS) workers = EOD_MAX_WORKERS;
+    memset(&state, 0, sizeof(state));
+    state.magic = EOD_MAGIC;
+    state.version = DB_FORMAT_VERSION;
+    state.workers = workers;
+    state.business_date = config->business_date;
+    state.state = EOD_RUNNING;
+    state.annual_rate_pct = config->annual_rate_pct;
+    state.fee = config->fee;
+    if (save_state() != 0) {
+        snprintf(error, len, "cannot write %s", EOD_STATE_PATH);
+        return -1;
+    }
+    return 0;
+}
+
+// Posts config->business_date across every account, calling `report`
+// about once a second. A run that fails part-way leaves data/eod.dat
+// marked running; calling again with the same config resumes it.
+int run_end_of_day(const EodConfig *config, eod_progress_fn report, void *arg,
+                   EodProgress *result, char *error, size_t len) {
+    if (config->business_date < 19700101 || config->business_date > 99991231 ||
+        !(config->annual_rate_pct >= 0) || !(config->fee >= 0)) {
+        snprintf(error, len, "invalid date, rate or fee");
+        return -1;
+    }
+    if (pthread_mutex_trylock(&run_lock) != 0) {
+        snprintf(error, len, "an end-of-day run is already in progress");
+        return -1;
+    }
+    int resume;
+    if (prepare_run(config, &resume, error, len) != 0) {
+        pthread_mutex_unlock(&run_lock);
+        return -1;
+    }
+
+    Worker workers[EOD_MAX_WORKERS];
+    int total = table_record_count(TABLE_ACCOUNTS);
+    atomic_store(&accounts_done, 0);
+    atomic_store(&postings_done, 0);
+    atomic_store(&interest_cents, 0);
+    atomic_store(&fee_cents, 0);
+    atomic_store(&workers_running, 0);
+    int started = 0;
+    for (int i = 0; i < state.workers; i++) {
+        Worker *w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->index = i;
+        w->stripe_lo = i * LOCK_STRIPES / state.workers;
+        w->stripe_hi = (i + 1) * LOCK_STRIPES / state.workers;
+        w->total = total;
+        w->resume = resume;
+        atomic_fetch_add(&workers_running, 1);
+        if (pthread_create(&w->thread, NULL, eod_worker, w) != 0) {
+            atomic_fetch_sub(&workers_running, 1);
+            w->failed = 1;
+            break;
+        }
+        started++;
+    }
+
+    EodProgress progress;
+    long last_report = metrics_now_usec();
+    while (atomic_load(&workers_running) > 0) {
+        usleep(50000);
+        if (report != NULL && metrics_now_usec() - last_report >= EOD_REPORT_USEC) {
+            snapshot_progress(total, &progress);
+            report(&progress, arg);
+            last_report = metrics_now_usec();
+        }
+    }
+    int failed = started < state.workers;
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].failed) failed = 1;
+    }
+
+    snapshot_progress(total, result);
+    if (failed) {
+        snprintf(error, len, "posting failed part-way; run again with the same date, rate and fee to resume");
+    } else {
+        state.state = EOD_DONE;
+        if (save_state() != 0) {
+            snprintf(error, len, "posted, but cannot mark %d done in %s", state.business_date, EOD_STATE_PATH);
+            failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&run_lock);
+    return failed ? -1 : 0;
+}
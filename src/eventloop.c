@@ -0,0 +1,318 @@
+/* src/eventloop.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "eventloop.h"
+#include "session.h"
+#include "helpers.h"
+#include "workpool.h"
+#include "frame.h"
+
+#define MESSAGE_SIZE 1024       // one read, as in the thread model
+#define MAX_MESSAGES 4          // a command line plus up to three fields
+#define MAX_EVENTS 256
+#define PENDING_MAX 65536       // unsent refusals before the client is dropped
+#define INPUT_TIMEOUT_SEC 60    // prompt-driven requests: wait for each answer
+
+enum Protocol { PROTOCOL_UNKNOWN, PROTOCOL_TEXT, PROTOCOL_FRAMED };
+
+typedef struct {
+    ClientSession session;
+    int loop;                   // epoll set that owns the connection
+    enum Protocol protocol;     // known from the first byte received
+    FrameBuffer frames;         // framed protocol: requests not yet run
+    char *pending;              // refusals the loop has not sent yet
+    size_t pending_len;
+    int fields_needed;          // -1 until the command line has arrived
+    int interactive;            // reads its own input once running
+    int message_count;
+    int offsets[MAX_MESSAGES];
+    size_t used;
+    char input[MAX_MESSAGES * MESSAGE_SIZE];
+} Connection;
+
+static int *loops = NULL;       // one epoll fd per I/O thread
+static int loop_count = 0;
+
+static void reset_request(Connection *c) {
+    c->fields_needed = -1;
+    c->interactive = 0;
+    c->message_count = 0;
+    c->used = 0;
+}
+
+static int set_blocking(int fd, int blocking) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) return -1;
+    flags = blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+    return fcntl(fd, F_SETFL, flags);
+}
+
+// Connections are registered one-shot: after each event the connection
+// is left alone until rearm(), so a request being run by a worker never
+// races the loop that read it
+static int watch(Connection *c) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = c };
+    return epoll_ctl(loops[c->loop], EPOLL_CTL_ADD, c->session.fd, &ev);
+}
+
+static void close_connection(Connection *c, int disconnected) {
+    epoll_ctl(loops[c->loop], EPOLL_CTL_DEL, c->session.fd, NULL);
+    session_close(&c->session, disconnected);
+    frame_buffer_free(&c->frames);
+    free(c->pending);
+    free(c);
+}
+
+// While refusals are unsent the connection waits to be writable, not
+// readable: nothing new is run, so replies stay in request order
+static void rearm(Connection *c) {
+    uint32_t events = c->pending_len > 0 ? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+    struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.ptr = c };
+    if (epoll_ctl(loops[c->loop], EPOLL_CTL_MOD, c->session.fd, &ev) != 0)
+        close_connection(c, 1);
+}
+
+// Sends what the socket takes now. Returns -1 if the client is gone.
+static int send_pending(Connection *c) {
+    size_t sent = 0;
+    while (sent < c->pending_len) {
+        ssize_t n = write(c->session.fd, c->pending + sent, c->pending_len - sent);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && errno == EAGAIN) break;
+        if (n <= 0) return -1;
+        sent += n;
+    }
+    memmove(c->pending, c->pending + sent, c->pending_len - sent);
+    c->pending_len -= sent;
+    return 0;
+}
+
+// The loop never waits on a client's socket: a refusal is queued on the
+// connection and sent as the socket allows. Returns -1 once a client has
+// left too much unread.
+static int queue_reply(Connection *c, const char *data, size_t len) {
+    if (c->pending_len + len > PENDING_MAX) return -1;
+    char *pending = realloc(c->pending, c->pending_len + len);
+    if (pending == NULL) return -1;
+    memcpy(pending + c->pending_len, data, len);
+    c->pending = pending;
+    c->pending_len += len;
+    return 0;
+}
+
+static int queue_frame(Connection *c, uint32_t request_id, enum FrameKind kind, const char *payload) {
+    char header[FRAME_REPLY_HEADER];
+    size_t len = strlen(payload);
+    frame_encode_reply_header(header, request_id, kind, len);
+    return queue_reply(c, header, sizeof(header)) == 0 ? queue_reply(c, payload, len) : -1;
+}
+
+static void on_writable(Connection *c) {
+    if (send_pending(c) != 0) close_connection(c, 1);
+    else rearm(c);
+}
+
+static int set_input_timeout(int fd, int seconds) {
+    struct timeval tv = { .tv_sec = seconds };
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// Runs on a worker, or for a prompt-driven request on an interactive one. A
+// complete request has its fields fed in place of the socket reads the
+// handler makes; a prompt-driven one gets a blocking socket, since it
+// reads its input only after replying, and gives up on a silent client
+// after INPUT_TIMEOUT_SEC.
+static void run_request(void *arg) {
+    Connection *c = arg;
+    const char *fields[MAX_MESSAGES];
+    for (int i = 1; i < c->message_count; i++)
+        fields[i - 1] = c->input + c->offsets[i];
+    int status;
+    if (c->interactive) {
+        set_input_timeout(c->session.fd, INPUT_TIMEOUT_SEC);
+        set_blocking(c->session.fd, 1);
+        status = session_handle(&c->session, c->input);
+        if (set_blocking(c->session.fd, 0) != 0 || set_input_timeout(c->session.fd, 0) != 0)
+            status = -1;
+    } else {
+        feed_input(fields, c->message_count - 1);
+        status = session_handle(&c->session, c->input);
+        stop_input();
+    }
+    reset_request(c);
+    if (status != 0) close_connection(c, 0);
+    else rearm(c);
+}
+
+// Runs on a worker: every request that has fully arrived, in order
+static void run_frames(void *arg) {
+    Connection *c = arg;
+    size_t used = 0;
+    int status = 0, size;
+    Frame frame;
+    while ((size = frame_parse(c->frames.data + used, c->frames.len - used, &frame)) > 0) {
+        status = session_handle_frame(&c->session, &frame);
+        used += size;
+        if (status != 0) break;
+    }
+    frame_buffer_consume(&c->frames, used);
+    if (status != 0 || size < 0) close_connection(c, status == 0);
+    else rearm(c);
+}
+
+// Framed protocol: reads whatever has arrived; any complete request is
+// queued for a worker together with the rest already buffered
+static void on_frames_readable(Connection *c) {
+    ssize_t n = frame_buffer_read(&c->frames, c->session.fd);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        rearm(c);
+        return;
+    }
+    if (n <= 0) {
+        close_connection(c, 1);
+        return;
+    }
+    Frame frame;
+    int size = frame_parse(c->frames.data, c->frames.len, &frame);
+    if (size < 0) {
+        close_connection(c, 1);
+        return;
+    }
+    if (size == 0 || workpool_submit(POOL_REQUESTS, run_frames, c) == 0) {
+        if (size == 0) rearm(c);
+        return;
+    }
+    // No room: refuse every complete request, each under its own id
+    size_t used = 0;
+    while ((size = frame_parse(c->frames.data + used, c->frames.len - used, &frame)) > 0) {
+        if (queue_frame(c, frame.request_id, FRAME_DATA, SERVER_BUSY_REPLY) != 0 ||
+            queue_frame(c, frame.request_id, FRAME_END, "") != 0) {
+            close_connection(c, 1);
+            return;
+        }
+        used += size;
+    }
+    frame_buffer_consume(&c->frames, used);
+    on_writable(c);
+}
+
+// Text protocol: one read per wakeup; each read is one message, as the
+// blocking handlers see it
+static void on_readable(Connection *c) {
+    if (c->protocol == PROTOCOL_UNKNOWN) {
+        char first;
+        if (recv(c->session.fd, &first, 1, MSG_PEEK) == 1)
+            c->protocol = first == 0 ? PROTOCOL_FRAMED : PROTOCOL_TEXT;
+    }
+    if (c->protocol == PROTOCOL_FRAMED) {
+        on_frames_readable(c);
+        return;
+    }
+    char *message = c->input + c->used;
+    ssize_t n = read(c->session.fd, message, MESSAGE_SIZE - 1);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        rearm(c);
+        return;
+    }
+    if (n <= 0) {
+        close_connection(c, 1);
+        return;
+    }
+    message[n] = '\0';
+    c->offsets[c->message_count++] = c->used;
+    c->used += n + 1;
+
+    if (c->fields_needed == -1) {
+        c->fields_needed = session_input_fields(&c->session, message);
+        if (c->fields_needed == SESSION_INTERACTIVE) {
+            c->interactive = 1;
+            c->fields_needed = 0;
+        }
+    }
+    if (c->message_count < c->fields_needed + 1) {
+        rearm(c);
+        return;
+    }
+    // A prompt-driven request waits on its client between prompts, so it
+    // runs on its own pool: a few silent clients must not hold every worker
+    int started = workpool_submit(c->interactive ? POOL_INTERACTIVE : POOL_REQUESTS, run_request, c);
+    if (started != 0) {
+        // Shed the request, not the connection; the client may retry
+        reset_request(c);
+        if (queue_reply(c, SERVER_BUSY_REPLY, strlen(SERVER_BUSY_REPLY)) != 0) close_connection(c, 1);
+        else on_writable(c);
+    }
+}
+
+static void *loop_main(void *arg) {
+    int epoll_fd = *(int *)arg;
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return NULL;
+        }
+        for (int i = 0; i < n; i++) {
+            Connection *c = events[i].data.ptr;
+            if (events[i].events & EPOLLOUT) on_writable(c);
+            else if (events[i].events & (EPOLLIN | EPOLLRDHUP)) on_readable(c);
+            else close_connection(c, 1);
+        }
+    }
+    return NULL;
+}
+
+// Starts `io_threads` loops, then accepts connections forever, handing
+// them out round-robin. Returns -1 only if the loops cannot be started.
+int eventloop_run(int server_fd, int io_threads) {
+    if (io_threads < 1) io_threads = 1;
+    loops = calloc(io_threads, sizeof(int));
+    if (loops == NULL) return -1;
+    for (loop_count = 0; loop_count < io_threads; loop_count++) {
+        loops[loop_count] = epoll_create1(0);
+        pthread_t th;
+        if (loops[loop_count] == -1 ||
+            pthread_create(&th, NULL, loop_main, &loops[loop_count]) != 0)
+            return -1;
+        pthread_detach(th);
+    }
+
+    int next = 0;
+    while (1) {
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0) {
+            perror("accept");
+            continue;
+        }
+        Connection *c = malloc(sizeof(Connection));
+        if (c == NULL || set_blocking(fd, 0) != 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        session_init(&c->session, fd);
+        c->protocol = PROTOCOL_UNKNOWN;
+        c->frames = (FrameBuffer){ NULL, 0, 0 };
+        c->pending = NULL;
+        c->pending_len = 0;
+        c->loop = next;
+        next = (next + 1) % loop_count;
+        reset_request(c);
+        if (watch(c) != 0) {
+            perror("epoll_ctl");
+            session_close(&c->session, 0);
+            free(c);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* src/format.c */
+#include <stdio.h>
+#include <string.h>
+#include "format.h"
+
+void describe_transaction(const TransactionRecord *transaction, char *buf, size_t len) {
+    switch (transaction->type) {
+    case TXN_DEPOSIT:
+        snprintf(buf, len, "Deposit %.2f", transaction->amount);
+        break;
+    case TXN_WITHDRAWAL:
+        snprintf(buf, len, "Withdrawal %.2f", -transaction->amount);
+        break;
+    case TXN_TRANSFER_OUT:
+        snprintf(buf, len, "Transfer to #%d %.2f", transaction->counterpartyID, -transaction->amount);
+        break;
+    case TXN_TRANSFER_IN:
+        snprintf(buf, len, "Transfer from #%d %.2f", transaction->counterpartyID, transaction->amount);
+        break;
+    case TXN_END_OF_DAY:
+        snprintf(buf, len, "Interest/fees %d %.2f", transaction->counterpartyID, transaction->amount);
+        break;
+    default:
+        snprintf(buf, len, "Transaction %.2f", transaction->amount);
+        break;
+    }
+}
+
+void upgrade_user(const UserV1 *in, User *out) {
+    memset(out, 0, sizeof(*out));
+    out->id = in->id;
+    memcpy(out->username, in->username, MAX_USERNAME_LEN);
+    memcpy(out->password_hash, in->password_hash, MAX_PASSWORD_LEN);
+    out->username[MAX_USERNAME_LEN - 1] = '\0';
+    out->password_hash[MAX_PASSWORD_LEN - 1] = '\0';
+    out->role = in->role;
+    out->active = in->active != 0;
+    out->last_login = in->last_login;
+    out->flags = RECORD_IN_USE;
+}
+
+void upgrade_account(const AccountV1 *in, Account *out) {
+    memset(out, 0, sizeof(*out));
+    out->accountID = in->accountID;
+    out->userID = in->userID;
+    out->balance = in->balance;
+    out->transaction_count = in->transaction_count;
+    out->flags = RECORD_IN_USE;
+}
+
+void widen_account(const AccountV2Narrow *in, Account *out) {
+    memset(out, 0, sizeof(*out));
+    out->accountID = in->accountID;
+    out->userID = in->userID;
+    out->balance = in->balance;
+    out->transaction_count = in->transaction_count;
+    out->flags = in->flags;
+    out->version = in->version;
+}
+
+// v1 kept only free text; every writer produced "Deposit x" or
+// "Withdrawal x", and the sign of the amount settles anything else.
+void upgrade_transaction(const TransactionRecordV1 *in, TransactionRecord *out) {
+    memset(out, 0, sizeof(*out));
+    out->transactionID = in->transactionID;
+    out->accountID = in->accountID;
+    out->timestamp = in->timestamp;
+    out->amount = in->amount;
+    out->new_balance = in->new_balance;
+    out->counterpartyID = -1;
+    if (strncmp(in->description, "Withdrawal", 10) == 0) out->type = TXN_WITHDRAWAL;
+    else if (strncmp(in->description, "Deposit", 7) == 0) out->type = TXN_DEPOSIT;
+    else out->type = in->amount < 0 ? TXN_WITHDRAWAL : TXN_DEPOSIT;
+    // v1 marked a never-written slot by a zero timestamp
+    out->flags = in->timestamp != 0 ? RECORD_IN_USE : 0;
+}
+
+void upgrade_loan(const LoanV1 *in, Loan *out) {
+    memset(out, 0, sizeof(*out));
+    out->loanID = in->loanID;
+    out->custID = in->custID;
+    out->amount = in->amount;
+    out->status = in->status;
+    out->assigned_employeeID = in->assigned_employeeID;
+    out->application_date = in->application_date;
+    out->decision_date = in->decision_date;
+    out->flags = RECORD_IN_USE;
+}
+
+void upgrade_feedback(const FeedbackV1 *in, Feedback *out) {
+    memset(out, 0, sizeof(*out));
+    out->feedbackID = in->feedbackID;
+    out->custID = in->custID;
+    out->timestamp = in->timestamp;
+    memcpy(out->message, in->message, MAX_FEEDBACK_LEN);
+    out->message[MAX_FEEDBACK_LEN - 1] = '\0';
+}
+
+void upgrade_session(const SessionV1 *in, Session *out) {
+    memset(out, 0, sizeof(*out));
+    out->user_id = in->user_id;
+    out->login_time = in->login_time;
+    out->session_active = in->session_active != 0;
+}
@@ -0,0 +1,157 @@
+/* src/frame.c */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "frame.h"
+
+#define FRAME_READ_CHUNK 65536
+
+static const char *opcode_names[OP_COUNT] = {
+    [OP_LOGIN]          = "LOGIN",
+    [OP_EXIT]           = "EXIT",
+    [OP_BALANCE]        = "BALANCE",
+    [OP_BALANCE_AT]     = "BALANCE_AT",
+    [OP_DEPOSIT]        = "DEPOSIT",
+    [OP_WITHDRAW]       = "WITHDRAW",
+    [OP_TRANSFER]       = "TRANSFER",
+    [OP_BEGIN]          = "BEGIN",
+    [OP_COMMIT]         = "COMMIT",
+    [OP_ABORT]          = "ABORT",
+    [OP_TRANSFER_BATCH] = "TRANSFER_BATCH",
+    [OP_LOAN]           = "LOAN",
+    [OP_FEEDBACK]       = "FEEDBACK",
+    [OP_HISTORY]        = "HISTORY",
+    [OP_ADD_CUST]       = "ADD_CUST",
+    [OP_EDIT_CUST]      = "EDIT_CUST",
+    [OP_LOAN_DECIDE]    = "LOAN_DECIDE",
+    [OP_MY_LOANS]       = "MY_LOANS",
+    [OP_CUST_TRANS]     = "CUST_TRANS",
+    [OP_ASSIGN_LOAN]    = "ASSIGN_LOAN",
+    [OP_VIEW_FEEDBACK]  = "VIEW_FEEDBACK",
+    [OP_VIEW_USERS]     = "VIEW_USERS",
+    [OP_ADD_EMP]        = "ADD_EMP",
+    [OP_ADD_MGR]        = "ADD_MGR",
+    [OP_DEACTIVATE]     = "DEACTIVATE",
+    [OP_REACTIVATE]     = "REACTIVATE",
+    [OP_VIEW_LOGS]      = "VIEW_LOGS",
+    [OP_ARCHIVE_TXNS]   = "ARCHIVE_TXNS",
+    [OP_EOD]            = "EOD",
+};
+
+// The text-protocol command for an opcode, or NULL if there is none
+const char *opcode_name(int opcode) {
+    return opcode > 0 && opcode < OP_COUNT ? opcode_names[opcode] : NULL;
+}
+
+static uint32_t get_u32(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint32_t)u[0] << 24 | (uint32_t)u[1] << 16 | (uint32_t)u[2] << 8 | u[3];
+}
+
+static uint16_t get_u16(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint16_t)(u[0] << 8 | u[1]);
+}
+
+static void put_u32(char *p, uint32_t v) {
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+static void put_u16(char *p, uint16_t v) {
+    p[0] = (char)(v >> 8);
+    p[1] = (char)v;
+}
+
+// Decodes the request at the start of buf. Returns its size in bytes,
+// 0 if it has not fully arrived, or -1 if it is malformed.
+int frame_parse(const char *buf, size_t len, Frame *frame) {
+    if (len < 4) return 0;
+    uint32_t body = get_u32(buf);
+    if (body < FRAME_REQUEST_HEADER - 4 || body > FRAME_MAX - 4) return -1;
+    if (len < 4 + (size_t)body) return 0;
+
+    frame->request_id = get_u32(buf + 4);
+    frame->opcode = get_u16(buf + 8);
+    frame->field_count = get_u16(buf + 10);
+    if (frame->field_count > FRAME_MAX_FIELDS) return -1;
+    const char *p = buf + FRAME_REQUEST_HEADER, *end = buf + 4 + body;
+    for (int i = 0; i < frame->field_count; i++) {
+        if (end - p < 4) return -1;
+        uint32_t n = get_u32(p);
+        p += 4;
+        if ((size_t)(end - p) < n) return -1;
+        frame->fields[i] = p;
+        frame->field_lengths[i] = n;
+        p += n;
+    }
+    return p == end ? (int)(4 + body) : -1;
+}
+
+// Writes a request frame into buf. Returns its size, or 0 if it does not fit.
+size_t frame_encode_request(char *buf, size_t capacity, uint32_t request_id, uint16_t opcode,
+                            const char *const *fields, int field_count) {
+    size_t len = FRAME_REQUEST_HEADER;
+    for (int i = 0; i < field_count; i++) len += 4 + strlen(fields[i]);
+    if (len > capacity || len > FRAME_MAX || field_count > FRAME_MAX_FIELDS) return 0;
+    put_u32(buf, (uint32_t)(len - 4));
+    put_u32(buf + 4, request_id);
+    put_u16(buf + 8, opcode);
+    put_u16(buf + 10, (uint16_t)field_count);
+    char *p = buf + FRAME_REQUEST_HEADER;
+    for (int i = 0; i < field_count; i++) {
+        size_t n = strlen(fields[i]);
+        put_u32(p, (uint32_t)n);
+        memcpy(p + 4, fields[i], n);
+        p += 4 + n;
+    }
+    return len;
+}
+
+void frame_encode_reply_header(char *header, uint32_t request_id, enum FrameKind kind,
+                               size_t payload_len) {
+    put_u32(header, (uint32_t)(FRAME_REPLY_HEADER - 4 + payload_len));
+    put_u32(header + 4, request_id);
+    header[8] = (char)kind;
+}
+
+// Appends what one read() returns, growing the buffer as needed. Returns
+// read()'s result, or -1 with nothing read once a frame would exceed
+// FRAME_MAX.
+ssize_t frame_buffer_read(FrameBuffer *b, int fd) {
+    if (b->capacity - b->len < FRAME_READ_CHUNK) {
+        size_t capacity = b->capacity ? b->capacity * 2 : FRAME_READ_CHUNK;
+        while (capacity - b->len < FRAME_READ_CHUNK) capacity *= 2;
+        char *data = capacity > 2 * (size_t)FRAME_MAX ? NULL : realloc(b->data, capacity);
+        if (data == NULL) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        b->data = data;
+        b->capacity = capacity;
+    }
+    ssize_t n = read(fd, b->data + b->len, b->capacity - b->len);
+    if (n > 0) b->len += n;
+    return n;
+}
+
+void frame_buffer_free(FrameBuffer *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->capacity = 0;
+}
+
+// Drops the first n bytes, the frames already handled. An emptied buffer
+// is released, so idle connections hold no memory for it.
+void frame_buffer_consume(FrameBuffer *b, size_t n) {
+    if (n == b->len) {
+        frame_buffer_free(b);
+        return;
+    }
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+}
+
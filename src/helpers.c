@@ -1,17 +1,224 @@
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include "helpers.h"
+#include "frame.h"
+
+#define SEND_TIMEOUT_MS 30000   // a client that stops reading is dropped
+
+// Set by capture_responses(): until stop_capture(), this thread's replies
+// are appended here (truncated to fit) instead of being sent
+static __thread char *capture_buf = NULL;
+static __thread size_t capture_len = 0;
+
+// Set by frame_replies(): until end_frame_replies(), this thread's replies
+// become FRAME_DATA frames carrying the request's id. They are held in
+// frame_out and written together with the FRAME_END frame.
+static __thread int framing = 0;
+static __thread uint32_t frame_request_id = 0;
+static __thread OutBuf frame_out;
+
+// Set by feed_input(): until stop_input(), this thread's socket reads take
+// these already-received messages, one per read, and then find no more
+static __thread const char *const *input_messages = NULL;
+static __thread int input_count = 0;
+static __thread int input_next = 0;
+
+// Writes all of the parts, in as few writev() calls as the socket allows.
+// Event-loop sockets are non-blocking, so a full send buffer is waited out
+// here rather than dropping the rest. Consumes the iovec array.
+static int writev_fully(int socket_fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            count--;
+            continue;
+        }
+        ssize_t n = writev(socket_fd, iov, count);
+        if (n == -1) {
+            struct pollfd pfd = { .fd = socket_fd, .events = POLLOUT };
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && poll(&pfd, 1, SEND_TIMEOUT_MS) == 1) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int write_fully(int socket_fd, const char *message, size_t len) {
+    struct iovec iov = { (void *)message, len };
+    return writev_fully(socket_fd, &iov, 1);
+}
+
+static void hold_reply(const char *payload, size_t len, enum FrameKind kind);
+
+// Replies to a framed or captured request go through send_response()'s
+// path; anything else is written straight to the socket
+static int goes_direct(const OutBuf *out) {
+    return out->raw || (capture_buf == NULL && !framing);
+}
+
+// Adds the parts to the buffer. If they do not fit, the buffered bytes
+// and the parts go out together in one writev().
+static int outbuf_append(OutBuf *out, const struct iovec *parts, int count) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += parts[i].iov_len;
+    if (out->used + total <= OUTBUF_SIZE) {
+        for (int i = 0; i < count; i++) {
+            memcpy(out->data + out->used, parts[i].iov_base, parts[i].iov_len);
+            out->used += parts[i].iov_len;
+        }
+        return 0;
+    }
+    if (!goes_direct(out)) {
+        if (outbuf_flush(out) != 0) return -1;
+        for (int i = 0; i < count; i++) hold_reply(parts[i].iov_base, parts[i].iov_len, FRAME_DATA);
+        return 0;
+    }
+    struct iovec iov[4];
+    iov[0] = (struct iovec){ out->data, out->used };
+    for (int i = 0; i < count && i < 3; i++) iov[i + 1] = parts[i];
+    out->used = 0;
+    return writev_fully(out->fd, iov, count + 1);
+}
+
+// Keeps reply text for the request being captured or framed
+static void hold_reply(const char *payload, size_t len, enum FrameKind kind) {
+    if (capture_buf != NULL) {
+        size_t used = strlen(capture_buf);
+        snprintf(capture_buf + used, capture_len - used, "%.*s", (int)len, payload);
+        return;
+    }
+    char header[FRAME_REPLY_HEADER];
+    frame_encode_reply_header(header, frame_request_id, kind, len);
+    struct iovec parts[2] = { { header, sizeof(header) }, { (void *)payload, len } };
+    outbuf_append(&frame_out, parts, 2);
+}
+
+void outbuf_init(OutBuf *out, int socket_fd) {
+    out->fd = socket_fd;
+    out->raw = 0;
+    out->used = 0;
+}
+
+void outbuf_puts(OutBuf *out, const char *text) {
+    struct iovec part = { (void *)text, strlen(text) };
+    outbuf_append(out, &part, 1);
+}
+
+// Formats straight into the buffer; a row that does not fit in what is
+// left is sent along with the buffered rows
+void outbuf_printf(OutBuf *out, const char *format, ...) {
+    char row[1024];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->used, OUTBUF_SIZE - out->used, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n < OUTBUF_SIZE - out->used) {
+        out->used += n;
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(row, sizeof(row), format, args);
+    va_end(args);
+    outbuf_puts(out, row);
+}
+
+// Sends everything buffered. Call at the end of every response.
+int outbuf_flush(OutBuf *out) {
+    if (out->used == 0) return 0;
+    size_t len = out->used;
+    out->used = 0;
+    if (goes_direct(out)) return write_fully(out->fd, out->data, len);
+    hold_reply(out->data, len, FRAME_DATA);
+    return 0;
+}
 
 void send_response(int socket_fd, const char *message) {
-    write(socket_fd, message, strlen(message));
+    if (capture_buf != NULL || framing) {
+        hold_reply(message, strlen(message), FRAME_DATA);
+        return;
+    }
+    write_fully(socket_fd, message, strlen(message));
+}
+
+void frame_replies(int socket_fd, uint32_t request_id) {
+    framing = 1;
+    frame_request_id = request_id;
+    outbuf_init(&frame_out, socket_fd);
+    frame_out.raw = 1;
+}
+
+// Sends the framed replies held so far, for a request that reports
+// progress while it runs. Text-protocol replies are never held.
+void flush_responses(void) {
+    if (framing) outbuf_flush(&frame_out);
+}
+
+// Marks the framed request's reply complete: the held replies and the
+// FRAME_END frame leave in one write
+void end_frame_replies(void) {
+    hold_reply("", 0, FRAME_END);
+    outbuf_flush(&frame_out);
+    framing = 0;
+}
+
+void capture_responses(char *buf, size_t len) {
+    buf[0] = '\0';
+    capture_buf = buf;
+    capture_len = len;
+}
+
+void stop_capture(void) {
+    capture_buf = NULL;
+    capture_len = 0;
+}
+
+void feed_input(const char *const *messages, int count) {
+    input_messages = messages;
+    input_count = count;
+    input_next = 0;
+}
+
+void stop_input(void) {
+    input_messages = NULL;
+    input_count = 0;
+    input_next = 0;
+}
+
+// One message: the next fed one, else whatever one read() returns. A
+// request whose input was fed never reads the socket itself.
+static ssize_t receive(int fd, void *buf, size_t len) {
+    if (input_messages != NULL) {
+        if (input_next == input_count) return 0;
+        const char *message = input_messages[input_next++];
+        size_t n = strlen(message);
+        if (n > len) n = len;
+        memcpy(buf, message, n);
+        return n;
+    }
+    return read(fd, buf, len);
 }
 
 int read_username_from_socket(int socket_fd, char *username, size_t max_len) {
     char buffer[MAX_USERNAME_LEN];
-    ssize_t bytes_read = read(socket_fd, buffer, max_len - 1);
+    ssize_t bytes_read = receive(socket_fd, buffer, max_len - 1);
     if (bytes_read <= 0) return -1;
     buffer[bytes_read] = '\0';
     strncpy(username, buffer, max_len);
@@ -19,13 +226,13 @@ int read_username_from_socket(int socket_fd, char *username, size_t max_len) {
 }
 
 int read_string_from_socket(int socket_fd, char *buffer, size_t max_len) {
-    ssize_t bytes_read = read(socket_fd, buffer, max_len - 1);
+    ssize_t bytes_read = receive(socket_fd, buffer, max_len - 1);
     if (bytes_read <= 0) return -1;
     buffer[bytes_read] = '\0';
     return 0;
 }
 int read_line_from_socket(int fd, char *buf, size_t max) {
-    ssize_t n = read(fd, buf, max - 1);
+    ssize_t n = receive(fd, buf, max - 1);
     if (n <= 0) return -1;
     buf[n] = '\0';
     /* strip trailing newline if present */
@@ -34,14 +241,14 @@ int read_line_from_socket(int fd, char *buf, size_t max) {
     return 0;
 }
 int read_double_from_socket(int socket_fd, double *dbl, size_t max_len) {
-    ssize_t bytes_read = read(socket_fd, dbl, max_len - 1);
+    ssize_t bytes_read = receive(socket_fd, dbl, max_len - 1);
     if (bytes_read <= 0) return -1;
     return 0;
 }
 
 double read_amount_from_socket(int socket_fd) {
     char buffer[32];
-    ssize_t bytes_read = read(socket_fd, buffer, sizeof(buffer) - 1);
+    ssize_t bytes_read = receive(socket_fd, buffer, sizeof(buffer) - 1);
     if (bytes_read <= 0) return -1.0;
     buffer[bytes_read] = '\0';
     double amount;
@@ -0,0 +1,228 @@
+/* src/idempotency.c */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "idempotency.h"
+#include "store.h"
+#include "commit.h"
+
+#define BUCKETS (IDEMPOTENCY_SLOTS * 2)
+
+// Slot i of the ring mirrors record i of the file. A pending slot belongs
+// to a request that is still running and is never reused.
+typedef struct {
+    IdempotencyRecord record;
+    int pending;
+    int next;               // next slot in the same bucket, -1 ends the chain
+} Slot;
+
+static RecordStore key_store = { .fd = -1 };
+static Slot *slots = NULL;
+static int buckets[BUCKETS];
+static uint64_t next_sequence = 1;
+static pthread_mutex_t key_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished_cond = PTHREAD_COND_INITIALIZER;
+
+// The key this thread's next commit carries into its WAL entry
+static __thread IdempotencyRecord armed;
+static __thread int armed_set = 0;
+static __thread int armed_logged = 0;     // its WAL entry is durable
+
+static unsigned bucket_for(int user_id, const char *key) {
+    uint32_t h = 2166136261u ^ (uint32_t)user_id;
+    for (const char *p = key; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h % BUCKETS;
+}
+
+// Caller holds key_lock
+static int find_locked(int user_id, const char *key) {
+    for (int i = buckets[bucket_for(user_id, key)]; i != -1; i = slots[i].next)
+        if (slots[i].record.userID == user_id && strcmp(slots[i].record.key, key) == 0)
+            return i;
+    return -1;
+}
+
+static void link_locked(int idx) {
+    unsigned b = bucket_for(slots[idx].record.userID, slots[idx].record.key);
+    slots[idx].next = buckets[b];
+    buckets[b] = idx;
+}
+
+static void unlink_locked(int idx) {
+    if (!(slots[idx].record.flags & RECORD_IN_USE)) return;
+    int *link = &buckets[bucket_for(slots[idx].record.userID, slots[idx].record.key)];
+    while (*link != -1 && *link != idx) link = &slots[*link].next;
+    if (*link == idx) *link = slots[idx].next;
+}
+
+// Loads the keys the last run wrote back. Call before open_transaction_log(),
+// whose WAL replay restores the keys committed after that.
+int idempotency_open(const char *path) {
+    if (store_open(&key_store, path, sizeof(IdempotencyHeader), sizeof(IdempotencyRecord), 0) != 0)
+        return -1;
+    IdempotencyHeader header;
+    if (pread(key_store.fd, &header, sizeof(header), 0) != sizeof(header)) {
+        header = (IdempotencyHeader){ .magic = DB_MAGIC, .version = DB_FORMAT_VERSION,
+                                      .record_size = sizeof(IdempotencyRecord),
+                                      .next_id = 0, .record_count = IDEMPOTENCY_SLOTS };
+        if (pwrite(key_store.fd, &header, sizeof(header), 0) != sizeof(header) ||
+            fsync(key_store.fd) != 0)
+            return -1;
+    } else if (header.magic != DB_MAGIC || header.version != DB_FORMAT_VERSION ||
+               header.record_size != sizeof(IdempotencyRecord) ||
+               header.record_count != IDEMPOTENCY_SLOTS) {
+        return -1;
+    }
+
+    slots = calloc(IDEMPOTENCY_SLOTS, sizeof(Slot));
+    if (slots == NULL) return -1;
+    for (int b = 0; b < BUCKETS; b++) buckets[b] = -1;
+    for (int i = 0; i < IDEMPOTENCY_SLOTS; i++) {
+        Slot *slot = &slots[i];
+        slot->next = -1;
+        if (store_read(&key_store, i, &slot->record) != 0 || !(slot->record.flags & RECORD_IN_USE)) {
+            memset(&slot->record, 0, sizeof(slot->record));
+            continue;
+        }
+        link_locked(i);
+        if (slot->record.sequence >= next_sequence) next_sequence = slot->record.sequence + 1;
+    }
+    return 0;
+}
+
+// Keys are 1-32 characters from [A-Za-z0-9_-]
+int idempotency_valid_key(const char *key) {
+    size_t len = strlen(key);
+    if (len == 0 || len >= IDEMPOTENCY_KEY_LEN) return 0;
+    for (const char *p = key; *p; p++)
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_') return 0;
+    return 1;
+}
+
+// Claims (user_id, key) for `request`, or reports how it was already used.
+// A duplicate that arrives while the first request is still running waits
+// for it, so both get the same reply.
+enum IdempotencyStatus idempotency_begin(int user_id, const char *key, const char *request,
+                                         char *reply, size_t len) {
+    pthread_mutex_lock(&key_lock);
+    int idx;
+    while ((idx = find_locked(user_id, key)) != -1 && slots[idx].pending &&
+           strcmp(slots[idx].record.request, request) == 0)
+        pthread_cond_wait(&finished_cond, &key_lock);
+
+    if (idx != -1) {
+        enum IdempotencyStatus status = IDEMPOTENCY_CONFLICT;
+        if (strcmp(slots[idx].record.request, request) == 0) {
+            snprintf(reply, len, "%s", slots[idx].record.reply);
+            status = IDEMPOTENCY_REPLAY;
+        }
+        pthread_mutex_unlock(&key_lock);
+        return status;
+    }
+
+    // Evict the oldest key, skipping any whose request is still running
+    for (int tries = 0; tries < IDEMPOTENCY_SLOTS; tries++) {
+        idx = next_sequence % IDEMPOTENCY_SLOTS;
+        if (!slots[idx].pending) break;
+        next_sequence++;
+    }
+    if (slots[idx].pending) {
+        pthread_mutex_unlock(&key_lock);
+        return IDEMPOTENCY_BUSY;
+    }
+    unlink_locked(idx);
+    Slot *slot = &slots[idx];
+    memset(&slot->record, 0, sizeof(slot->record));
+    slot->record.sequence = next_sequence++;
+    slot->record.created = time(NULL);
+    slot->record.userID = user_id;
+    slot->record.flags = RECORD_IN_USE;
+    snprintf(slot->record.key, sizeof(slot->record.key), "%s", key);
+    snprintf(slot->record.request, sizeof(slot->record.request), "%s", request);
+    slot->pending = 1;
+    link_locked(idx);
+    pthread_mutex_unlock(&key_lock);
+    return IDEMPOTENCY_NEW;
+}
+
+// Attaches a key claimed with IDEMPOTENCY_NEW to this thread's next commit,
+// with the reply the request sends once that commit succeeds. The key then
+// becomes durable in the same WAL entry as the money it moved.
+void idempotency_arm(int user_id, const char *key, const char *reply) {
+    pthread_mutex_lock(&key_lock);
+    int idx = find_locked(user_id, key);
+    armed_logged = 0;
+    armed_set = idx != -1 && slots[idx].pending;
+    if (armed_set) {
+        armed = slots[idx].record;
+        snprintf(armed.reply, sizeof(armed.reply), "%s", reply);
+    }
+    pthread_mutex_unlock(&key_lock);
+}
+
+// Returns the armed key, once, or NULL. For commit_postings().
+const IdempotencyRecord *idempotency_take_armed(void) {
+    if (!armed_set) return NULL;
+    armed_set = 0;
+    return &armed;
+}
+
+// Called by commit_postings() once the entry carrying the armed key is
+// durable, so idempotency_finish() need not sync the key again
+void idempotency_logged(void) {
+    armed_logged = 1;
+}
+
+// Writes a key whose WAL entry committed into its ring slot, without
+// syncing; a checkpoint calls idempotency_sync() before it empties the WAL.
+// A slot that has since been reused for a newer key is left alone.
+int idempotency_put(const IdempotencyRecord *record) {
+    if (slots == NULL) return -1;
+    int idx = record->sequence % IDEMPOTENCY_SLOTS;
+    pthread_mutex_lock(&key_lock);
+    int result = 0;
+    if (!(slots[idx].record.flags & RECORD_IN_USE) || slots[idx].record.sequence <= record->sequence) {
+        unlink_locked(idx);
+        slots[idx].record = *record;
+        link_locked(idx);
+        result = store_put(&key_store, idx, record);
+    }
+    if (record->sequence >= next_sequence) next_sequence = record->sequence + 1;
+    pthread_mutex_unlock(&key_lock);
+    return result;
+}
+
+int idempotency_sync(void) {
+    return slots == NULL ? 0 : store_sync(&key_store);
+}
+
+// Records the reply of a request claimed with IDEMPOTENCY_NEW and makes it
+// durable; the caller sends the reply only afterwards. A request that
+// committed already has its key in a durable WAL entry and is not synced
+// again; only the ones that did not, such as a refused withdrawal, are.
+int idempotency_finish(int user_id, const char *key, const char *reply) {
+    int logged = armed_logged;
+    armed_set = 0;
+    armed_logged = 0;
+    pthread_mutex_lock(&key_lock);
+    int idx = find_locked(user_id, key);
+    if (idx == -1 || !slots[idx].pending) {
+        pthread_mutex_unlock(&key_lock);
+        return -1;
+    }
+    snprintf(slots[idx].record.reply, sizeof(slots[idx].record.reply), "%s", reply);
+    slots[idx].pending = 0;
+    // Written under the lock so a later reuse of the slot lands after it
+    int result = store_put(&key_store, idx, &slots[idx].record);
+    pthread_cond_broadcast(&finished_cond);
+    pthread_mutex_unlock(&key_lock);
+
+    if (result == 0 && !logged) result = commit_sync(key_store.fd);
+    return result;
+}
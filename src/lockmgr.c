@@ -0,0 +1,157 @@
+/* src/lockmgr.c */
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "lockmgr.h"
+
+// Record locks live in a fixed table of rwlocks per data file, striped by
+// record id. Two records only contend when their ids share a stripe, so
+// operations on different accounts proceed in parallel instead of queueing
+// behind one whole-file fcntl lock.
+
+// fcntl locks belong to the process, not the thread: they cannot order the
+// server's own threads, and releasing one drops it for every thread. Table
+// locks are therefore pthread rwlocks, and the optional file lock is taken
+// by the first holder and released by the last.
+typedef struct {
+    pthread_rwlock_t lock;
+    pthread_mutex_t file_mutex;
+    int file_holders;
+    int fd;
+} TableLock;
+
+static const char *const table_files[LOCK_TABLE_COUNT] = {
+    [LOCK_USERS]    = "data/users.dat",
+    [LOCK_ACCOUNTS] = "data/accounts.dat",
+    [LOCK_LOANS]    = "data/loans.dat",
+    [LOCK_FEEDBACK] = "data/feedback.dat",
+    [LOCK_SESSIONS] = "data/sessions.dat"
+};
+
+static TableLock table_locks[LOCK_TABLE_COUNT];
+static pthread_rwlock_t record_locks[LOCK_TABLE_COUNT][LOCK_STRIPES];
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+static int use_file_locks = 0;
+
+static void init_locks(void) {
+    for (int t = 0; t < LOCK_TABLE_COUNT; t++) {
+        pthread_rwlock_init(&table_locks[t].lock, NULL);
+        pthread_mutex_init(&table_locks[t].file_mutex, NULL);
+        table_locks[t].file_holders = 0;
+        table_locks[t].fd = -1;
+        for (int i = 0; i < LOCK_STRIPES; i++)
+            pthread_rwlock_init(&record_locks[t][i], NULL);
+    }
+}
+
+static int valid_table(enum LockTable table) {
+    if (table < 0 || table >= LOCK_TABLE_COUNT) return 0;
+    pthread_once(&locks_once, init_locks);
+    return 1;
+}
+
+void lockmgr_use_file_locks(int enable) {
+    use_file_locks = enable;
+}
+
+static int set_file_lock(TableLock *t, enum LockTable table, short type) {
+    if (t->fd == -1) {
+        t->fd = open(table_files[table], O_RDWR | O_CREAT, 0644);
+        if (t->fd == -1) return -1;
+    }
+    struct flock lock = { .l_type = type, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+    return fcntl(t->fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &lock);
+}
+
+int lock_table(enum LockTable table, enum LockMode mode) {
+    if (!valid_table(table)) return -1;
+    TableLock *t = &table_locks[table];
+    int result = (mode == LOCK_EXCLUSIVE) ? pthread_rwlock_wrlock(&t->lock)
+                                          : pthread_rwlock_rdlock(&t->lock);
+    if (result != 0 || !use_file_locks) return result;
+
+    // Holders of the rwlock are either one writer or only readers, so the
+    // first holder's mode is the mode every concurrent holder wants
+    pthread_mutex_lock(&t->file_mutex);
+    if (t->file_holders == 0 &&
+        set_file_lock(t, table, mode == LOCK_EXCLUSIVE ? F_WRLCK : F_RDLCK) == -1) {
+        pthread_mutex_unlock(&t->file_mutex);
+        pthread_rwlock_unlock(&t->lock);
+        return -1;
+    }
+    t->file_holders++;
+    pthread_mutex_unlock(&t->file_mutex);
+    return 0;
+}
+
+int unlock_table(enum LockTable table) {
+    if (!valid_table(table)) return -1;
+    TableLock *t = &table_locks[table];
+    if (use_file_locks) {
+        pthread_mutex_lock(&t->file_mutex);
+        if (t->file_holders > 0 && --t->file_holders == 0)
+            set_file_lock(t, table, F_UNLCK);
+        pthread_mutex_unlock(&t->file_mutex);
+    }
+    return pthread_rwlock_unlock(&t->lock);
+}
+
+static pthread_rwlock_t *stripe_for(enum LockTable table, int id) {
+    return &record_locks[table][(unsigned)id % LOCK_STRIPES];
+}
+
+int lock_record(enum LockTable table, int id, enum LockMode mode) {
+    if (!valid_table(table) || id < 0) return -1;
+    pthread_rwlock_t *lock = stripe_for(table, id);
+    return (mode == LOCK_EXCLUSIVE) ? pthread_rwlock_wrlock(lock) : pthread_rwlock_rdlock(lock);
+}
+
+int unlock_record(enum LockTable table, int id) {
+    if (!valid_table(table) || id < 0) return -1;
+    return pthread_rwlock_unlock(stripe_for(table, id));
+}
+
+// Locks any number of records of one table. Stripes are always taken in
+// ascending order, so two threads locking overlapping sets cannot deadlock,
+// and ids that share a stripe (or repeat) lock it only once.
+static void stripe_set(const int *ids, int count, unsigned char *used) {
+    memset(used, 0, LOCK_STRIPES);
+    for (int i = 0; i < count; i++) used[(unsigned)ids[i] % LOCK_STRIPES] = 1;
+}
+
+int lock_record_set(enum LockTable table, const int *ids, int count, enum LockMode mode) {
+    if (!valid_table(table)) return -1;
+    for (int i = 0; i < count; i++) if (ids[i] < 0) return -1;
+    unsigned char used[LOCK_STRIPES];
+    stripe_set(ids, count, used);
+    for (int s = 0; s < LOCK_STRIPES; s++) {
+        if (!used[s]) continue;
+        pthread_rwlock_t *lock = &record_locks[table][s];
+        if (((mode == LOCK_EXCLUSIVE) ? pthread_rwlock_wrlock(lock) : pthread_rwlock_rdlock(lock)) != 0) {
+            while (--s >= 0)
+                if (used[s]) pthread_rwlock_unlock(&record_locks[table][s]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int unlock_record_set(enum LockTable table, const int *ids, int count) {
+    if (!valid_table(table)) return -1;
+    unsigned char used[LOCK_STRIPES];
+    stripe_set(ids, count, used);
+    for (int s = LOCK_STRIPES - 1; s >= 0; s--)
+        if (used[s]) pthread_rwlock_unlock(&record_locks[table][s]);
+    return 0;
+}
+
+int lock_record_pair(enum LockTable table, int id1, int id2, enum LockMode mode) {
+    int ids[2] = { id1, id2 };
+    return lock_record_set(table, ids, 2, mode);
+}
+
+int unlock_record_pair(enum LockTable table, int id1, int id2) {
+    int ids[2] = { id1, id2 };
+    return unlock_record_set(table, ids, 2);
+}
@@ -0,0 +1,169 @@
+/* src/metrics.c */
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "frame.h"
+
+// Latencies go into power-of-two buckets: bucket b holds [2^(b-1), 2^b) us
+#define LATENCY_BUCKETS 40
+
+static const char *metric_names[METRIC_COUNT] = {
+    [METRIC_COMMITS]           = "commits",
+    [METRIC_COMMIT_BATCHES]    = "commit_batches",
+    [METRIC_VERSION_CONFLICTS] = "version_conflicts",
+    [METRIC_TXLOG_BATCHES]     = "txlog_batches",
+    [METRIC_TXLOG_DROPS]       = "txlog_queue_drops",
+    [METRIC_REQUESTS_REJECTED] = "requests_rejected",
+};
+
+static const char *gauge_names[GAUGE_COUNT] = {
+    [GAUGE_TXLOG_QUEUE_DEPTH] = "txlog_queue_depth",
+    [GAUGE_CONNECTIONS]       = "connections",
+    [GAUGE_REQUEST_QUEUE]     = "request_queue_depth",
+    [GAUGE_INTERACTIVE_QUEUE] = "interactive_queue_depth",
+};
+
+static const char *latency_names[LATENCY_COUNT] = {
+    [LATENCY_COMMIT]     = "commit_latency",
+    [LATENCY_REQUEST]    = "request_latency",
+    [LATENCY_QUEUE_WAIT] = "queue_wait",
+};
+
+static long counters[METRIC_COUNT];
+static long last_counters[METRIC_COUNT];
+static long gauges[GAUGE_COUNT];
+static long gauge_peaks[GAUGE_COUNT];
+static long latency_buckets[LATENCY_COUNT][LATENCY_BUCKETS];
+static long latency_count[LATENCY_COUNT];
+static long latency_sum[LATENCY_COUNT];
+static long command_count[OP_COUNT];  // per opcode, handler time only
+static long command_sum[OP_COUNT];
+static long last_report_usec;
+
+static const char *report_path;
+static int report_interval;
+
+long metrics_now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+void metrics_add(enum Metric metric, long n) {
+    __atomic_add_fetch(&counters[metric], n, __ATOMIC_RELAXED);
+}
+
+void metrics_set(enum Gauge gauge, long value) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&gauge_peaks[gauge], __ATOMIC_RELAXED);
+    while (value > peak &&
+           !__atomic_compare_exchange_n(&gauge_peaks[gauge], &peak, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void metrics_gauge_add(enum Gauge gauge, long delta) {
+    long value = __atomic_add_fetch(&gauges[gauge], delta, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&gauge_peaks[gauge], __ATOMIC_RELAXED);
+    while (value > peak &&
+           !__atomic_compare_exchange_n(&gauge_peaks[gauge], &peak, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void metrics_observe(enum LatencyMetric metric, long usec) {
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (1L << bucket) <= usec) bucket++;
+    __atomic_add_fetch(&latency_buckets[metric][bucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&latency_count[metric], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&latency_sum[metric], usec, __ATOMIC_RELAXED);
+}
+
+// Time spent in one command's handler, by opcode (frame.h)
+void metrics_observe_command(int opcode, long usec) {
+    if (opcode <= 0 || opcode >= OP_COUNT) return;
+    __atomic_add_fetch(&command_count[opcode], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&command_sum[opcode], usec, __ATOMIC_RELAXED);
+}
+
+// Upper bound of the bucket containing the p-th percentile
+static long percentile(enum LatencyMetric metric, double p) {
+    long total = __atomic_load_n(&latency_count[metric], __ATOMIC_RELAXED);
+    if (total == 0) return 0;
+    long target = (long)(total * p);
+    long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += __atomic_load_n(&latency_buckets[metric][b], __ATOMIC_RELAXED);
+        if (seen > target) return 1L << b;
+    }
+    return 1L << (LATENCY_BUCKETS - 1);
+}
+
+// One line per metric; counter rates are per second since the previous report
+int metrics_report(char *buf, size_t len) {
+    long now = metrics_now_usec();
+    double elapsed = last_report_usec ? (now - last_report_usec) / 1e6 : 0;
+    last_report_usec = now;
+
+    size_t used = 0;
+    for (int m = 0; m < METRIC_COUNT && used < len; m++) {
+        long value = __atomic_load_n(&counters[m], __ATOMIC_RELAXED);
+        double rate = elapsed > 0 ? (value - last_counters[m]) / elapsed : 0;
+        last_counters[m] = value;
+        used += snprintf(buf + used, len - used, "%-24s %12ld  (%.1f/s)\n",
+                         metric_names[m], value, rate);
+    }
+    for (int g = 0; g < GAUGE_COUNT && used < len; g++) {
+        used += snprintf(buf + used, len - used, "%-24s %12ld  (max %ld)\n", gauge_names[g],
+                         __atomic_load_n(&gauges[g], __ATOMIC_RELAXED),
+                         __atomic_load_n(&gauge_peaks[g], __ATOMIC_RELAXED));
+    }
+    for (int m = 0; m < LATENCY_COUNT && used < len; m++) {
+        long count = __atomic_load_n(&latency_count[m], __ATOMIC_RELAXED);
+        long sum = __atomic_load_n(&latency_sum[m], __ATOMIC_RELAXED);
+        used += snprintf(buf + used, len - used,
+                         "%-24s n=%ld avg=%ldus p50<=%ldus p99<=%ldus\n",
+                         latency_names[m], count, count ? sum / count : 0,
+                         percentile(m, 0.50), percentile(m, 0.99));
+    }
+    // Commands only once they have run, so the report stays short
+    for (int op = 1; op < OP_COUNT && used < len; op++) {
+        long count = __atomic_load_n(&command_count[op], __ATOMIC_RELAXED);
+        if (count == 0) continue;
+        long sum = __atomic_load_n(&command_sum[op], __ATOMIC_RELAXED);
+        used += snprintf(buf + used, len - used, "cmd_%-20s n=%ld avg=%ldus\n",
+                         opcode_name(op), count, sum / count);
+    }
+    return used < len ? (int)used : (int)len;
+}
+
+static void *reporter_main(void *arg) {
+    (void)arg;
+    char buf[8192];
+    while (1) {
+        sleep(report_interval);
+        metrics_report(buf, sizeof(buf));
+        FILE *log = fopen(report_path, "a");
+        if (log == NULL) continue;
+        time_t now = time(NULL);
+        char tbuf[32];
+        strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(log, "[%s] metrics\n%s", tbuf, buf);
+        fclose(log);
+    }
+    return NULL;
+}
+
+// Appends a metrics report to `path` every `interval_sec` seconds (0 disables)
+int metrics_start_reporter(const char *path, int interval_sec) {
+    if (interval_sec <= 0) return 0;
+    report_path = path;
+    report_interval = interval_sec;
+    last_report_usec = metrics_now_usec();
+    pthread_t th;
+    if (pthread_create(&th, NULL, reporter_main, NULL) != 0) return -1;
+    pthread_detach(th);
+    return 0;
+}
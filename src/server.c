@@ -6,34 +6,47 @@
 #include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <getopt.h>
+#include <signal.h>
 #include "types.h"
 #include "database.h"
+#include "commit.h"
+#include "metrics.h"
 #include "helpers.h"
 #include "customer.h"
 #include "employee.h"
 #include "admin.h"
 #include "transactions.h"
+#include "lockmgr.h"
+#include "txlogger.h"
+#include "idempotency.h"
+#include "snapshot.h"
+#include "session.h"
+#include "eventloop.h"
+#include "workpool.h"
+#include "frame.h"
+#include "commands.h"
 
 #define PORT 8080
-#define MAX_CLIENTS 100
 #define BUFFER_SIZE 1024
 
-// Initialize database files
+// Initialize database files. Existing files must already be in the
+// current on-disk format; older trees are upgraded offline with ./migrate.
 void init_database(void)
 {
-    const char *filenames[] = {
-        "users.dat",
-        "accounts.dat",
-        "transactions.dat",
-        "loans.dat",
-        "feedback.dat",
-        "sessions.dat"
+    const struct { const char *name; size_t record_size; } files[] = {
+        { "users.dat",    sizeof(User) },
+        { "accounts.dat", sizeof(Account) },
+        { "loans.dat",    sizeof(Loan) },
+        { "feedback.dat", sizeof(Feedback) }
     };
     const char *data_dir = "data";
     char path[256];
-    for (int i=0; i<5; i++) {
-        snprintf(path, sizeof(path), "%s/%s", data_dir, filenames[i]);
+    for (int i=0; i<4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", data_dir, files[i].name);
 
         int fd = open(path, O_RDWR | O_CREAT, 0644);
         if (fd == -1) {
@@ -41,13 +54,28 @@ void init_database(void)
             fprintf(stderr, "File: %s\n", path);
             exit(1);
         }
+        FileHeader header;
         if (lseek(fd, 0, SEEK_END) == 0) {
-            UserHeader header = { .next_id = 0, .record_count = 0 };
-            write(fd, &header, sizeof(UserHeader));
+            header = (FileHeader){ .magic = DB_MAGIC, .version = DB_FORMAT_VERSION,
+                                   .record_size = files[i].record_size,
+                                   .next_id = 0, .record_count = 0 };
+            write(fd, &header, sizeof(FileHeader));
             fsync(fd);
+        } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                   header.magic != DB_MAGIC || header.version != DB_FORMAT_VERSION ||
+                   header.record_size != files[i].record_size) {
+            fprintf(stderr, "%s is not in on-disk format v%d; run ./migrate first\n",
+                    path, DB_FORMAT_VERSION);
+            exit(1);
         }
         close(fd);
     }
+    snprintf(path, sizeof(path), "%s/transactions.dat", data_dir);
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_size > 0) {
+        fprintf(stderr, "%s is a v1 transaction log; run ./migrate first\n", path);
+        exit(1);
+    }
     snprintf(path, sizeof(path), "%s/sessions.dat", data_dir);
     int fd = open(path, O_RDWR | O_CREAT, 0644);
     if (fd == -1) {
@@ -60,39 +88,28 @@ void init_database(void)
 void create_initial_admin() {
     if (find_user_by_username("admin") != NULL) return;
 
-    int fd = lock_file("data/users.dat", F_WRLCK);
-    if (fd == -1) {
+    if (lock_table(LOCK_USERS, LOCK_EXCLUSIVE) != 0) {
         perror("Failed to lock users.dat for admin creation");
         return;
     }
 
-    UserHeader hdr;
-    lseek(fd, 0, SEEK_SET); // Go to start
-    if (read(fd, &hdr, sizeof(UserHeader)) != sizeof(UserHeader)) {
-        hdr.next_id = 0;
-        hdr.record_count = 0;
-    }
-
     // Only create admin if no other users exist
-    if (hdr.next_id != 0) {
-        unlock_file(fd);
+    if (table_record_count(TABLE_USERS) != 0) {
+        unlock_table(LOCK_USERS);
         return; // Some user (maybe admin) already exists.
     }
 
     User admin = {0};
-    admin.id = hdr.next_id++; // Use ID 0, increment next_id to 1
-    hdr.record_count++;
+    admin.id = fetch_and_increment_id(TABLE_USERS); // ID 0 on an empty table
 
     strncpy(admin.username, "admin", MAX_USERNAME_LEN - 1);
     strncpy(admin.password_hash, "admin123", MAX_PASSWORD_LEN - 1);
     admin.role = ROLE_ADMIN;
     admin.active = 1;
-    lseek(fd, 0, SEEK_SET); // Rewind to write updated header
-    write(fd, &hdr, sizeof(UserHeader));
-    lseek(fd, 0, SEEK_END); // Go to end to append user
-    write(fd, &admin, sizeof(User));
-    fsync(fd);
-    unlock_file(fd);
+    admin.flags = RECORD_IN_USE;
+    save_user(&admin); // Appends record #0
+    index_user(&admin);
+    unlock_table(LOCK_USERS);
 }
 
 
@@ -108,26 +125,24 @@ int authenticate_user(const char *username, const char *password, int *user_id,
 
 // Add session
 int add_session(int user_id) {
-    int fd = lock_file("data/sessions.dat", F_WRLCK);
-    if (fd == -1) return -1;
+    // Exclusive: two logins for one user must not both pass the check
+    if (lock_table(LOCK_SESSIONS, LOCK_EXCLUSIVE) != 0) return -1;
     Session session;
-    while (read(fd, &session, sizeof(Session)) == sizeof(Session)) {
+    int count = 0;
+    for (; read_session_record(count, &session) == 0; count++) {
         if (session.user_id == user_id && session.session_active) {
-            unlock_file(fd);
+            unlock_table(LOCK_SESSIONS);
             return -1; // Session already active
         }
     }
     Session new_session = {
         .user_id = user_id,
         .login_time = time(NULL),
-        .session_active = 1,
-        .reserved = {0}
+        .session_active = 1
     };
-    lseek(fd, 0, SEEK_END);
-    write(fd, &new_session, sizeof(Session));
-    fsync(fd);
-    unlock_file(fd);
-    return 0;
+    int result = save_session_record(count, &new_session);
+    unlock_table(LOCK_SESSIONS);
+    return result;
 }
 
 // Helper: read full line from client
@@ -150,170 +165,352 @@ static const char* role_to_string(enum Role role) {
 }
 
 
-// Client handler
-void *handle_client(void *arg) {
-    int client_fd = *(int *)arg;
-    free(arg);
+void session_init(ClientSession *s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->user_id = -1;
+    multi_txn_init(&s->txn);
+    metrics_gauge_add(GAUGE_CONNECTIONS, 1);
+    // A framed reply ends with a small FRAME_END write; Nagle would hold
+    // it back until the client acknowledged the reply before it
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
 
-    char buffer[BUFFER_SIZE];
-    int  user_id = -1;
+// The command word at the start of a text request; sets *len to its length
+static const char *command_word(const char *request, size_t *len) {
+    while (*request == ' ' || *request == '\t' || *request == '\r' || *request == '\n') request++;
+    *len = strcspn(request, " \t\r\n");
+    return request;
+}
+
+// Further messages the request reads after its command line (commands.c)
+int session_input_fields(const ClientSession *s, const char *request) {
+    if (!s->logged_in) return 0;
+    size_t len;
+    const char *word = command_word(request, &len);
+    const Command *c = command_lookup(word, len, s->role);
+    return c != NULL ? c->inputs : 0;
+}
+
+// LOGIN <ROLE> <USER> <PASS>. Anything else is answered and ignored.
+static void session_login(ClientSession *s, const char *buffer) {
+    int client_fd = s->fd;
+    char cmd[32], role_str[32], username[MAX_USERNAME_LEN], password[MAX_PASSWORD_LEN];
+    int user_id;
     enum Role role;
 
-    // LOGIN
-    while (1) {
-        if (read_full_line(client_fd, buffer, sizeof(buffer)) < 0) {
-            close(client_fd);
-            return NULL;
-        }
+    // New format: LOGIN <ROLE> <USER> <PASS>
+    if (sscanf(buffer, "%31s %31s %49s %63s", cmd, role_str, username, password) != 4)
+        return;
 
-        char cmd[32], role_str[32], username[MAX_USERNAME_LEN], password[MAX_PASSWORD_LEN];
-        
-        // New format: LOGIN <ROLE> <USER> <PASS>
-        if (sscanf(buffer, "%s %s %s %s", cmd, role_str, username, password) != 4)
-            continue;
+    if (strcmp(cmd, "LOGIN") != 0) {
+        send_response(client_fd, "Send LOGIN <ROLE> <user> <pass>\n");
+        return;
+    }
 
-        if (strcmp(cmd, "LOGIN") != 0) {
-            send_response(client_fd, "Send LOGIN <ROLE> <user> <pass>\n");
-            continue;
-        }
+    if (authenticate_user(username, password, &user_id, &role) != 0) {
+        send_response(client_fd, "Login failed: Invalid username or password\n");
+        return;
+    }
 
-        if (authenticate_user(username, password, &user_id, &role) != 0) {
-            send_response(client_fd, "Login failed: Invalid username or password\n");
-            continue;
-        }
+    // New check: Validate the role
+    const char *actual_role_str = role_to_string(role);
+    if (strcmp(role_str, actual_role_str) != 0) {
+        send_response(client_fd, "Login failed: Role mismatch\n");
+        return;
+    }
 
-        // New check: Validate the role
-        const char *actual_role_str = role_to_string(role);
-        if (strcmp(role_str, actual_role_str) != 0) {
-            send_response(client_fd, "Login failed: Role mismatch\n");
-            continue;
-        }
+    if (add_session(user_id) != 0) {
+        send_response(client_fd, "Session already active\n");
+        return;
+    }
 
-        if (add_session(user_id) != 0) {
-            send_response(client_fd, "Session already active\n");
-            continue;
-        }
+    // Simplified success response
+    send_response(client_fd, "Login successful\n");
+    s->logged_in = 1;
+    s->user_id = user_id;
+    s->role = role;
+}
 
-        // Simplified success response
-        send_response(client_fd, "Login successful\n");
-        break; // Exit login loop
+static const char *unknown_command_reply(enum Role role) {
+    switch (role) {
+        case ROLE_EMPLOYEE: return "Unknown employee command\n";
+        case ROLE_MANAGER:  return "Unknown manager command\n";
+        case ROLE_ADMIN:    return "Unknown admin command\n";
+        default:            return "Unknown command\n";
     }
+}
 
-    // COMMAND LOOP (role-based)
-    while (1) {
-        if (read_full_line(client_fd, buffer, sizeof(buffer)) < 0)
-            break;                                   // client disconnected
-        
-        if (role == ROLE_CUSTOMER) {
-            char cmd[32];
-            sscanf(buffer, "%s", cmd);
-
-            if (strcmp(cmd, "BALANCE") == 0) {
-                getBalance(user_id, client_fd);
-            }
-            else if (strcmp(cmd, "DEPOSIT") == 0) {
-                double amt = read_amount_from_socket(client_fd);
-                deposit(user_id, amt, client_fd);
-            }
-            else if (strcmp(cmd, "WITHDRAW") == 0) {
-                double amt = read_amount_from_socket(client_fd);
-                withdraw(user_id, amt, client_fd);
-            }
-            else if (strcmp(cmd, "TRANSFER") == 0) {
-                transferFunds(user_id, client_fd);
-            }
-            else if (strcmp(cmd, "LOAN") == 0) {
-                applyLoan(user_id, client_fd);
-            }
-            else if (strcmp(cmd, "FEEDBACK") == 0) {
-                addFeedback(user_id, client_fd);
-            }
-            else if (strcmp(cmd, "HISTORY") == 0) {
-                viewTransactionHistory(user_id, client_fd);
-            }
-            else if (strcmp(cmd, "EXIT") == 0) {
-                exitCustomer(user_id, client_fd);
-                break;
-            }
-            else {
-                send_response(client_fd, "Unknown command\n");
-            }
-        }
+// Runs the command, if the session's role may; NULL is an unknown command
+static int session_run(ClientSession *s, const Command *c, const char *args) {
+    long started = metrics_now_usec();
+    int result = 0;
+    if (c == NULL) send_response(s->fd, unknown_command_reply(s->role));
+    else result = command_run(c, s, args);
+    metrics_observe(LATENCY_REQUEST, metrics_now_usec() - started);
+    return result;
+}
 
-        else if (role == ROLE_EMPLOYEE) {
-            char cmd[32];
-            sscanf(buffer, "%s", cmd);
-
-            if (strcmp(cmd, "ADD_CUST") == 0)         addNewCustomer(client_fd);
-            else if (strcmp(cmd, "EDIT_CUST") == 0)   editCustomerDetails(client_fd);
-            else if (strcmp(cmd, "LOAN_DECIDE") == 0) approveRejectLoans(user_id, client_fd);
-            else if (strcmp(cmd, "MY_LOANS") == 0)    viewAssignedLoanApplications(user_id, client_fd);
-            else if (strcmp(cmd, "CUST_TRANS") == 0)  viewCustomerTransactions(client_fd);
-            else if (strcmp(cmd, "EXIT") == 0) {
-                exitCustomer(user_id, client_fd);
-                break;
-            }
-            else {
-                send_response(client_fd, "Unknown employee command\n");
-            }
+// Runs one request: the command line in `buffer`, plus whatever further
+// input the command reads. Returns -1 once the client has sent EXIT.
+int session_handle(ClientSession *s, char *buffer) {
+    if (!s->logged_in) {
+        session_login(s, buffer);
+        return 0;
+    }
+    size_t len;
+    const char *word = command_word(buffer, &len);
+    return session_run(s, command_lookup(word, len, s->role), word + len);
+}
+
+// Runs one framed request. The opcode indexes the command table directly
+// and field 0 holds its arguments; only LOGIN needs the command line
+// rebuilt. The other fields stand in for the command's reads, and every
+// reply goes out framed with the request's id. Returns -1 after EXIT.
+int session_handle_frame(ClientSession *s, const Frame *frame) {
+    const char *name = opcode_name(frame->opcode);
+    size_t len = 0;
+    for (int i = 0; i < frame->field_count; i++) len += frame->field_lengths[i] + 1;
+    char *text = malloc(len + 32);
+    if (text == NULL) return -1;
+
+    // Command line first, then each input field, each NUL-terminated
+    const char *inputs[FRAME_MAX_FIELDS];
+    size_t prefix = (size_t)snprintf(text, 32, "%s ", name != NULL ? name : "");
+    size_t used = prefix;
+    for (int i = 0; i < frame->field_count; i++) {
+        if (i > 0) inputs[i - 1] = text + used;
+        memcpy(text + used, frame->fields[i], frame->field_lengths[i]);
+        used += frame->field_lengths[i];
+        text[used++] = '\0';
+    }
+    if (frame->field_count == 0) text[used] = '\0';
+
+    int status = 0;
+    frame_replies(s->fd, frame->request_id);
+    if (name == NULL) {
+        send_response(s->fd, "Unknown command\n");
+    } else {
+        int fields = frame->field_count > 0 ? frame->field_count - 1 : 0;
+        const Command *c = s->logged_in ? command_for_opcode(frame->opcode, s->role) : NULL;
+        // A handler whose input runs out reads nothing; refuse the request
+        // rather than let it act on an answer that never came
+        if (c != NULL && c->inputs != SESSION_INTERACTIVE && fields < c->inputs) {
+            send_response(s->fd, "Request is missing input fields\n");
+        } else {
+            feed_input(inputs, fields);
+            if (s->logged_in) status = session_run(s, c, text + prefix);
+            else session_login(s, text);
+            stop_input();
         }
+    }
+    end_frame_replies();
+    free(text);
+    return status;
+}
 
-        else if (role == ROLE_MANAGER) {
-            char cmd[32];
-            sscanf(buffer, "%s", cmd);
-
-            if (strcmp(cmd, "ADD_CUST") == 0)          addNewCustomer(client_fd);
-            else if (strcmp(cmd, "EDIT_CUST") == 0)    editCustomerDetails(client_fd);
-            else if (strcmp(cmd, "MY_LOANS") == 0)     viewAssignedLoanApplications(user_id, client_fd);
-            else if (strcmp(cmd, "LOAN_DECIDE") == 0)  approveRejectLoans(user_id, client_fd);
-            else if (strcmp(cmd, "CUST_TRANS") == 0)   viewCustomerTransactions(client_fd);
-            else if (strcmp(cmd, "ASSIGN_LOAN") == 0) {
-                // This is the one exception. The client *did* send args.
-                // We re-parse the *original buffer* to get them.
-                char a1[64], a2[64];
-                sscanf(buffer, "%*s %s %s", a1, a2); // %*s skips the command
-                int loan_id = atoi(a1);
-                int emp_id  = atoi(a2);
-                assignLoanToEmployee(user_id, loan_id, emp_id, client_fd);
-            }
-            else if (strcmp(cmd, "VIEW_FEEDBACK") == 0) viewAllFeedback(client_fd);
-            else if (strcmp(cmd, "VIEW_USERS") == 0)    viewAllUsers(client_fd);
-            else if (strcmp(cmd, "EXIT") == 0) {
-                exitCustomer(user_id, client_fd);
-                break;
-            }
-            else {
-                send_response(client_fd, "Unknown manager command\n");
-            }
+// Ends the connection. An open transaction is abandoned; a client that
+// disconnected without EXIT still has its session ended.
+void session_close(ClientSession *s, int disconnected) {
+    if (disconnected && s->logged_in) end_session(s->user_id);
+    multi_txn_clear(&s->txn);
+    close(s->fd);
+    metrics_gauge_add(GAUGE_CONNECTIONS, -1);
+}
+
+// Thread model, framed protocol: runs each request as soon as its frame
+// is complete, so a client may send several before reading the replies
+static void serve_frames(ClientSession *s) {
+    FrameBuffer in = { NULL, 0, 0 };
+    int status = 0, size = 0;
+    while (status == 0 && size >= 0 && frame_buffer_read(&in, s->fd) > 0) {
+        size_t used = 0;
+        Frame frame;
+        while (status == 0 && (size = frame_parse(in.data + used, in.len - used, &frame)) > 0) {
+            status = session_handle_frame(s, &frame);
+            used += size;
         }
+        frame_buffer_consume(&in, used);
+    }
+    frame_buffer_free(&in);
+    session_close(s, status == 0);
+}
 
-        else if (role == ROLE_ADMIN) {
-            char cmd[32];
-            sscanf(buffer, "%s", cmd);
-
-            if (strcmp(cmd, "ADD_EMP") == 0)         addEmployee(client_fd);
-            else if (strcmp(cmd, "ADD_MGR") == 0)    addManager(client_fd);
-            else if (strcmp(cmd, "VIEW_USERS") == 0) viewAllUsers(client_fd);
-            else if (strcmp(cmd, "DEACTIVATE") == 0) deactivateUser(user_id, client_fd);
-            else if (strcmp(cmd, "REACTIVATE") == 0) reactivateUser(user_id, client_fd);
-            else if (strcmp(cmd, "VIEW_LOGS") == 0)  viewSystemLogs(client_fd);
-            else if (strcmp(cmd, "EXIT") == 0) {
-                exitCustomer(user_id, client_fd);
-                break;
-            }
-            else {
-                send_response(client_fd, "Unknown admin command\n");
-            }
+// Thread model: one handler thread per connection, blocking in read()
+void *handle_client(void *arg) {
+    int client_fd = *(int *)arg;
+    free(arg);
+
+    char buffer[BUFFER_SIZE];
+    ClientSession session;
+    session_init(&session, client_fd);
+    char first;
+    if (recv(client_fd, &first, 1, MSG_PEEK) == 1 && first == 0) {
+        serve_frames(&session);
+        return NULL;
+    }
+    while (read_full_line(client_fd, buffer, sizeof(buffer)) == 0) {
+        if (session_handle(&session, buffer) != 0) {
+            session_close(&session, 0);
+            return NULL;
         }
     }
-    close(client_fd);
+    session_close(&session, 1);
     return NULL;
 }
 
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --mmap                     serve users/accounts from memory-mapped files\n"
+            "  --durability=MODE          strict | group (default) | async\n"
+            "  --group-max-batch=N        flush once N commits are queued (default 64)\n"
+            "  --group-max-latency-us=N   max wait for a batch to fill (default 0)\n"
+            "  --stats-interval=SEC       append metrics to logs/server.log (default 60, 0 = off)\n"
+            "  --file-locks               also take fcntl locks for table-wide work, for dbdump\n"
+            "  --txlog-writer=MODE        thread (default) | inline: who writes transaction history\n"
+            "  --txlog-queue=N            records the history queue holds (default 65536)\n"
+            "  --txlog-fsync              fsync history after every logger batch\n"
+            "  --snapshot-interval=SEC    snapshot all balances for BALANCE_AT (default 86400, 0 = off)\n"
+            "  --snapshot-keep=N          delete all but the newest N snapshots (default 90, 0 = keep all)\n"
+            "  --io-model=MODEL           epoll (default) | threads: an unbounded thread per connection\n"
+            "  --io-threads=N             event-loop threads for --io-model=epoll (default: CPUs)\n"
+            "  --workers=N                threads running epoll-model requests (default 16)\n"
+            "  --queue-depth=N            requests queued for a worker before \"server busy\" (default 1024)\n"
+            "  --interactive-workers=N    threads running prompt-driven requests, e.g. EOD (default 8)\n"
+            "  --interactive-queue=N      prompt-driven requests queued before \"server busy\" (default 16)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int use_mmap = 0;
+    int stats_interval = 60;
+    int snapshot_interval = 24 * 60 * 60;
+    int snapshot_keep = 90;
+    int use_epoll = 1;
+    int io_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = 16;
+    int queue_depth = 1024;
+    int interactive_workers = 8;
+    int interactive_queue = 16;
+    CommitConfig commit_config = {
+        .mode = DURABILITY_GROUP,
+        .max_batch = 64,
+        .max_latency_us = 0
+    };
+    TxLoggerConfig logger_config = {
+        .threaded = 1,
+        .queue_capacity = 65536,
+        .fsync_batches = 0
+    };
+    static const struct option options[] = {
+        { "mmap",                 no_argument,       NULL, 'm' },
+        { "durability",           required_argument, NULL, 'd' },
+        { "group-max-batch",      required_argument, NULL, 'b' },
+        { "group-max-latency-us", required_argument, NULL, 'l' },
+        { "stats-interval",       required_argument, NULL, 's' },
+        { "file-locks",           no_argument,       NULL, 'f' },
+        { "txlog-writer",         required_argument, NULL, 'w' },
+        { "txlog-queue",          required_argument, NULL, 'q' },
+        { "txlog-fsync",          no_argument,       NULL, 'y' },
+        { "snapshot-interval",    required_argument, NULL, 'p' },
+        { "snapshot-keep",        required_argument, NULL, 'K' },
+        { "io-model",             required_argument, NULL, 'i' },
+        { "io-threads",           required_argument, NULL, 't' },
+        { "workers",              required_argument, NULL, 'k' },
+        { "queue-depth",          required_argument, NULL, 'Q' },
+        { "interactive-workers",  required_argument, NULL, 'I' },
+        { "interactive-queue",    required_argument, NULL, 'J' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt_ch;
+    while ((opt_ch = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt_ch) {
+            case 'm': use_mmap = 1; break;
+            case 'd':
+                if (parse_durability_mode(optarg, &commit_config.mode) != 0) usage(argv[0]);
+                break;
+            case 'b': commit_config.max_batch = atoi(optarg); break;
+            case 'l': commit_config.max_latency_us = atoi(optarg); break;
+            case 's': stats_interval = atoi(optarg); break;
+            case 'f': lockmgr_use_file_locks(1); break;
+            case 'w':
+                if (strcmp(optarg, "thread") == 0)      logger_config.threaded = 1;
+                else if (strcmp(optarg, "inline") == 0) logger_config.threaded = 0;
+                else usage(argv[0]);
+                break;
+            case 'q': logger_config.queue_capacity = atoi(optarg); break;
+            case 'y': logger_config.fsync_batches = 1; break;
+            case 'p': snapshot_interval = atoi(optarg); break;
+            case 'K': snapshot_keep = atoi(optarg); break;
+            case 'i':
+                if (strcmp(optarg, "threads") == 0)     use_epoll = 0;
+                else if (strcmp(optarg, "epoll") == 0)  use_epoll = 1;
+                else usage(argv[0]);
+                break;
+            case 't': io_threads = atoi(optarg); break;
+            case 'k': workers = atoi(optarg); break;
+            case 'Q': queue_depth = atoi(optarg); break;
+            case 'I': interactive_workers = atoi(optarg); break;
+            case 'J': interactive_queue = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind < argc || snapshot_keep < 0 || io_threads < 1 || workers < 1 || queue_depth < 1 ||
+        interactive_workers < 1 || interactive_queue < 1) usage(argv[0]);
+
+    if (commit_init(&commit_config) != 0) {
+        perror("Failed to start committer");
+        exit(1);
+    }
+    metrics_start_reporter("logs/server.log", stats_interval);
+
+    if (lock_data_dir() != 0) {
+        fprintf(stderr, "data/ is in use by another server or tool\n");
+        exit(1);
+    }
     init_database();
+    if (open_record_stores(use_mmap) != 0) {
+        perror("Failed to open record stores");
+        exit(1);
+    }
+    if (open_id_counters() != 0) {
+        perror("Failed to open id counters");
+        exit(1);
+    }
+    // Before WAL replay, which restores keys committed since the last checkpoint
+    if (idempotency_open("data/idempotency.dat") != 0) {
+        fprintf(stderr, "Failed to load idempotency keys\n");
+        exit(1);
+    }
+    if (open_transaction_log() != 0) {
+        perror("Failed to recover transaction log");
+        exit(1);
+    }
+    if (txlogger_start(&logger_config) != 0) {
+        perror("Failed to start transaction logger");
+        exit(1);
+    }
+    if (build_user_index() != 0) {
+        fprintf(stderr, "Failed to build user index\n");
+        exit(1);
+    }
+    if (build_account_index() != 0) {
+        fprintf(stderr, "Failed to build account index\n");
+        exit(1);
+    }
     create_initial_admin();
+    if (commands_init() != 0) {
+        fprintf(stderr, "Failed to build command table\n");
+        exit(1);
+    }
+    if (snapshot_open("data/snapshots") != 0 || snapshot_start(snapshot_interval, snapshot_keep) != 0) {
+        fprintf(stderr, "Failed to start balance snapshots\n");
+        exit(1);
+    }
 
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == -1) { perror("socket"); exit(EXIT_FAILURE); }
@@ -329,11 +526,24 @@ int main() {
     if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         perror("bind"); exit(EXIT_FAILURE);
     }
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen"); exit(EXIT_FAILURE);
     }
+    // A client gone mid-reply is noticed by write(), not by a signal
+    signal(SIGPIPE, SIG_IGN);
     printf("Server listening on port %d ...\n", PORT);
 
+    if (use_epoll) {
+        if (workpool_start(POOL_REQUESTS, workers, queue_depth) != 0 ||
+            workpool_start(POOL_INTERACTIVE, interactive_workers, interactive_queue) != 0) {
+            perror("Failed to start worker pool");
+            exit(1);
+        }
+        eventloop_run(server_fd, io_threads);
+        perror("Failed to start event loops");
+        exit(1);
+    }
+
     while (1) {
         struct sockaddr_in client_addr;
         socklen_t len = sizeof(client_addr);
@@ -0,0 +1,326 @@
+/* src/snapshot.c */
+#define _GNU_SOURCE   // strptime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "types.h"
+#include "database.h"
+#include "transactions.h"
+
+#define SNAPSHOT_READ_CHUNK 1024
+#define SNAPSHOT_RETRY_SEC 60
+
+// Times of the snapshots on disk, oldest first; each names its file
+static time_t *snapshot_times = NULL;
+static int snapshot_count = 0;
+static int snapshot_capacity = 0;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static char snapshot_dir[200];
+static int snapshot_interval = 0;
+static int snapshot_keep = 0;
+
+static void snapshot_path(time_t taken, const char *suffix, char *path, size_t len) {
+    snprintf(path, len, "%s/balances-%ld.%s", snapshot_dir, (long)taken, suffix);
+}
+
+static int compare_times(const void *a, const void *b) {
+    time_t x = *(const time_t *)a, y = *(const time_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_ids(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Caller holds snapshot_lock
+static int add_snapshot_locked(time_t taken) {
+    for (int i = 0; i < snapshot_count; i++)
+        if (snapshot_times[i] == taken) return 0;
+    if (snapshot_count == snapshot_capacity) {
+        int capacity = snapshot_capacity ? snapshot_capacity * 2 : 64;
+        time_t *times = realloc(snapshot_times, capacity * sizeof(time_t));
+        if (times == NULL) return -1;
+        snapshot_times = times;
+        snapshot_capacity = capacity;
+    }
+    snapshot_times[snapshot_count++] = taken;
+    qsort(snapshot_times, snapshot_count, sizeof(time_t), compare_times);
+    return 0;
+}
+
+// Indexes the snapshots already under dir. Call before snapshot_start().
+int snapshot_open(const char *dir) {
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "%s", dir);
+    if (mkdir(snapshot_dir, 0755) != 0 && errno != EEXIST) return -1;
+    DIR *d = opendir(snapshot_dir);
+    if (d == NULL) return -1;
+    int result = 0;
+    struct dirent *entry;
+    pthread_mutex_lock(&snapshot_lock);
+    while (result == 0 && (entry = readdir(d)) != NULL) {
+        long taken;
+        char expected[64];
+        if (sscanf(entry->d_name, "balances-%ld.dat", &taken) != 1 || taken <= 0) continue;
+        snprintf(expected, sizeof(expected), "balances-%ld.dat", taken);
+        if (strcmp(expected, entry->d_name) != 0) continue;
+        result = add_snapshot_locked((time_t)taken);
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    closedir(d);
+    return result;
+}
+
+/* ------------------------------------------------------------------ */
+/* Taking a snapshot                                                   */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    SnapshotHeader header;
+    BalanceRecord *records;
+} Capture;
+
+// Runs at a commit boundary, so the balances and last_transactionID agree
+static int capture_balances(int last_transaction_id, void *arg) {
+    Capture *c = arg;
+    int count = table_record_count(TABLE_ACCOUNTS);
+    c->header = (SnapshotHeader){ .magic = SNAPSHOT_MAGIC, .version = DB_FORMAT_VERSION,
+                                  .record_size = sizeof(BalanceRecord), .taken = time(NULL),
+                                  .last_transactionID = last_transaction_id, .record_count = count };
+    c->records = calloc(count > 0 ? count : 1, sizeof(BalanceRecord));
+    if (c->records == NULL) return -1;
+
+    Account chunk[SNAPSHOT_READ_CHUNK];
+    for (int first = 0; first < count; first += SNAPSHOT_READ_CHUNK) {
+        int n = count - first < SNAPSHOT_READ_CHUNK ? count - first : SNAPSHOT_READ_CHUNK;
+        // An account still being opened may not be written yet; read one by one
+        int whole = read_account_range(first, n, chunk) == 0;
+        for (int i = 0; i < n; i++) {
+            BalanceRecord *r = &c->records[first + i];
+            r->accountID = first + i;
+            if (!whole && read_account(first + i, &chunk[i]) != 0) continue;
+            if (!(chunk[i].flags & RECORD_IN_USE)) continue;
+            r->balance = chunk[i].balance;
+            r->flags = RECORD_IN_USE;
+        }
+    }
+    return 0;
+}
+
+// Writes every account's current balance to a new snapshot file. Commits
+// pause only while the balances are copied, not while the file is written.
+int snapshot_take(void) {
+    Capture c = { .records = NULL };
+    if (at_commit_boundary(capture_balances, &c) != 0) {
+        free(c.records);
+        return -1;
+    }
+    char tmp[256], path[256];
+    snapshot_path(c.header.taken, "tmp", tmp, sizeof(tmp));
+    snapshot_path(c.header.taken, "dat", path, sizeof(path));
+    size_t len = (size_t)c.header.record_count * sizeof(BalanceRecord);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int result = fd == -1 ? -1 : 0;
+    if (result == 0 && (write(fd, &c.header, sizeof(c.header)) != sizeof(c.header) ||
+                        write(fd, c.records, len) != (ssize_t)len || fsync(fd) != 0))
+        result = -1;
+    if (fd != -1) close(fd);
+    free(c.records);
+    // Renamed only once complete, so a crash never leaves a partial snapshot
+    if (result == 0 && rename(tmp, path) != 0) result = -1;
+    if (result != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    pthread_mutex_lock(&snapshot_lock);
+    result = add_snapshot_locked(c.header.taken);
+    pthread_mutex_unlock(&snapshot_lock);
+    return result;
+}
+
+// Deletes all but the newest snapshot_keep snapshots. A query that already
+// picked a deleted one finds it gone and replays the live history instead.
+static void prune_snapshots(void) {
+    if (snapshot_keep <= 0) return;
+    pthread_mutex_lock(&snapshot_lock);
+    int excess = snapshot_count - snapshot_keep;
+    time_t *old = excess > 0 ? malloc(excess * sizeof(time_t)) : NULL;
+    if (old != NULL) {
+        memcpy(old, snapshot_times, excess * sizeof(time_t));
+        memmove(snapshot_times, snapshot_times + excess, snapshot_keep * sizeof(time_t));
+        snapshot_count = snapshot_keep;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    if (old == NULL) return;
+    for (int i = 0; i < excess; i++) {
+        char path[256];
+        snapshot_path(old[i], "dat", path, sizeof(path));
+        if (unlink(path) != 0 && errno != ENOENT) perror(path);
+    }
+    free(old);
+}
+
+static void *snapshot_main(void *arg) {
+    (void)arg;
+    prune_snapshots();
+    while (1) {
+        pthread_mutex_lock(&snapshot_lock);
+        time_t newest = snapshot_count > 0 ? snapshot_times[snapshot_count - 1] : 0;
+        pthread_mutex_unlock(&snapshot_lock);
+        time_t now = time(NULL);
+        if (now < newest + snapshot_interval) {
+            sleep((unsigned)(newest + snapshot_interval - now));
+            continue;
+        }
+        if (snapshot_take() != 0) {
+            fprintf(stderr, "Balance snapshot failed; retrying in %d s\n", SNAPSHOT_RETRY_SEC);
+            sleep(SNAPSHOT_RETRY_SEC);
+            continue;
+        }
+        prune_snapshots();
+    }
+    return NULL;
+}
+
+// Takes a snapshot every `interval_sec` seconds (0 disables), starting now
+// if the newest one on disk is already older than that, and keeps only the
+// newest `keep` (0 keeps them all)
+int snapshot_start(int interval_sec, int keep) {
+    if (interval_sec <= 0) return 0;
+    snapshot_interval = interval_sec;
+    snapshot_keep = keep;
+    pthread_t th;
+    if (pthread_create(&th, NULL, snapshot_main, NULL) != 0) return -1;
+    pthread_detach(th);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Point-in-time queries                                               */
+/* ------------------------------------------------------------------ */
+
+// Reads the account's record from the newest snapshot taken at or before
+// `when`. Returns -1 if there is none.
+static int read_snapshot_record(time_t when, int account_id, SnapshotHeader *header,
+                                BalanceRecord *record) {
+    pthread_mutex_lock(&snapshot_lock);
+    int lo = 0, hi = snapshot_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (snapshot_times[mid] <= when) lo = mid + 1;
+        else hi = mid;
+    }
+    time_t taken = lo > 0 ? snapshot_times[lo - 1] : 0;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (taken == 0) return -1;
+
+    char path[256];
+    snapshot_path(taken, "dat", path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    int result = -1;
+    if (pread(fd, header, sizeof(*header), 0) == sizeof(*header) &&
+        header->magic == SNAPSHOT_MAGIC && header->record_size == sizeof(BalanceRecord)) {
+        memset(record, 0, sizeof(*record));
+        off_t offset = sizeof(SnapshotHeader) + (off_t)account_id * sizeof(BalanceRecord);
+        if (account_id >= header->record_count ||
+            pread(fd, record, sizeof(*record), offset) == sizeof(*record))
+            result = 0;
+    }
+    close(fd);
+    return result;
+}
+
+// The account's balance as of `when`: the nearest earlier snapshot, then
+// its transactions committed after the snapshot, up to `when`. Costs one
+// snapshot read plus the transactions since it; before the first snapshot
+// it replays the account's whole live history. Returns -1 for a time
+// before the account was opened.
+int balance_at(int account_id, time_t when, double *balance) {
+    Account account;
+    int live = read_account(account_id, &account) == 0 && (account.flags & RECORD_IN_USE);
+    if (live && account.opened != 0 && when < (time_t)account.opened) return -1;
+
+    SnapshotHeader header;
+    BalanceRecord record;
+    int after_id = -1;
+    int known = 0;
+    if (read_snapshot_record(when, account_id, &header, &record) == 0) {
+        after_id = header.last_transactionID;
+        if (record.flags & RECORD_IN_USE) {
+            *balance = record.balance;
+            known = 1;
+        }
+    }
+
+    int *ids;
+    int count = transaction_ids_after(account_id, after_id, &ids);
+    // Concurrent commits may index their ids slightly out of order
+    if (count > 1) qsort(ids, count, sizeof(int), compare_ids);
+    for (int i = 0; i < count; i++) {
+        TransactionRecord t;
+        if (read_transaction(ids[i], &t) != 0) {
+            free(ids);
+            return -1;
+        }
+        if (t.timestamp > when) {
+            // Nothing earlier is known: the balance just before this posting
+            if (!known) *balance = t.new_balance - t.amount;
+            known = 1;
+            break;
+        }
+        *balance = t.new_balance;
+        known = 1;
+    }
+    free(ids);
+    if (known) return 0;
+
+    // No snapshot entry and no postings since: the balance never moved
+    if (!live) return -1;
+    *balance = account.balance;
+    return 0;
+}
+
+// Accepts "YYYY-MM-DD HH:MM:SS", "YYYY-MM-DD HH:MM", "YYYY-MM-DD" (the end
+// of that day) in local time, or seconds since the epoch
+int parse_point_in_time(const char *text, time_t *when) {
+    while (isspace((unsigned char)*text)) text++;
+    char *end;
+    long seconds = strtol(text, &end, 10);
+    while (isspace((unsigned char)*end)) end++;
+    if (end != text && *end == '\0' && seconds > 99991231) {
+        *when = (time_t)seconds;
+        return 0;
+    }
+
+    static const struct { const char *format; int end_of_day; } formats[] = {
+        { "%Y-%m-%d %H:%M:%S", 0 },
+        { "%Y-%m-%d %H:%M",    0 },
+        { "%Y-%m-%d",          1 }
+    };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *rest = strptime(text, formats[f].format, &tm);
+        if (rest == NULL) continue;
+        while (isspace((unsigned char)*rest)) rest++;
+        if (*rest != '\0') continue;
+        if (formats[f].end_of_day) {
+            tm.tm_hour = 23;
+            tm.tm_min = 59;
+            tm.tm_sec = 59;
+        }
+        tm.tm_isdst = -1;
+        *when = mktime(&tm);
+        return *when == (time_t)-1 ? -1 : 0;
+    }
+    return -1;
+}
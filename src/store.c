@@ -0,0 +1,185 @@
+/* src/store.c */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "store.h"
+#include "commit.h"
+
+#define MIN_MAP_LEN (1 << 20)
+
+static off_t record_offset(RecordStore *s, int idx) {
+    return s->header_size + (off_t)idx * s->record_size;
+}
+
+// Caller holds s->lock for writing. Refreshes file_size and grows the
+// mapping so that it covers at least `needed` bytes of the file.
+static int remap_locked(RecordStore *s, off_t needed) {
+    struct stat st;
+    if (fstat(s->fd, &st) == -1) return -1;
+    // Never shrink: an appended slot is claimed before its pwrite lands
+    if (st.st_size > s->file_size) s->file_size = st.st_size;
+    if (!s->use_mmap) return 0;
+    if (needed < s->file_size) needed = s->file_size;
+    if ((size_t)needed <= s->map_len && s->map != NULL) return 0;
+
+    size_t len = s->map_len ? s->map_len : MIN_MAP_LEN;
+    while (len < (size_t)needed) len *= 2;
+
+    // Reserve more than the file holds: pages past EOF become usable as soon
+    // as the file is extended, so appends rarely need a new mapping.
+    void *map = (s->map == NULL)
+        ? mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0)
+        : mremap(s->map, s->map_len, len, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) return -1;
+    s->map = map;
+    s->map_len = len;
+    return 0;
+}
+
+int store_open(RecordStore *s, const char *path, size_t header_size, size_t record_size, int use_mmap) {
+    memset(s, 0, sizeof(*s));
+    s->header_size = header_size;
+    s->record_size = record_size;
+    s->use_mmap = use_mmap;
+    pthread_rwlock_init(&s->lock, NULL);
+    s->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (s->fd == -1) return -1;
+    if (remap_locked(s, 0) != 0) {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void store_close(RecordStore *s) {
+    if (s->map) munmap(s->map, s->map_len);
+    if (s->fd != -1) close(s->fd);
+    s->map = NULL;
+    s->fd = -1;
+}
+
+int store_count(RecordStore *s) {
+    pthread_rwlock_wrlock(&s->lock);
+    remap_locked(s, 0);
+    off_t size = s->file_size;
+    pthread_rwlock_unlock(&s->lock);
+    if (size < (off_t)s->header_size) return 0;
+    return (size - s->header_size) / s->record_size;
+}
+
+int store_read(RecordStore *s, int idx, void *out) {
+    if (idx < 0) return -1;
+    off_t offset = record_offset(s, idx);
+    if (!s->use_mmap)
+        return pread(s->fd, out, s->record_size, offset) == (ssize_t)s->record_size ? 0 : -1;
+
+    pthread_rwlock_rdlock(&s->lock);
+    if (offset + (off_t)s->record_size > s->file_size) {
+        // Another fd may have appended since we last looked
+        pthread_rwlock_unlock(&s->lock);
+        pthread_rwlock_wrlock(&s->lock);
+        if (remap_locked(s, 0) != 0 || offset + (off_t)s->record_size > s->file_size) {
+            pthread_rwlock_unlock(&s->lock);
+            return -1;
+        }
+    }
+    memcpy(out, s->map + offset, s->record_size);
+    pthread_rwlock_unlock(&s->lock);
+    return 0;
+}
+
+// Reads `count` consecutive records starting at #idx with one call. The
+// caller keeps writers of those records out.
+int store_read_range(RecordStore *s, int idx, int count, void *out) {
+    if (idx < 0 || count <= 0) return -1;
+    off_t offset = record_offset(s, idx);
+    size_t len = (size_t)count * s->record_size;
+    if (!s->use_mmap)
+        return pread(s->fd, out, len, offset) == (ssize_t)len ? 0 : -1;
+
+    pthread_rwlock_rdlock(&s->lock);
+    int result = -1;
+    if (offset + (off_t)len <= s->file_size) {
+        memcpy(out, s->map + offset, len);
+        result = 0;
+    }
+    pthread_rwlock_unlock(&s->lock);
+    return result;
+}
+
+// Copies record #idx into the file (or mapping) without forcing it to disk.
+// Writing one past the last record appends.
+int store_put(RecordStore *s, int idx, const void *record) {
+    if (idx < 0) return -1;
+    off_t offset = record_offset(s, idx);
+    off_t end = offset + s->record_size;
+    if (!s->use_mmap)
+        return pwrite(s->fd, record, s->record_size, offset) == (ssize_t)s->record_size ? 0 : -1;
+
+    pthread_rwlock_rdlock(&s->lock);
+    if (end > s->file_size) {
+        // Appending: extend the file, and the mapping if it is too short
+        pthread_rwlock_unlock(&s->lock);
+        pthread_rwlock_wrlock(&s->lock);
+        if (remap_locked(s, end) != 0 ||
+            (end > s->file_size && ftruncate(s->fd, end) == -1)) {
+            pthread_rwlock_unlock(&s->lock);
+            return -1;
+        }
+        if (end > s->file_size) s->file_size = end;
+    }
+    memcpy(s->map + offset, record, s->record_size);
+    pthread_rwlock_unlock(&s->lock);
+    return 0;
+}
+
+// Copies `record` into a fresh slot after the last one and makes it durable.
+// Returns the slot index, or -1. Concurrent appends get distinct slots.
+int store_append(RecordStore *s, const void *record) {
+    pthread_rwlock_wrlock(&s->lock);
+    if (s->file_size < (off_t)s->header_size) s->file_size = s->header_size;
+    int idx = (s->file_size - s->header_size) / s->record_size;
+    off_t offset = record_offset(s, idx);
+    off_t end = offset + s->record_size;
+    int result = 0;
+    if (!s->use_mmap) {
+        s->file_size = end;   // claim the slot; the write itself runs unlocked
+        pthread_rwlock_unlock(&s->lock);
+        if (pwrite(s->fd, record, s->record_size, offset) != (ssize_t)s->record_size) return -1;
+    } else {
+        if (remap_locked(s, end) != 0 || ftruncate(s->fd, end) == -1)
+            result = -1;
+        else {
+            s->file_size = end;
+            memcpy(s->map + offset, record, s->record_size);
+        }
+        pthread_rwlock_unlock(&s->lock);
+        if (result != 0) return -1;
+    }
+    if (commit_sync(s->fd) != 0) return -1;
+    return idx;
+}
+
+// Writes record #idx and makes it durable. Strict mmap stores msync just the
+// touched pages; everything else goes through the commit pipeline.
+int store_write(RecordStore *s, int idx, const void *record) {
+    if (store_put(s, idx, record) != 0) return -1;
+    if (!s->use_mmap || commit_mode() != DURABILITY_STRICT) return commit_sync(s->fd);
+
+    off_t offset = record_offset(s, idx);
+    long page = sysconf(_SC_PAGESIZE);
+    off_t start = offset & ~(off_t)(page - 1);
+    pthread_rwlock_rdlock(&s->lock);
+    int result = msync(s->map + start, offset + s->record_size - start, MS_SYNC);
+    pthread_rwlock_unlock(&s->lock);
+    return result;
+}
+
+// Flushes every record written with store_put()
+int store_sync(RecordStore *s) {
+    return fsync(s->fd);
+}
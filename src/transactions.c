@@ -5,104 +5,345 @@
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include "types.h"
 #include "transactions.h"
 #include "helpers.h"
 #include "database.h"
+#include "lockmgr.h"
+#include "wal.h"
+#include "txlog.h"
+#include "txlogger.h"
+#include "metrics.h"
+#include "idempotency.h"
+
+#define WAL_CHECKPOINT_BYTES (4L << 20)
+
+// Committers hold it shared from WAL append until the data files are
+// written; a checkpoint holds it exclusively while it truncates the WAL.
+static pthread_rwlock_t checkpoint_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* ------------------------------------------------------------------ */
+/* History index: accountID -> ids of that account's transactions, in */
+/* commit order. Rebuilt from the segment log at startup and appended */
+/* to on every commit, so HISTORY reads only the account's own slots.  */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    int *ids;
+    int count;
+    int capacity;
+} TransactionList;
+
+static TransactionList *account_history = NULL;   // indexed by accountID
+static size_t account_history_capacity = 0;
+static pthread_rwlock_t history_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int index_transaction_locked(int account_id, int transaction_id) {
+    if (account_id < 0) return -1;
+    if ((size_t)account_id >= account_history_capacity) {
+        size_t new_capacity = account_history_capacity ? account_history_capacity : 1024;
+        while (new_capacity <= (size_t)account_id) new_capacity *= 2;
+        TransactionList *lists = realloc(account_history, new_capacity * sizeof(TransactionList));
+        if (lists == NULL) return -1;
+        memset(lists + account_history_capacity, 0,
+               (new_capacity - account_history_capacity) * sizeof(TransactionList));
+        account_history = lists;
+        account_history_capacity = new_capacity;
+    }
+    TransactionList *list = &account_history[account_id];
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        int *ids = realloc(list->ids, capacity * sizeof(int));
+        if (ids == NULL) return -1;
+        list->ids = ids;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = transaction_id;
+    return 0;
+}
 
-int deposit (int customer_id, double amount, int socket_fd) {
-    int accounts_fd, transactions_fd;
-    Account *account;
-    TransactionRecord transaction;
+static void index_transactions(const TransactionRecord *transactions, int count) {
+    pthread_rwlock_wrlock(&history_lock);
+    for (int i = 0; i < count; i++)
+        index_transaction_locked(transactions[i].accountID, transactions[i].transactionID);
+    pthread_rwlock_unlock(&history_lock);
+}
 
-    // Validate amount
-    if (amount <= 0) {
-        send_response(socket_fd, "Invalid deposit amount\n");
-        return -1;
+static int index_visit(const TransactionRecord *transaction, void *arg) {
+    (void)arg;
+    return index_transaction_locked(transaction->accountID, transaction->transactionID);
+}
+
+int build_history_index(void) {
+    pthread_rwlock_wrlock(&history_lock);
+    for (size_t i = 0; i < account_history_capacity; i++) free(account_history[i].ids);
+    free(account_history);
+    account_history = NULL;
+    account_history_capacity = 0;
+
+    int result = txlog_scan(0, (time_t)LONG_MAX, TXLOG_ANY_ACCOUNT, index_visit, NULL);
+    pthread_rwlock_unlock(&history_lock);
+    return result;
+}
+
+// Returns a malloc'd copy of the account's transaction ids (caller frees).
+// Every id returned is readable: ids are indexed when their records are
+// queued, so this waits for the logger to catch up first.
+int transaction_ids_for_account(int account_id, int **ids) {
+    *ids = NULL;
+    txlogger_drain();
+    pthread_rwlock_rdlock(&history_lock);
+    int count = 0;
+    if (account_id >= 0 && (size_t)account_id < account_history_capacity) {
+        TransactionList *list = &account_history[account_id];
+        if (list->count > 0 && (*ids = malloc(list->count * sizeof(int))) != NULL) {
+            memcpy(*ids, list->ids, list->count * sizeof(int));
+            count = list->count;
+        }
     }
+    pthread_rwlock_unlock(&history_lock);
+    return count;
+}
 
-    // Lock accounts.dat
-    accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-    if (accounts_fd == -1) {
-        send_response(socket_fd, "Failed to lock accounts file\n");
-        return -1;
+// Like transaction_ids_for_account(), but only the ids above after_id,
+// found by binary search. Only meaningful for an after_id taken at a
+// commit boundary, before which every smaller id was already indexed.
+int transaction_ids_after(int account_id, int after_id, int **ids) {
+    *ids = NULL;
+    txlogger_drain();
+    pthread_rwlock_rdlock(&history_lock);
+    int count = 0;
+    if (account_id >= 0 && (size_t)account_id < account_history_capacity) {
+        TransactionList *list = &account_history[account_id];
+        int lo = 0, hi = list->count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (list->ids[mid] > after_id) hi = mid;
+            else lo = mid + 1;
+        }
+        count = list->count - lo;
+        if (count > 0 && (*ids = malloc(count * sizeof(int))) != NULL)
+            memcpy(*ids, list->ids + lo, count * sizeof(int));
+        else
+            count = 0;
     }
+    pthread_rwlock_unlock(&history_lock);
+    return count;
+}
 
-    // Find account
-    account = find_account_by_user_id(customer_id);
-    if (account == NULL) {
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Account not found\n");
-        return -1;
+int read_transaction(int transaction_id, TransactionRecord *out) {
+    return txlog_read(transaction_id, out);
+}
+
+void prepare_transaction(TransactionRecord *transaction, int account_id,
+                         enum TransactionType type, double amount, double new_balance) {
+    // The id is assigned by commit_postings()
+    memset(transaction, 0, sizeof(TransactionRecord));
+    transaction->accountID = account_id;
+    transaction->timestamp = time(NULL);
+    transaction->type = type;
+    transaction->flags = RECORD_IN_USE;
+    transaction->counterpartyID = -1;
+    transaction->amount = amount;
+    transaction->new_balance = new_balance;
+}
+
+// Writes a committed change back to the data files. WAL replay writes the
+// history itself; live commits hand it to the transaction logger.
+static int apply_postings(const Account *accounts, int account_count,
+                          const TransactionRecord *transactions, int transaction_count,
+                          const IdempotencyRecord *key) {
+    for (int i = 0; i < account_count; i++)
+        if (put_account(&accounts[i]) != 0) return -1;
+    for (int i = 0; i < transaction_count; i++)
+        if (txlog_write(&transactions[i]) != 0) return -1;
+    return key ? idempotency_put(key) : 0;
+}
+
+static int post_committed(const Account *accounts, int account_count,
+                          const TransactionRecord *transactions, int transaction_count,
+                          const IdempotencyRecord *key) {
+    for (int i = 0; i < account_count; i++)
+        if (put_account(&accounts[i]) != 0) return -1;
+    if (key && idempotency_put(key) != 0) return -1;
+    return txlogger_submit(transactions, transaction_count);
+}
+
+// Caller holds checkpoint_lock exclusively. Segments are sealed only once
+// the WAL is empty, since replay never writes into a sealed segment.
+static int checkpoint_postings(void) {
+    if (txlogger_drain() != 0) return -1;
+    if (sync_accounts() != 0 || txlog_sync() != 0 || idempotency_sync() != 0) return -1;
+    if (wal_truncate() != 0) return -1;
+    return txlog_seal();
+}
+
+// A change is in the WAL but could not be applied, or was applied but
+// could not be made durable. Serving on would let later writers build on
+// the wrong image, so the only safe way on is a restart, which replays
+// the WAL.
+static void commit_lost(const char *what) {
+    fprintf(stderr, "Committed change %s; stopping so restart replays the WAL\n", what);
+    abort();
+}
+
+// Commits one atomic change: the new account images and their transaction
+// records go to the WAL in a single entry (one fsync), and are written to
+// accounts.dat and queued for the transaction log, without forcing either
+// file to disk.
+// The images are applied before the WAL sync, so a caller holding the
+// account's record lock can pass its id as `locked_account` and have the
+// lock released then, not after the fsync; -1 if none. A writer that
+// builds on an applied image appends after it, so its own sync covers it.
+// Transaction ids are assigned here, under the checkpoint lock, so a
+// checkpoint never seals a segment an allocated id still has to be written to.
+// An idempotency key armed by this thread rides in the same entry.
+static int commit_entry(Account *accounts, int account_count,
+                        TransactionRecord *transactions, int transaction_count,
+                        int locked_account) {
+    const IdempotencyRecord *key = idempotency_take_armed();
+    // Every committed image is a new version of its account
+    for (int i = 0; i < account_count; i++)
+        accounts[i].version++;
+    pthread_rwlock_rdlock(&checkpoint_lock);
+    for (int i = 0; i < transaction_count; i++)
+        transactions[i].transactionID = txlog_next_id();
+    int result = wal_append(accounts, account_count, transactions, transaction_count, key);
+    // Logged but not applied: accounts.dat and its readers would keep the
+    // old image, and the next writer would build on it
+    if (result == 0 && post_committed(accounts, account_count, transactions, transaction_count, key) != 0)
+        commit_lost("could not be applied");
+    if (result == 0) index_transactions(transactions, transaction_count);
+    if (locked_account >= 0) unlock_record(LOCK_ACCOUNTS, locked_account);
+    if (result == 0 && wal_sync() != 0) commit_lost("could not be synced");
+    pthread_rwlock_unlock(&checkpoint_lock);
+    if (result == 0 && key) idempotency_logged();
+
+    if (result == 0 && wal_size() > WAL_CHECKPOINT_BYTES &&
+        pthread_rwlock_trywrlock(&checkpoint_lock) == 0) {
+        if (wal_size() > WAL_CHECKPOINT_BYTES) checkpoint_postings();
+        pthread_rwlock_unlock(&checkpoint_lock);
     }
+    return result;
+}
 
-    // Update balance (using the 0-based ID fix)
-    double new_balance = account->balance + amount;
-    lseek(accounts_fd, sizeof(AccountHeader) + (account->accountID) * sizeof(Account), SEEK_SET);
-    account->balance = new_balance;
-    account->transaction_count++;
-    if (write(accounts_fd, account, sizeof(Account)) != sizeof(Account)) {
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Failed to update account\n");
-        return -1;
+int commit_postings(Account *accounts, int account_count,
+                    TransactionRecord *transactions, int transaction_count) {
+    return commit_entry(accounts, account_count, transactions, transaction_count, -1);
+}
+
+// Opens the segmented transaction log and the WAL, replays anything the
+// last run logged but may not have written back, then checkpoints. Call
+// after open_record_stores() and before any client is served.
+int open_transaction_log(void) {
+    if (txlog_open("data/txlog") != 0) return -1;
+    if (wal_open("data/wal.log") != 0) return -1;
+
+    // Replayed records advance the log's next id past themselves
+    if (wal_replay(apply_postings) < 0) return -1;
+    pthread_rwlock_wrlock(&checkpoint_lock);
+    int result = checkpoint_postings();
+    pthread_rwlock_unlock(&checkpoint_lock);
+    if (result == 0) result = build_history_index();
+    return result;
+}
+
+// Writes every committed change back to the data files and empties the
+// WAL. For tools that exit after committing; the server checkpoints itself.
+int checkpoint_transactions(void) {
+    pthread_rwlock_wrlock(&checkpoint_lock);
+    int result = checkpoint_postings();
+    pthread_rwlock_unlock(&checkpoint_lock);
+    return result;
+}
+
+// Calls fn while no commit is in flight: accounts.dat holds every
+// committed image and last_transaction_id is the newest committed id.
+// Commits wait until fn returns, so fn should only copy what it needs.
+int at_commit_boundary(int (*fn)(int last_transaction_id, void *arg), void *arg) {
+    pthread_rwlock_wrlock(&checkpoint_lock);
+    int result = fn(txlog_last_id(), arg);
+    pthread_rwlock_unlock(&checkpoint_lock);
+    return result;
+}
+
+// Moves sealed segments older than cutoff out of the live log and drops
+// their ids from the history index. Returns the number of segments moved.
+int archive_transactions(time_t cutoff) {
+    int archived = txlog_archive_before(cutoff);
+    if (archived > 0) {
+        // No commit may index a record while the index is rebuilt
+        pthread_rwlock_wrlock(&checkpoint_lock);
+        if (txlogger_drain() != 0 || build_history_index() != 0) archived = -1;
+        pthread_rwlock_unlock(&checkpoint_lock);
     }
-    fsync(accounts_fd);
-
-    // Unlock accounts.dat
-    unlock_file(accounts_fd);
-
-    // Log transaction
-    transactions_fd = lock_file("data/transactions.dat", F_WRLCK);
-    if (transactions_fd == -1) {
-        // Rollback: Subtract amount back
-        accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-        // Re-find account to be safe
-        account = find_account_by_user_id(customer_id); 
-        if(account != NULL) {
-            account->balance = account->balance - amount;
-            account->transaction_count++; // Log rollback
-            lseek(accounts_fd, sizeof(AccountHeader) + (account->accountID) * sizeof(Account), SEEK_SET);
-            write(accounts_fd, account, sizeof(Account));
-            fsync(accounts_fd);
-        }
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Failed to log transaction\n");
+    return archived;
+}
+
+// Single-account writers are optimistic: the new image is built from a
+// lock-free snapshot, and the record lock is held only to compare the
+// stored version with the snapshot's and, if it still matches, to append
+// and apply the new image. The WAL sync runs after the lock is released.
+// Returns 1 if another writer committed in between, in which case the
+// caller rebuilds.
+static int commit_if_unchanged(const Account *snapshot, Account *updated,
+                               TransactionRecord *transaction) {
+    if (lock_record(LOCK_ACCOUNTS, snapshot->accountID, LOCK_EXCLUSIVE) != 0) return -1;
+    Account current;
+    if (read_account(snapshot->accountID, &current) != 0) {
+        unlock_record(LOCK_ACCOUNTS, snapshot->accountID);
         return -1;
     }
+    if (current.version != snapshot->version) {
+        unlock_record(LOCK_ACCOUNTS, snapshot->accountID);
+        metrics_add(METRIC_VERSION_CONFLICTS, 1);
+        return 1;
+    }
+    return commit_entry(updated, 1, transaction, 1, snapshot->accountID);
+}
 
-    TransactionHeader trans_header;
-    lseek(transactions_fd, 0, SEEK_SET); // 1. Go to start
-    read(transactions_fd, &trans_header, sizeof(TransactionHeader)); // 2. Read header
+int deposit (int customer_id, double amount, int socket_fd) {
+    Account *account;
+    TransactionRecord transaction;
 
-    // Prepare transaction
-    transaction.transactionID = trans_header.next_id++; // 3. Use and increment ID
-    transaction.accountID = account->accountID;
-    transaction.timestamp = time(NULL);
-    snprintf(transaction.description, MAX_DESCRIPTION_LEN, "Deposit %.2f", amount);
-    transaction.amount = amount;
-    transaction.new_balance = new_balance;
-    memset(transaction.reserved, 0, sizeof(transaction.reserved));
+    // Validate amount
+    if (amount <= 0) {
+        send_response(socket_fd, "Invalid deposit amount\n");
+        return -1;
+    }
 
-    // Append transaction
-    lseek(transactions_fd, 0, SEEK_END);
-    write(transactions_fd, &transaction, sizeof(TransactionRecord));
+    int result;
+    do {
+        // Find account (lock-free snapshot)
+        account = find_account_by_user_id(customer_id);
+        if (account == NULL) {
+            send_response(socket_fd, "Account not found\n");
+            return -1;
+        }
+        Account snapshot = *account;
 
-    // 4. Increment count and write header back
-    lseek(transactions_fd, 0, SEEK_SET);
-    trans_header.record_count++;
-    write(transactions_fd, &trans_header, sizeof(TransactionHeader));
-    fsync(transactions_fd);
+        // New account image plus the transaction that explains it
+        Account updated = snapshot;
+        updated.balance += amount;
+        updated.transaction_count++;
+        prepare_transaction(&transaction, updated.accountID, TXN_DEPOSIT, amount, updated.balance);
 
-    // Unlock transactions.dat
-    unlock_file(transactions_fd);
+        // Balance and history commit together through the WAL
+        result = commit_if_unchanged(&snapshot, &updated, &transaction);
+    } while (result == 1);
 
+    if (result != 0) {
+        send_response(socket_fd, "Failed to update account\n");
+        return -1;
+    }
     send_response(socket_fd, "Deposit successful\n");
     return 0;
 }
 
 // Withdraw 
 int withdraw(int customer_id, double amount, int socket_fd) {
-    int accounts_fd, transactions_fd;
     Account *account;
     TransactionRecord transaction;
 
@@ -112,211 +353,522 @@ int withdraw(int customer_id, double amount, int socket_fd) {
         return -1;
     }
 
-    // Lock accounts.dat
-    accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-    if (accounts_fd == -1) {
-        send_response(socket_fd, "Failed to lock accounts file\n");
+    int result;
+    do {
+        // Find account (lock-free snapshot)
+        account = find_account_by_user_id(customer_id);
+        if (account == NULL) {
+            send_response(socket_fd, "Account not found\n");
+            return -1;
+        }
+        Account snapshot = *account;
+
+        // Check sufficient funds; the version check keeps this decision valid
+        if (snapshot.balance < amount) {
+            send_response(socket_fd, "Insufficient funds\n");
+            return -1;
+        }
+
+        // New account image plus the transaction that explains it
+        Account updated = snapshot;
+        updated.balance -= amount;
+        updated.transaction_count++;
+        prepare_transaction(&transaction, updated.accountID, TXN_WITHDRAWAL, -amount, updated.balance); // Negative for withdrawal
+
+        // Balance and history commit together through the WAL
+        result = commit_if_unchanged(&snapshot, &updated, &transaction);
+    } while (result == 1);
+
+    if (result != 0) {
+        send_response(socket_fd, "Failed to update account\n");
+        return -1;
+    }
+    send_response(socket_fd, "Withdrawal successful\n");
+    return 0;
+}
+
+// Helper: Log transaction (can be reused)
+int log_transaction(int account_id, enum TransactionType type, double amount, double new_balance) {
+    TransactionRecord transaction;
+    prepare_transaction(&transaction, account_id, type, amount, new_balance);
+    return commit_postings(NULL, 0, &transaction, 1);
+}
+
+int transferFunds(int customer_id, const char *recipient_username, double amount, int socket_fd) {
+    User *recipient_user;
+    Account *account;
+
+    if (amount <= 0) {
+        send_response(socket_fd, "Invalid transfer amount\n");
+        return -1;
+    }
+
+    // Validate recipient (index lookup, no users.dat lock needed)
+    recipient_user = find_user_by_username(recipient_username);
+    if (recipient_user == NULL || recipient_user->role != ROLE_CUSTOMER || recipient_user->active == 0) {
+        send_response(socket_fd, "Invalid or inactive recipient\n");
+        return -1;
+    }
+    if (recipient_user->id == customer_id) {
+        send_response(socket_fd, "Cannot transfer to self\n");
+        return -1;
+    }
+    int recipient_id = recipient_user->id;
+
+    // Lock both account records up front, in a fixed order, so the debit
+    // and the credit happen under one critical section
+    int sender_account_id = account_id_for_user(customer_id);
+    int recipient_account_id = account_id_for_user(recipient_id);
+    if (sender_account_id < 0 || recipient_account_id < 0 ||
+        lock_record_pair(LOCK_ACCOUNTS, sender_account_id, recipient_account_id, LOCK_EXCLUSIVE) != 0) {
+        send_response(socket_fd, "Account not found\n");
         return -1;
     }
 
-    // Find account
+    // find_account_by_user_id reuses one buffer, so copy each result
+    Account updated[2];
     account = find_account_by_user_id(customer_id);
-    if (account == NULL) {
-        unlock_file(accounts_fd);
+    if (account != NULL) updated[0] = *account;
+    if (account == NULL || (account = find_account_by_user_id(recipient_id)) == NULL) {
+        unlock_record_pair(LOCK_ACCOUNTS, sender_account_id, recipient_account_id);
         send_response(socket_fd, "Account not found\n");
         return -1;
     }
+    updated[1] = *account;
 
     // Check sufficient funds
-    if (account->balance < amount) {
-        unlock_file(accounts_fd);
+    if (updated[0].balance < amount) {
+        unlock_record_pair(LOCK_ACCOUNTS, sender_account_id, recipient_account_id);
         send_response(socket_fd, "Insufficient funds\n");
         return -1;
     }
 
-    // Update balance (using the 0-based ID fix)
-    double new_balance = account->balance - amount;
-    lseek(accounts_fd, sizeof(AccountHeader) + (account->accountID) * sizeof(Account), SEEK_SET);
-    account->balance = new_balance;
-    account->transaction_count++;
-    if (write(accounts_fd, account, sizeof(Account)) != sizeof(Account)) {
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Failed to update account\n");
+    // Both account images and the paired debit/credit records commit as
+    // one WAL entry: either the whole transfer survives a crash or none of it
+    TransactionRecord transactions[2];
+    updated[0].balance -= amount;
+    updated[0].transaction_count++;
+    updated[1].balance += amount;
+    updated[1].transaction_count++;
+    prepare_transaction(&transactions[0], updated[0].accountID, TXN_TRANSFER_OUT, -amount, updated[0].balance);
+    prepare_transaction(&transactions[1], updated[1].accountID, TXN_TRANSFER_IN, amount, updated[1].balance);
+    transactions[0].counterpartyID = updated[1].accountID;
+    transactions[1].counterpartyID = updated[0].accountID;
+
+    if (commit_postings(updated, 2, transactions, 2) != 0) {
+        unlock_record_pair(LOCK_ACCOUNTS, sender_account_id, recipient_account_id);
+        send_response(socket_fd, "Transfer failed\n");
         return -1;
     }
-    fsync(accounts_fd);
+    unlock_record_pair(LOCK_ACCOUNTS, sender_account_id, recipient_account_id);
 
-    // Unlock accounts.dat
-    unlock_file(accounts_fd);
+    send_response(socket_fd, "Transfer successful\n");
+    return 0;
+}
+/* ------------------------------------------------------------------ */
+/* TRANSFER_BATCH: one source account, many (recipient, amount) legs.  */
+/* Body: a leg count line, then one "<recipient> <amount>" line per    */
+/* leg. Every accepted leg commits in a single WAL entry.              */
+/* ------------------------------------------------------------------ */
+#define TRANSFER_BATCH_MAX_LEGS 16384      // 2 records per leg must fit one WAL entry
+#define TRANSFER_BATCH_MAX_LINE 128
+
+typedef struct {
+    char recipient[MAX_USERNAME_LEN];
+    double amount;
+    int user_id;
+    int account_id;         // -1 once the leg is refused
+    const char *error;
+} BatchLeg;
+
+static int count_lines(const char *buf, size_t len) {
+    int lines = 0;
+    for (size_t i = 0; i < len; i++)
+        if (buf[i] == '\n') lines++;
+    return lines;
+}
 
-    // Log transaction
-    transactions_fd = lock_file("data/transactions.dat", F_WRLCK);
-    if (transactions_fd == -1) {
-        // Rollback: Add amount back
-        accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-        // Re-find account to be safe
-        account = find_account_by_user_id(customer_id);
-        if(account != NULL) {
-            account->balance = account->balance + amount;
-            account->transaction_count++; // Log rollback
-            lseek(accounts_fd, sizeof(AccountHeader) + (account->accountID) * sizeof(Account), SEEK_SET);
-            write(accounts_fd, account, sizeof(Account));
-            fsync(accounts_fd);
+// Collects the batch body, starting with whatever arrived with the command.
+// Returns a malloc'd, NUL-terminated buffer holding the count line and
+// every leg line, or NULL if the body is malformed or the client went away.
+static char *read_batch_body(int socket_fd, const char *pending, int *leg_count) {
+    size_t len = strlen(pending), capacity = len + 4096;
+    char *buf = malloc(capacity);
+    if (buf == NULL) return NULL;
+    memcpy(buf, pending, len);
+
+    *leg_count = -1;
+    while (1) {
+        buf[len] = '\0';
+        char *body = buf + strspn(buf, " \r\n");
+        if (*leg_count < 0 && strchr(body, '\n') != NULL) {
+            if (sscanf(body, "%d", leg_count) != 1 ||
+                *leg_count <= 0 || *leg_count > TRANSFER_BATCH_MAX_LEGS) break;
         }
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Failed to log transaction\n");
+        if (*leg_count > 0 && count_lines(body, len - (body - buf)) >= *leg_count + 1)
+            return buf;
+        if (len >= (size_t)(TRANSFER_BATCH_MAX_LEGS + 1) * TRANSFER_BATCH_MAX_LINE) break;
+
+        if (capacity - len < 4096) {
+            char *grown = realloc(buf, capacity * 2);
+            if (grown == NULL) break;
+            buf = grown;
+            capacity *= 2;
+        }
+        if (read_string_from_socket(socket_fd, buf + len, capacity - len) != 0) break;
+        len += strlen(buf + len);
+    }
+    free(buf);
+    return NULL;
+}
+
+// Sends the summary line, one result line per leg, then the end marker
+static void send_batch_results(int socket_fd, const BatchLeg *legs, int leg_count,
+                               const char *summary) {
+    OutBuf out;
+    outbuf_init(&out, socket_fd);
+    outbuf_puts(&out, summary);
+    for (int i = 0; i < leg_count; i++)
+        outbuf_printf(&out, "%d %s\n", i + 1, legs[i].error ? legs[i].error : "OK");
+    outbuf_puts(&out, "--- End of Batch ---\n");
+    outbuf_flush(&out);
+}
+
+// Caller holds every involved account lock. Builds one image per distinct
+// account (image_of maps an account id to its image; ids are dense, so a
+// flat array is enough), checks the total once and commits every accepted
+// leg as one WAL entry. Fills `summary` and marks each leg's outcome.
+static int apply_transfer_batch(int customer_id, BatchLeg *legs, int leg_count, int *image_of,
+                                Account *updated, TransactionRecord *transactions,
+                                char *summary, size_t summary_len) {
+    Account *account = find_account_by_user_id(customer_id);
+    if (account == NULL) {
+        snprintf(summary, summary_len, "Account not found\n");
         return -1;
     }
+    int image_count = 0;
+    updated[image_count] = *account;
+    image_of[account->accountID] = image_count++;
+
+    double total = 0;
+    int accepted = 0;
+    for (int i = 0; i < leg_count; i++) {
+        BatchLeg *leg = &legs[i];
+        if (leg->error != NULL) continue;
+        if (image_of[leg->account_id] < 0) {
+            account = find_account_by_user_id(leg->user_id);
+            if (account == NULL) {
+                leg->error = "ERR Account not found";
+                continue;
+            }
+            updated[image_count] = *account;
+            image_of[leg->account_id] = image_count++;
+        }
+        total += leg->amount;
+        accepted++;
+    }
 
-    TransactionHeader trans_header;
-    lseek(transactions_fd, 0, SEEK_SET); // 1. Go to start
-    read(transactions_fd, &trans_header, sizeof(TransactionHeader)); // 2. Read header
+    // The total is checked once: either every accepted leg is paid or none is
+    if (accepted == 0 || updated[0].balance < total) {
+        for (int i = 0; i < leg_count; i++)
+            if (legs[i].error == NULL) legs[i].error = "ERR Insufficient funds";
+        snprintf(summary, summary_len, "Batch rejected: %s (total %.2f, balance %.2f)\n",
+                 accepted == 0 ? "no valid legs" : "insufficient funds", total, updated[0].balance);
+        return -1;
+    }
 
-    // Prepare transaction
-    transaction.transactionID = trans_header.next_id++; // 3. Use and increment ID
-    transaction.accountID = account->accountID;
-    transaction.timestamp = time(NULL);
-    snprintf(transaction.description, MAX_DESCRIPTION_LEN, "Withdrawal %.2f", amount);
-    transaction.amount = -amount; // Negative for withdrawal
-    transaction.new_balance = new_balance;
-    memset(transaction.reserved, 0, sizeof(transaction.reserved));
+    int transaction_count = 0;
+    for (int i = 0; i < leg_count; i++) {
+        BatchLeg *leg = &legs[i];
+        if (leg->error != NULL) continue;
+        Account *source = &updated[0];
+        Account *recipient = &updated[image_of[leg->account_id]];
+        source->balance -= leg->amount;
+        source->transaction_count++;
+        recipient->balance += leg->amount;
+        recipient->transaction_count++;
+        TransactionRecord *out = &transactions[transaction_count++];
+        TransactionRecord *in = &transactions[transaction_count++];
+        prepare_transaction(out, source->accountID, TXN_TRANSFER_OUT, -leg->amount, source->balance);
+        prepare_transaction(in, recipient->accountID, TXN_TRANSFER_IN, leg->amount, recipient->balance);
+        out->counterpartyID = recipient->accountID;
+        in->counterpartyID = source->accountID;
+    }
 
-    // Append transaction
-    lseek(transactions_fd, 0, SEEK_END);
-    write(transactions_fd, &transaction, sizeof(TransactionRecord));
+    if (commit_postings(updated, image_count, transactions, transaction_count) != 0) {
+        for (int i = 0; i < leg_count; i++)
+            if (legs[i].error == NULL) legs[i].error = "ERR Not applied";
+        snprintf(summary, summary_len, "Transfer batch failed\n");
+        return -1;
+    }
+    snprintf(summary, summary_len, "Batch applied: %d of %d legs, total %.2f\n",
+             accepted, leg_count, total);
+    return 0;
+}
 
-    // 4. Increment count and write header back
-    lseek(transactions_fd, 0, SEEK_SET);
-    trans_header.record_count++;
-    write(transactions_fd, &trans_header, sizeof(TransactionHeader));
-    fsync(transactions_fd);
+int transferBatch(int customer_id, int socket_fd, const char *pending) {
+    int leg_count;
+    char *body = read_batch_body(socket_fd, pending, &leg_count);
+    if (body == NULL) {
+        send_response(socket_fd, "Invalid transfer batch\n--- End of Batch ---\n");
+        return -1;
+    }
+    BatchLeg *legs = calloc(leg_count, sizeof(BatchLeg));
+    int *lock_ids = malloc((leg_count + 1) * sizeof(int));
+    if (legs == NULL || lock_ids == NULL) {
+        free(body);
+        free(legs);
+        free(lock_ids);
+        send_response(socket_fd, "Transfer batch failed\n--- End of Batch ---\n");
+        return -1;
+    }
 
-    // Unlock transactions.dat
-    unlock_file(transactions_fd);
+    // Parse and validate each leg on its own; a bad leg does not sink the batch
+    int source_account_id = account_id_for_user(customer_id);
+    int max_account_id = source_account_id;
+    int lock_count = 0;
+    lock_ids[lock_count++] = source_account_id;
+    char *save = NULL;
+    char *line = strtok_r(body, "\n", &save);   // the count line
+    for (int i = 0; i < leg_count; i++) {
+        BatchLeg *leg = &legs[i];
+        leg->account_id = -1;
+        line = strtok_r(NULL, "\n", &save);
+        if (line == NULL || sscanf(line, "%49s %lf", leg->recipient, &leg->amount) != 2 ||
+            !(leg->amount > 0)) {
+            leg->error = "ERR Invalid leg";
+            continue;
+        }
+        User *recipient = find_user_by_username(leg->recipient);
+        if (recipient == NULL || recipient->role != ROLE_CUSTOMER || recipient->active == 0) {
+            leg->error = "ERR Invalid or inactive recipient";
+            continue;
+        }
+        if (recipient->id == customer_id) {
+            leg->error = "ERR Cannot transfer to self";
+            continue;
+        }
+        leg->user_id = recipient->id;
+        leg->account_id = account_id_for_user(recipient->id);
+        if (leg->account_id < 0) {
+            leg->error = "ERR Account not found";
+            continue;
+        }
+        if (leg->account_id > max_account_id) max_account_id = leg->account_id;
+        lock_ids[lock_count++] = leg->account_id;
+    }
+    free(body);
+
+    char summary[128];
+    int result = -1;
+    int *image_of = malloc((max_account_id + 1) * sizeof(int));
+    Account *updated = malloc(lock_count * sizeof(Account));
+    TransactionRecord *transactions = malloc(2 * (size_t)leg_count * sizeof(TransactionRecord));
+    if (source_account_id < 0) {
+        snprintf(summary, sizeof(summary), "Account not found\n");
+    } else if (image_of == NULL || updated == NULL || transactions == NULL) {
+        snprintf(summary, sizeof(summary), "Transfer batch failed\n");
+    } else if (lock_record_set(LOCK_ACCOUNTS, lock_ids, lock_count, LOCK_EXCLUSIVE) != 0) {
+        snprintf(summary, sizeof(summary), "Account not found\n");
+    } else {
+        // Source and every recipient stay locked from the balance check to the commit
+        for (int i = 0; i <= max_account_id; i++) image_of[i] = -1;
+        result = apply_transfer_batch(customer_id, legs, leg_count, image_of,
+                                      updated, transactions, summary, sizeof(summary));
+        unlock_record_set(LOCK_ACCOUNTS, lock_ids, lock_count);
+    }
+    send_batch_results(socket_fd, legs, leg_count, summary);
+    free(image_of);
+    free(updated);
+    free(transactions);
+    free(legs);
+    free(lock_ids);
+    return result;
+}
 
-    send_response(socket_fd, "Withdrawal successful\n");
-    return 0;
+/* ------------------------------------------------------------------ */
+/* Multi-operation transactions: BEGIN, any number of DEPOSIT /        */
+/* WITHDRAW / TRANSFER, then COMMIT. Operations are only queued until  */
+/* COMMIT, which locks every account involved (in stripe order, so two */
+/* transactions never deadlock), applies the operations in order and   */
+/* commits them all as one WAL entry, or none of them.                 */
+/* ------------------------------------------------------------------ */
+void multi_txn_init(MultiTxn *txn) {
+    memset(txn, 0, sizeof(*txn));
 }
 
-// Helper: Log transaction (can be reused)
-int log_transaction(int account_id, const char *description, double amount, double new_balance) {
-    int fd = lock_file("data/transactions.dat", F_WRLCK);
-    if (fd == -1) return -1;
+void multi_txn_clear(MultiTxn *txn) {
+    free(txn->ops);
+    multi_txn_init(txn);
+}
 
-    TransactionHeader header;
-    read(fd, &header, sizeof(TransactionHeader));
-    TransactionRecord transaction;
-    transaction.transactionID = header.next_id++;
-    transaction.accountID = account_id;
-    transaction.timestamp = time(NULL);
-    strncpy(transaction.description, description, MAX_DESCRIPTION_LEN);
-    transaction.amount = amount;
-    transaction.new_balance = new_balance;
-    memset(transaction.reserved, 0, sizeof(transaction.reserved));
-
-    lseek(fd, 0, SEEK_END);
-    write(fd, &transaction, sizeof(TransactionRecord));
-    lseek(fd, 0, SEEK_SET);
-    header.record_count++;
-    write(fd, &header, sizeof(TransactionHeader));
-    fsync(fd);
-
-    unlock_file(fd);
+// type is TXN_DEPOSIT, TXN_WITHDRAWAL or TXN_TRANSFER_OUT (from account_id
+// to counterparty_id)
+int multi_txn_add(MultiTxn *txn, enum TransactionType type, int account_id,
+                  int counterparty_id, double amount) {
+    if (txn->count >= MULTI_TXN_MAX_OPS) return -1;
+    if (txn->count == txn->capacity) {
+        int capacity = txn->capacity ? txn->capacity * 2 : 8;
+        TxnOperation *ops = realloc(txn->ops, capacity * sizeof(TxnOperation));
+        if (ops == NULL) return -1;
+        txn->ops = ops;
+        txn->capacity = capacity;
+    }
+    txn->ops[txn->count++] = (TxnOperation){ .type = type, .account_id = account_id,
+                                             .counterparty_id = counterparty_id, .amount = amount };
     return 0;
 }
 
-// Helper: Update account balance and transaction count
-int update_account(int fd, Account *account, double new_balance) {
-    
-    lseek(fd, sizeof(AccountHeader) + (account->accountID) * sizeof(Account), SEEK_SET);
-    account->balance = new_balance;
-    account->transaction_count++;
-    if (write(fd, account, sizeof(Account)) != sizeof(Account)) {
-        return -1;
+// Caller holds every involved account lock. Returns the image of the
+// account, reading it on first use, or NULL.
+static Account *txn_image(int account_id, int *image_of, Account *images, int *image_count) {
+    if (image_of[account_id] < 0) {
+        if (read_account(account_id, &images[*image_count]) != 0 ||
+            !(images[*image_count].flags & RECORD_IN_USE)) return NULL;
+        image_of[account_id] = (*image_count)++;
     }
-    fsync(fd); // Ensure durability
-    return 0;
+    return &images[image_of[account_id]];
 }
 
-int transferFunds(int customer_id, int socket_fd) {
-    char recipient_username[MAX_USERNAME_LEN];
-    double amount;
-    int users_fd, accounts_fd;
-    User *recipient_user;
-    Account *sender_account, *recipient_account;
+// Caller holds every involved account lock
+static int apply_multi_txn(const MultiTxn *txn, int *image_of, Account *images,
+                           TransactionRecord *transactions, char *error, size_t len) {
+    int image_count = 0, transaction_count = 0;
+    for (int i = 0; i < txn->count; i++) {
+        const TxnOperation *op = &txn->ops[i];
+        Account *account = txn_image(op->account_id, image_of, images, &image_count);
+        Account *payee = NULL;
+        if (op->type == TXN_TRANSFER_OUT)
+            payee = txn_image(op->counterparty_id, image_of, images, &image_count);
+        if (account == NULL || (op->type == TXN_TRANSFER_OUT && payee == NULL)) {
+            snprintf(error, len, "operation %d: account not found", i + 1);
+            return -1;
+        }
+        // Funds are checked against the balance left by the earlier operations
+        if (op->type != TXN_DEPOSIT && account->balance < op->amount) {
+            snprintf(error, len, "operation %d: insufficient funds", i + 1);
+            return -1;
+        }
 
-    // Read input from socket
-    if (read_line_from_socket(socket_fd, recipient_username, MAX_USERNAME_LEN) != 0) {
-        send_response(socket_fd, "Error reading recipient username\n");
-        return -1;
+        double delta = op->type == TXN_DEPOSIT ? op->amount : -op->amount;
+        account->balance += delta;
+        account->transaction_count++;
+        TransactionRecord *t = &transactions[transaction_count++];
+        prepare_transaction(t, account->accountID, op->type, delta, account->balance);
+        if (payee != NULL) {
+            payee->balance += op->amount;
+            payee->transaction_count++;
+            TransactionRecord *in = &transactions[transaction_count++];
+            prepare_transaction(in, payee->accountID, TXN_TRANSFER_IN, op->amount, payee->balance);
+            t->counterpartyID = payee->accountID;
+            in->counterpartyID = account->accountID;
+        }
     }
-    amount = read_amount_from_socket(socket_fd);
-    if (amount <= 0) {
-        send_response(socket_fd, "Invalid transfer amount\n");
+    if (commit_postings(images, image_count, transactions, transaction_count) != 0) {
+        snprintf(error, len, "commit failed");
         return -1;
     }
+    return 0;
+}
 
-    // Validate recipient
-    users_fd = lock_file("data/users.dat", F_RDLCK);
-    if (users_fd == -1) {
-        send_response(socket_fd, "Failed to lock users file\n");
+// Applies every queued operation atomically. On failure nothing is
+// applied and `error` says which operation was refused. The queue is
+// left as is; the caller clears it.
+int multi_txn_commit(const MultiTxn *txn, char *error, size_t len) {
+    if (txn->count == 0) {
+        snprintf(error, len, "no operations");
         return -1;
     }
-    recipient_user = find_user_by_username(recipient_username);
-    if (recipient_user == NULL || recipient_user->role != ROLE_CUSTOMER || recipient_user->active == 0) {
-        unlock_file(users_fd);
-        send_response(socket_fd, "Invalid or inactive recipient\n");
-        return -1;
+    int *lock_ids = malloc(2 * (size_t)txn->count * sizeof(int));
+    int lock_count = 0, max_account_id = 0;
+    if (lock_ids != NULL) {
+        for (int i = 0; i < txn->count; i++) {
+            lock_ids[lock_count++] = txn->ops[i].account_id;
+            if (txn->ops[i].type == TXN_TRANSFER_OUT)
+                lock_ids[lock_count++] = txn->ops[i].counterparty_id;
+        }
+        for (int i = 0; i < lock_count; i++)
+            if (lock_ids[i] > max_account_id) max_account_id = lock_ids[i];
     }
-    if (recipient_user->id == customer_id) {
-        unlock_file(users_fd);
-        send_response(socket_fd, "Cannot transfer to self\n");
-        return -1;
+    int *image_of = malloc((max_account_id + 1) * sizeof(int));
+    Account *images = malloc((size_t)lock_count * sizeof(Account));
+    TransactionRecord *transactions = malloc(2 * (size_t)txn->count * sizeof(TransactionRecord));
+
+    int result = -1;
+    if (lock_ids == NULL || image_of == NULL || images == NULL || transactions == NULL) {
+        snprintf(error, len, "out of memory");
+    } else if (lock_record_set(LOCK_ACCOUNTS, lock_ids, lock_count, LOCK_EXCLUSIVE) != 0) {
+        snprintf(error, len, "account not found");
+    } else {
+        for (int i = 0; i <= max_account_id; i++) image_of[i] = -1;
+        result = apply_multi_txn(txn, image_of, images, transactions, error, len);
+        unlock_record_set(LOCK_ACCOUNTS, lock_ids, lock_count);
     }
-    unlock_file(users_fd);
-    // free(recipient_user); // If find_user_by_username uses malloc
+    free(lock_ids);
+    free(image_of);
+    free(images);
+    free(transactions);
+    return result;
+}
 
-    // Lock accounts.dat
-    accounts_fd = lock_file("data/accounts.dat", F_WRLCK);
-    if (accounts_fd == -1) {
-        send_response(socket_fd, "Failed to lock accounts file\n");
+// Validates one customer operation inside BEGIN ... COMMIT and queues it.
+// cmd is DEPOSIT, WITHDRAW or TRANSFER; recipient is only used by TRANSFER.
+int queueOperation(MultiTxn *txn, int customer_id, const char *cmd,
+                   const char *recipient_username, double amount, int socket_fd) {
+    char reply[96];
+    if (amount <= 0) {
+        send_response(socket_fd, "Invalid amount\n");
         return -1;
     }
-
-    // Find accounts
-    sender_account = find_account_by_user_id(customer_id);
-    recipient_account = find_account_by_user_id(recipient_user->id);
-    if (sender_account == NULL || recipient_account == NULL) {
-        unlock_file(accounts_fd);
+    int account_id = account_id_for_user(customer_id);
+    if (account_id < 0) {
         send_response(socket_fd, "Account not found\n");
         return -1;
     }
 
-    // Check sufficient funds
-    if (sender_account->balance < amount) {
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Insufficient funds\n");
-        return -1;
+    enum TransactionType type = TXN_DEPOSIT;
+    int counterparty_id = -1;
+    if (strcmp(cmd, "WITHDRAW") == 0) {
+        type = TXN_WITHDRAWAL;
+    } else if (strcmp(cmd, "TRANSFER") == 0) {
+        User *recipient = find_user_by_username(recipient_username);
+        if (recipient == NULL || recipient->role != ROLE_CUSTOMER || recipient->active == 0) {
+            send_response(socket_fd, "Invalid or inactive recipient\n");
+            return -1;
+        }
+        if (recipient->id == customer_id) {
+            send_response(socket_fd, "Cannot transfer to self\n");
+            return -1;
+        }
+        type = TXN_TRANSFER_OUT;
+        counterparty_id = account_id_for_user(recipient->id);
+        if (counterparty_id < 0) {
+            send_response(socket_fd, "Account not found\n");
+            return -1;
+        }
     }
 
-    // Perform transfer
-    if (withdraw(customer_id, amount, socket_fd) != 0) {
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Withdrawal failed\n");
-        return -1;
-    }
-    if (deposit(recipient_user->id, amount, socket_fd) != 0) {
-        // Rollback withdrawal
-        deposit(customer_id, amount, socket_fd);
-        unlock_file(accounts_fd);
-        send_response(socket_fd, "Deposit failed\n");
+    if (multi_txn_add(txn, type, account_id, counterparty_id, amount) != 0) {
+        send_response(socket_fd, "Transaction is full; COMMIT or ABORT\n");
         return -1;
     }
-
-    unlock_file(accounts_fd);
-    send_response(socket_fd, "Transfer successful\n");
+    snprintf(reply, sizeof(reply), "Queued %s (%d pending)\n", cmd, txn->count);
+    send_response(socket_fd, reply);
     return 0;
 }
+
+int commitTransaction(MultiTxn *txn, int socket_fd) {
+    char error[96], reply[160];
+    int result = multi_txn_commit(txn, error, sizeof(error));
+    if (result == 0)
+        snprintf(reply, sizeof(reply), "Transaction committed: %d operations\n", txn->count);
+    else
+        snprintf(reply, sizeof(reply), "Transaction aborted: %s\n", error);
+    multi_txn_clear(txn);
+    send_response(socket_fd, reply);
+    return result;
+}
+
 /*
     user enters other user's name. name will be validated so that user doesnt add his own name.
     withdraw function called for curent user, pass current user id
@@ -0,0 +1,369 @@
+/* src/txlog.c */
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "txlog.h"
+
+#define SCAN_BATCH 256
+
+typedef struct {
+    int fd;
+    SegmentHeader header;   // guarded by meta_lock
+    int dirty;              // header changed since it was last written
+} Segment;
+
+// The table is held shared around every segment read or write, so a
+// segment can only be detached (archived) once no I/O is using its fd.
+static Segment **segments = NULL;       // indexed by segment number
+static int segment_capacity = 0;
+static pthread_rwlock_t segments_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t meta_lock = PTHREAD_MUTEX_INITIALIZER;
+static char log_dir[200];
+
+// Needs no persistence: it is re-derived from the segments at startup
+static atomic_int next_id = 0;
+
+static void segment_path(int segment_no, int archived, char *path, size_t len) {
+    snprintf(path, len, archived ? "%s/archive/seg-%06d.dat" : "%s/seg-%06d.dat",
+             log_dir, segment_no);
+}
+
+static off_t slot_offset(int transaction_id) {
+    return sizeof(SegmentHeader) +
+           (off_t)(transaction_id % TXN_SEGMENT_RECORDS) * sizeof(TransactionRecord);
+}
+
+// Folds one record into the segment bounds. Every update is a max/min, so
+// writing the same record twice (WAL replay) leaves the header unchanged.
+static void note_record_locked(Segment *seg, const TransactionRecord *t) {
+    SegmentHeader *h = &seg->header;
+    int used = t->transactionID % TXN_SEGMENT_RECORDS + 1;
+    if (h->record_count == 0 || t->timestamp < h->min_timestamp) h->min_timestamp = t->timestamp;
+    if (h->record_count == 0 || t->timestamp > h->max_timestamp) h->max_timestamp = t->timestamp;
+    if (h->record_count == 0 || t->accountID < h->min_accountID) h->min_accountID = t->accountID;
+    if (h->record_count == 0 || t->accountID > h->max_accountID) h->max_accountID = t->accountID;
+    if (used > h->record_count) h->record_count = used;
+    seg->dirty = 1;
+}
+
+static void note_next_id(int transaction_id) {
+    int current = atomic_load(&next_id);
+    while (transaction_id >= current &&
+           !atomic_compare_exchange_weak(&next_id, &current, transaction_id + 1))
+        ;
+}
+
+// Rebuilds the header of a segment that was still open for writes
+static int rescan_segment(Segment *seg) {
+    TransactionRecord batch[SCAN_BATCH];
+    off_t offset = sizeof(SegmentHeader);
+    ssize_t n;
+    seg->header.record_count = 0;
+    while ((n = pread(seg->fd, batch, sizeof(batch), offset)) >= (ssize_t)sizeof(TransactionRecord)) {
+        int count = n / sizeof(TransactionRecord);
+        for (int i = 0; i < count; i++)
+            if (batch[i].flags & RECORD_IN_USE) note_record_locked(seg, &batch[i]);
+        offset += (off_t)count * sizeof(TransactionRecord);
+    }
+    return n < 0 ? -1 : 0;
+}
+
+static int reserve_table_locked(int segment_no) {
+    if (segment_no < segment_capacity) return 0;
+    int capacity = segment_capacity ? segment_capacity : 16;
+    while (capacity <= segment_no) capacity *= 2;
+    Segment **table = realloc(segments, capacity * sizeof(Segment *));
+    if (table == NULL) return -1;
+    memset(table + segment_capacity, 0, (capacity - segment_capacity) * sizeof(Segment *));
+    segments = table;
+    segment_capacity = capacity;
+    return 0;
+}
+
+// Caller holds segments_lock exclusively
+static Segment *open_segment_locked(int segment_no, int create) {
+    if (segment_no < segment_capacity && segments[segment_no] != NULL)
+        return segments[segment_no];
+    if (reserve_table_locked(segment_no) != 0) return NULL;
+
+    char path[256];
+    segment_path(segment_no, 0, path, sizeof(path));
+    int fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd == -1) return NULL;
+    Segment *seg = calloc(1, sizeof(Segment));
+    if (seg == NULL) {
+        close(fd);
+        return NULL;
+    }
+    seg->fd = fd;
+
+    int ok;
+    if (pread(fd, &seg->header, sizeof(SegmentHeader), 0) != sizeof(SegmentHeader)) {
+        SegmentHeader header = { .magic = TXN_SEGMENT_MAGIC, .version = DB_FORMAT_VERSION,
+                                 .record_size = sizeof(TransactionRecord),
+                                 .segment_no = segment_no };
+        seg->header = header;
+        ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    } else {
+        // A v1 segment (or a foreign file) needs ./migrate, not a rescan
+        ok = seg->header.magic == TXN_SEGMENT_MAGIC &&
+             seg->header.version == DB_FORMAT_VERSION &&
+             seg->header.record_size == sizeof(TransactionRecord);
+        // Bounds of an unsealed segment may lag its records after a crash
+        if (ok && !seg->header.sealed) ok = rescan_segment(seg) == 0;
+    }
+    if (!ok) {
+        close(fd);
+        free(seg);
+        return NULL;
+    }
+    segments[segment_no] = seg;
+    return seg;
+}
+
+// Returns the segment with segments_lock held shared, or NULL (lock released)
+static Segment *acquire_segment(int segment_no, int create) {
+    if (segment_no < 0) return NULL;
+    pthread_rwlock_rdlock(&segments_lock);
+    if (segment_no < segment_capacity && segments[segment_no] != NULL)
+        return segments[segment_no];
+    pthread_rwlock_unlock(&segments_lock);
+    if (!create) return NULL;
+
+    pthread_rwlock_wrlock(&segments_lock);
+    Segment *seg = open_segment_locked(segment_no, 1);
+    pthread_rwlock_unlock(&segments_lock);
+    if (seg == NULL) return NULL;
+    return acquire_segment(segment_no, 0);
+}
+
+// Opens every segment under dir
+int txlog_open(const char *dir) {
+    snprintf(log_dir, sizeof(log_dir), "%s", dir);
+    if (mkdir(log_dir, 0755) != 0 && errno != EEXIST) return -1;
+
+    DIR *d = opendir(log_dir);
+    if (d == NULL) return -1;
+    int result = 0;
+    struct dirent *entry;
+    pthread_rwlock_wrlock(&segments_lock);
+    while (result == 0 && (entry = readdir(d)) != NULL) {
+        int segment_no;
+        char expected[32];
+        if (sscanf(entry->d_name, "seg-%d.dat", &segment_no) != 1 || segment_no < 0) continue;
+        snprintf(expected, sizeof(expected), "seg-%06d.dat", segment_no);
+        if (strcmp(expected, entry->d_name) != 0) continue;
+
+        Segment *seg = open_segment_locked(segment_no, 0);
+        if (seg == NULL) {
+            result = -1;
+            break;
+        }
+        if (seg->header.record_count > 0)
+            note_next_id(segment_no * TXN_SEGMENT_RECORDS + seg->header.record_count - 1);
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    closedir(d);
+    return result;
+}
+
+int txlog_next_id(void) {
+    return atomic_fetch_add(&next_id, 1);
+}
+
+// Newest id handed out so far, -1 if none
+int txlog_last_id(void) {
+    return atomic_load(&next_id) - 1;
+}
+
+// Writes the record at its slot without forcing it to disk; the WAL
+// already holds it. Rewriting a slot is idempotent.
+int txlog_write(const TransactionRecord *transaction) {
+    Segment *seg = acquire_segment(transaction->transactionID / TXN_SEGMENT_RECORDS, 1);
+    if (seg == NULL) return -1;
+
+    int result = -1;
+    if (!seg->header.sealed &&
+        pwrite(seg->fd, transaction, sizeof(TransactionRecord),
+               slot_offset(transaction->transactionID)) == sizeof(TransactionRecord)) {
+        pthread_mutex_lock(&meta_lock);
+        note_record_locked(seg, transaction);
+        pthread_mutex_unlock(&meta_lock);
+        note_next_id(transaction->transactionID);
+        result = 0;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    return result;
+}
+
+// Writes records sorted by id, one pwrite per run of consecutive ids in
+// the same segment. Stops at the first failure.
+int txlog_write_batch(const TransactionRecord *transactions, int count) {
+    int start = 0;
+    while (start < count) {
+        int first_id = transactions[start].transactionID;
+        int segment_no = first_id / TXN_SEGMENT_RECORDS;
+        int end = start + 1;
+        while (end < count && transactions[end].transactionID == first_id + (end - start) &&
+               transactions[end].transactionID / TXN_SEGMENT_RECORDS == segment_no)
+            end++;
+
+        Segment *seg = acquire_segment(segment_no, 1);
+        if (seg == NULL) return -1;
+        size_t len = (size_t)(end - start) * sizeof(TransactionRecord);
+        int ok = !seg->header.sealed &&
+                 pwrite(seg->fd, &transactions[start], len, slot_offset(first_id)) == (ssize_t)len;
+        if (ok) {
+            pthread_mutex_lock(&meta_lock);
+            for (int i = start; i < end; i++) note_record_locked(seg, &transactions[i]);
+            pthread_mutex_unlock(&meta_lock);
+            note_next_id(transactions[end - 1].transactionID);
+        }
+        pthread_rwlock_unlock(&segments_lock);
+        if (!ok) return -1;
+        start = end;
+    }
+    return 0;
+}
+
+int txlog_read(int transaction_id, TransactionRecord *out) {
+    Segment *seg = acquire_segment(transaction_id / TXN_SEGMENT_RECORDS, 0);
+    if (seg == NULL) return -1;
+    ssize_t n = pread(seg->fd, out, sizeof(TransactionRecord), slot_offset(transaction_id));
+    pthread_rwlock_unlock(&segments_lock);
+    return (n == sizeof(TransactionRecord) && (out->flags & RECORD_IN_USE)) ? 0 : -1;
+}
+
+static int write_header(Segment *seg) {
+    pthread_mutex_lock(&meta_lock);
+    SegmentHeader header = seg->header;
+    seg->dirty = 0;
+    pthread_mutex_unlock(&meta_lock);
+    return pwrite(seg->fd, &header, sizeof(header), 0) == sizeof(header) ? 0 : -1;
+}
+
+// Writes back changed segment headers and forces every open segment to disk
+int txlog_sync(void) {
+    int result = 0;
+    pthread_rwlock_rdlock(&segments_lock);
+    for (int i = 0; i < segment_capacity && result == 0; i++) {
+        Segment *seg = segments[i];
+        if (seg == NULL || seg->header.sealed) continue;
+        if ((seg->dirty && write_header(seg) != 0) || fsync(seg->fd) != 0) result = -1;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    return result;
+}
+
+// Seals every segment wholly below next_id. Call after txlog_sync() once
+// the WAL no longer holds their records (replay never writes to a sealed
+// segment), with committers kept out so no allocated id is still pending.
+int txlog_seal(void) {
+    int active = atomic_load(&next_id) / TXN_SEGMENT_RECORDS;
+
+    // Keep the segment holding next_id on disk, so it survives archival
+    Segment *seg = acquire_segment(active, 1);
+    if (seg == NULL) return -1;
+    pthread_rwlock_unlock(&segments_lock);
+
+    int result = 0;
+    pthread_rwlock_rdlock(&segments_lock);
+    for (int i = 0; i < active && i < segment_capacity && result == 0; i++) {
+        seg = segments[i];
+        if (seg == NULL || seg->header.sealed) continue;
+        pthread_mutex_lock(&meta_lock);
+        seg->header.sealed = 1;
+        pthread_mutex_unlock(&meta_lock);
+        if (write_header(seg) != 0 || fsync(seg->fd) != 0) result = -1;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    return result;
+}
+
+static int segment_overlaps(const SegmentHeader *h, time_t from, time_t to, int account_id) {
+    if (h->record_count == 0) return 0;
+    if (h->max_timestamp < from || h->min_timestamp > to) return 0;
+    if (account_id != TXLOG_ANY_ACCOUNT &&
+        (account_id < h->min_accountID || account_id > h->max_accountID)) return 0;
+    return 1;
+}
+
+// Visits the records with from <= timestamp <= to (and the given account,
+// unless TXLOG_ANY_ACCOUNT) in id order. Segments whose bounds exclude the
+// range are skipped unread. Stops early if visit returns non-zero.
+int txlog_scan(time_t from, time_t to, int account_id, txlog_visit_fn visit, void *arg) {
+    pthread_rwlock_rdlock(&segments_lock);
+    int count = segment_capacity;
+    pthread_rwlock_unlock(&segments_lock);
+
+    int result = 0;
+    TransactionRecord batch[SCAN_BATCH];
+    for (int s = 0; s < count && result == 0; s++) {
+        Segment *seg = acquire_segment(s, 0);
+        if (seg == NULL) continue;
+        pthread_mutex_lock(&meta_lock);
+        SegmentHeader header = seg->header;
+        pthread_mutex_unlock(&meta_lock);
+
+        if (segment_overlaps(&header, from, to, account_id)) {
+            off_t offset = sizeof(SegmentHeader);
+            off_t end = sizeof(SegmentHeader) + (off_t)header.record_count * sizeof(TransactionRecord);
+            ssize_t n;
+            while (result == 0 && offset < end &&
+                   (n = pread(seg->fd, batch, sizeof(batch), offset)) >= (ssize_t)sizeof(TransactionRecord)) {
+                int records = n / sizeof(TransactionRecord);
+                for (int i = 0; i < records && result == 0; i++) {
+                    const TransactionRecord *t = &batch[i];
+                    if (!(t->flags & RECORD_IN_USE) || t->timestamp < from || t->timestamp > to) continue;
+                    if (account_id != TXLOG_ANY_ACCOUNT && t->accountID != account_id) continue;
+                    result = visit(t, arg);
+                }
+                offset += (off_t)records * sizeof(TransactionRecord);
+            }
+        }
+        pthread_rwlock_unlock(&segments_lock);
+    }
+    return result;
+}
+
+// Moves sealed segments whose newest record predates cutoff to dir/archive.
+// Each segment is detached under a brief exclusive hold on the table; the
+// writer only ever touches the active segment, which is never sealed.
+// Returns the number of segments archived, or -1.
+int txlog_archive_before(time_t cutoff) {
+    char archive_dir[256];
+    snprintf(archive_dir, sizeof(archive_dir), "%s/archive", log_dir);
+    if (mkdir(archive_dir, 0755) != 0 && errno != EEXIST) return -1;
+
+    pthread_rwlock_rdlock(&segments_lock);
+    int count = segment_capacity;
+    pthread_rwlock_unlock(&segments_lock);
+
+    int archived = 0;
+    for (int s = 0; s < count; s++) {
+        pthread_rwlock_wrlock(&segments_lock);
+        Segment *seg = segments[s];
+        if (seg == NULL || !seg->header.sealed || seg->header.max_timestamp >= cutoff) {
+            pthread_rwlock_unlock(&segments_lock);
+            continue;
+        }
+        segments[s] = NULL;
+        pthread_rwlock_unlock(&segments_lock);
+
+        char from[256], to[256];
+        segment_path(s, 0, from, sizeof(from));
+        segment_path(s, 1, to, sizeof(to));
+        close(seg->fd);
+        free(seg);
+        if (rename(from, to) != 0) return -1;
+        archived++;
+    }
+    return archived;
+}
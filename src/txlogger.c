@@ -0,0 +1,199 @@
+/* src/txlogger.c */
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "txlogger.h"
+#include "txlog.h"
+#include "metrics.h"
+
+#define LOGGER_BATCH 1024
+#define LOGGER_IDLE_WAIT_MS 10
+
+// Bounded multi-producer, single-consumer ring. A cell is free for the
+// producer that claimed position p when its sequence equals p, and ready
+// for the logger once the producer has stored p + 1.
+typedef struct {
+    atomic_ulong sequence;
+    TransactionRecord record;
+} Cell;
+
+static TxLoggerConfig config = { 0, 0, 0 };
+static Cell *cells = NULL;
+static unsigned long mask = 0;
+static atomic_ulong enqueue_pos = 0;   // next position a producer claims
+static unsigned long dequeue_pos = 0;  // logger thread only
+static atomic_ulong written_pos = 0;   // every position below it is in the segment log
+static atomic_int write_failed = 0;    // sticky: a queued record could not be written
+
+// Only used to sleep and wake; the queue itself never takes it
+static pthread_mutex_t logger_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int logger_idle = 0;
+
+static int enqueue(const TransactionRecord *transaction) {
+    unsigned long pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    Cell *cell;
+    while (1) {
+        cell = &cells[pos & mask];
+        unsigned long sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long diff = (long)(sequence - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;   // full: the logger has not freed this cell yet
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->record = *transaction;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+// Takes up to max ready records, in queue order
+static int dequeue_batch(TransactionRecord *out, int max) {
+    int count = 0;
+    while (count < max) {
+        Cell *cell = &cells[dequeue_pos & mask];
+        unsigned long sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence != dequeue_pos + 1) break;   // empty, or claimed but not yet filled
+        out[count++] = cell->record;
+        atomic_store_explicit(&cell->sequence, dequeue_pos + mask + 1, memory_order_release);
+        dequeue_pos++;
+    }
+    return count;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    int x = ((const TransactionRecord *)a)->transactionID;
+    int y = ((const TransactionRecord *)b)->transactionID;
+    return (x > y) - (x < y);
+}
+
+static void wait_for_work(void) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += LOGGER_IDLE_WAIT_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&logger_lock);
+    atomic_store(&logger_idle, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    // Re-check after announcing: a producer that published before seeing
+    // logger_idle will not signal. The timeout is only a backstop.
+    Cell *cell = &cells[dequeue_pos & mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != dequeue_pos + 1)
+        pthread_cond_timedwait(&work_cond, &logger_lock, &until);
+    atomic_store(&logger_idle, 0);
+    pthread_mutex_unlock(&logger_lock);
+}
+
+static void *logger_main(void *arg) {
+    (void)arg;
+    TransactionRecord *batch = malloc(LOGGER_BATCH * sizeof(TransactionRecord));
+    if (batch == NULL) return NULL;
+
+    while (1) {
+        int count = dequeue_batch(batch, LOGGER_BATCH);
+        if (count == 0) {
+            wait_for_work();
+            continue;
+        }
+        metrics_set(GAUGE_TXLOG_QUEUE_DEPTH, txlogger_depth());
+
+        // Ids were assigned before the race to enqueue, so sort to turn
+        // the batch into runs of adjacent slots
+        qsort(batch, count, sizeof(TransactionRecord), compare_ids);
+        if (txlog_write_batch(batch, count) != 0 ||
+            (config.fsync_batches && txlog_sync() != 0))
+            atomic_store(&write_failed, 1);
+        metrics_add(METRIC_TXLOG_BATCHES, 1);
+
+        pthread_mutex_lock(&logger_lock);
+        atomic_store(&written_pos, dequeue_pos);
+        pthread_cond_broadcast(&written_cond);
+        pthread_mutex_unlock(&logger_lock);
+    }
+    return NULL;
+}
+
+int txlogger_start(const TxLoggerConfig *new_config) {
+    config = *new_config;
+    if (!config.threaded) return 0;
+
+    unsigned long capacity = 2;
+    while (capacity < (unsigned long)config.queue_capacity) capacity *= 2;
+    cells = malloc(capacity * sizeof(Cell));
+    if (cells == NULL) return -1;
+    for (unsigned long i = 0; i < capacity; i++)
+        atomic_init(&cells[i].sequence, i);
+    mask = capacity - 1;
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, logger_main, NULL) != 0) {
+        free(cells);
+        cells = NULL;
+        return -1;
+    }
+    pthread_detach(th);
+    return 0;
+}
+
+// Hands committed records to the logger. A record the queue has no room
+// for is counted as a drop and written on the caller's thread instead, so
+// history is never lost, only delayed.
+int txlogger_submit(const TransactionRecord *transactions, int count) {
+    if (cells == NULL) {
+        for (int i = 0; i < count; i++)
+            if (txlog_write(&transactions[i]) != 0) return -1;
+        return 0;
+    }
+
+    int result = 0;
+    int queued = 0;
+    for (int i = 0; i < count; i++) {
+        if (enqueue(&transactions[i]) == 0) {
+            queued++;
+            continue;
+        }
+        metrics_add(METRIC_TXLOG_DROPS, 1);
+        if (txlog_write(&transactions[i]) != 0) result = -1;
+    }
+    if (queued == 0) return result;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&logger_idle)) {
+        pthread_mutex_lock(&logger_lock);
+        pthread_cond_signal(&work_cond);
+        pthread_mutex_unlock(&logger_lock);
+    }
+    return result;
+}
+
+// Waits until every record submitted before the call is in the segment
+// log. Returns -1 if the logger has ever failed a write, so a checkpoint
+// keeps the WAL that still holds the record.
+int txlogger_drain(void) {
+    if (cells != NULL) {
+        unsigned long target = atomic_load(&enqueue_pos);
+        if (atomic_load(&written_pos) < target) {
+            pthread_mutex_lock(&logger_lock);
+            while (atomic_load(&written_pos) < target)
+                pthread_cond_wait(&written_cond, &logger_lock);
+            pthread_mutex_unlock(&logger_lock);
+        }
+    }
+    return atomic_load(&write_failed) ? -1 : 0;
+}
+
+// Records queued or being written
+long txlogger_depth(void) {
+    return (long)(atomic_load(&enqueue_pos) - atomic_load(&written_pos));
+}
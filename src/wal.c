@@ -0,0 +1,159 @@
+/* src/wal.c */
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wal.h"
+#include "commit.h"
+#include "format.h"
+
+#define WAL_MAGIC 0x344C4157u   // "WAL4": WAL3 with 32-bit account versions
+#define WAL_MAGIC_V3 0x334C4157u // WAL2 plus an optional idempotency key
+#define WAL_MAGIC_V2 0x324C4157u // v2 Account/TransactionRecord images only
+#define WAL_MAGIC_V1 0x314C4157u
+#define WAL_MAX_RECORDS 65536
+
+typedef struct {
+    uint32_t magic;
+    uint32_t account_count;
+    uint32_t transaction_count;
+    uint32_t checksum;          // FNV-1a over the payload
+    uint32_t key_count;         // 0 or 1 IdempotencyRecord after the transactions
+} WalEntryHeader;
+
+// A WAL2 entry header is the WAL3 one without key_count
+#define WAL_V2_HEADER_SIZE offsetof(WalEntryHeader, key_count)
+
+static int wal_fd = -1;
+static pthread_mutex_t wal_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t wal_checksum(const unsigned char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int wal_open(const char *path) {
+    wal_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    return wal_fd == -1 ? -1 : 0;
+}
+
+long wal_size(void) {
+    struct stat st;
+    if (wal_fd == -1 || fstat(wal_fd, &st) == -1) return -1;
+    return st.st_size;
+}
+
+// Appends one entry, without forcing it to disk: wal_sync() does that, and
+// once it returns 0 the change survives a crash, so the data files
+// themselves can be written lazily. Entries reach the log in append order,
+// so a sync also covers every entry appended before it.
+// `key` (may be NULL) is the idempotency key of the request making it.
+int wal_append(const Account *accounts, int account_count,
+               const TransactionRecord *transactions, int transaction_count,
+               const IdempotencyRecord *key) {
+    size_t account_bytes = (size_t)account_count * sizeof(Account);
+    size_t transaction_bytes = (size_t)transaction_count * sizeof(TransactionRecord);
+    size_t payload = account_bytes + transaction_bytes + (key ? sizeof(IdempotencyRecord) : 0);
+    unsigned char *entry = malloc(sizeof(WalEntryHeader) + payload);
+    if (entry == NULL) return -1;
+
+    WalEntryHeader *hdr = (WalEntryHeader *)entry;
+    unsigned char *p = entry + sizeof(WalEntryHeader);
+    memcpy(p, accounts, account_bytes);
+    memcpy(p + account_bytes, transactions, transaction_bytes);
+    if (key) memcpy(p + account_bytes + transaction_bytes, key, sizeof(IdempotencyRecord));
+    hdr->magic = WAL_MAGIC;
+    hdr->account_count = account_count;
+    hdr->transaction_count = transaction_count;
+    hdr->key_count = key ? 1 : 0;
+    hdr->checksum = wal_checksum(entry + sizeof(WalEntryHeader), payload);
+
+    // One write() per entry keeps entries contiguous under O_APPEND; the
+    // sync happens outside the lock so concurrent committers can share it.
+    pthread_mutex_lock(&wal_lock);
+    ssize_t n = write(wal_fd, entry, sizeof(WalEntryHeader) + payload);
+    pthread_mutex_unlock(&wal_lock);
+    free(entry);
+    return n == (ssize_t)(sizeof(WalEntryHeader) + payload) ? 0 : -1;
+}
+
+// Makes every entry appended so far durable, as the durability mode says
+int wal_sync(void) {
+    return commit_sync(wal_fd);
+}
+
+// Feeds every complete entry to `apply`, in log order. Stops at the first
+// torn or corrupt entry, which can only be the tail of an interrupted append.
+// A v1 log is refused rather than skipped: ./migrate applies it. WAL2 and
+// WAL3 entries, left by a crash before an upgrade, replay with their
+// narrow account images widened; WAL2 ones carry no key.
+int wal_replay(wal_apply_fn apply) {
+    off_t offset = 0;
+    int replayed = 0;
+    WalEntryHeader hdr;
+    while (pread(wal_fd, &hdr, WAL_V2_HEADER_SIZE, offset) == (ssize_t)WAL_V2_HEADER_SIZE) {
+        if (hdr.magic == WAL_MAGIC_V1) return -1;
+        int has_key_count = hdr.magic == WAL_MAGIC || hdr.magic == WAL_MAGIC_V3;
+        if (!has_key_count && hdr.magic != WAL_MAGIC_V2) break;
+        size_t header_size = has_key_count ? sizeof(hdr) : WAL_V2_HEADER_SIZE;
+        hdr.key_count = 0;
+        if (has_key_count &&
+            pread(wal_fd, &hdr.key_count, sizeof(hdr.key_count), offset + WAL_V2_HEADER_SIZE) !=
+            sizeof(hdr.key_count))
+            break;
+        if (hdr.account_count > WAL_MAX_RECORDS || hdr.transaction_count > WAL_MAX_RECORDS ||
+            hdr.key_count > 1)
+            break;
+        size_t account_size = hdr.magic == WAL_MAGIC ? sizeof(Account) : sizeof(AccountV2Narrow);
+        size_t account_bytes = (size_t)hdr.account_count * account_size;
+        size_t transaction_bytes = (size_t)hdr.transaction_count * sizeof(TransactionRecord);
+        size_t payload = account_bytes + transaction_bytes + hdr.key_count * sizeof(IdempotencyRecord);
+        unsigned char *data = malloc(payload ? payload : 1);
+        if (data == NULL) return -1;
+        if (pread(wal_fd, data, payload, offset + header_size) != (ssize_t)payload ||
+            wal_checksum(data, payload) != hdr.checksum) {
+            free(data);
+            break;
+        }
+        const Account *accounts = (const Account *)data;
+        Account *widened = NULL;
+        if (account_size != sizeof(Account)) {
+            widened = malloc(hdr.account_count ? hdr.account_count * sizeof(Account) : 1);
+            if (widened == NULL) {
+                free(data);
+                return -1;
+            }
+            for (uint32_t i = 0; i < hdr.account_count; i++)
+                widen_account((const AccountV2Narrow *)data + i, &widened[i]);
+            accounts = widened;
+        }
+        const IdempotencyRecord *key = hdr.key_count
+            ? (const IdempotencyRecord *)(data + account_bytes + transaction_bytes) : NULL;
+        int result = apply(accounts, hdr.account_count,
+                           (const TransactionRecord *)(data + account_bytes), hdr.transaction_count,
+                           key);
+        free(widened);
+        free(data);
+        if (result != 0) return -1;
+        offset += header_size + payload;
+        replayed++;
+    }
+    return replayed;
+}
+
+// Caller guarantees every logged change has reached the data files on disk
+int wal_truncate(void) {
+    pthread_mutex_lock(&wal_lock);
+    int result = ftruncate(wal_fd, 0);
+    if (result == 0) result = fsync(wal_fd);
+    pthread_mutex_unlock(&wal_lock);
+    return result;
+}
@@ -0,0 +1,79 @@
+/* src/workpool.c */
+#include <stdlib.h>
+#include <pthread.h>
+#include "workpool.h"
+#include "metrics.h"
+
+typedef struct {
+    work_fn fn;
+    void *arg;
+    long queued_usec;
+} Job;
+
+typedef struct {
+    Job *jobs;                 // ring of queue_depth slots
+    int queue_depth;
+    int head;                  // next job a worker takes
+    int count;
+    enum Gauge queue_gauge;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+} Pool;
+
+static Pool pools[POOL_COUNT] = {
+    [POOL_REQUESTS]    = { .queue_gauge = GAUGE_REQUEST_QUEUE,
+                           .lock = PTHREAD_MUTEX_INITIALIZER, .work_cond = PTHREAD_COND_INITIALIZER },
+    [POOL_INTERACTIVE] = { .queue_gauge = GAUGE_INTERACTIVE_QUEUE,
+                           .lock = PTHREAD_MUTEX_INITIALIZER, .work_cond = PTHREAD_COND_INITIALIZER }
+};
+
+static void *worker_main(void *arg) {
+    Pool *p = arg;
+    while (1) {
+        pthread_mutex_lock(&p->lock);
+        while (p->count == 0)
+            pthread_cond_wait(&p->work_cond, &p->lock);
+        Job job = p->jobs[p->head];
+        p->head = (p->head + 1) % p->queue_depth;
+        p->count--;
+        metrics_set(p->queue_gauge, p->count);
+        pthread_mutex_unlock(&p->lock);
+
+        metrics_observe(LATENCY_QUEUE_WAIT, metrics_now_usec() - job.queued_usec);
+        job.fn(job.arg);
+    }
+    return NULL;
+}
+
+int workpool_start(enum WorkPool pool, int workers, int depth) {
+    Pool *p = &pools[pool];
+    if (workers < 1 || depth < 1) return -1;
+    p->jobs = calloc(depth, sizeof(Job));
+    if (p->jobs == NULL) return -1;
+    p->queue_depth = depth;
+    for (int i = 0; i < workers; i++) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, worker_main, p) != 0) return -1;
+        pthread_detach(th);
+    }
+    return 0;
+}
+
+// Queues fn(arg) for one of the pool's workers. Returns -1, without
+// queueing, when the queue is full; the caller tells its client to come
+// back later.
+int workpool_submit(enum WorkPool pool, work_fn fn, void *arg) {
+    Pool *p = &pools[pool];
+    pthread_mutex_lock(&p->lock);
+    if (p->count == p->queue_depth) {
+        pthread_mutex_unlock(&p->lock);
+        metrics_add(METRIC_REQUESTS_REJECTED, 1);
+        return -1;
+    }
+    p->jobs[(p->head + p->count) % p->queue_depth] = (Job){ fn, arg, metrics_now_usec() };
+    p->count++;
+    metrics_set(p->queue_gauge, p->count);
+    pthread_cond_signal(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
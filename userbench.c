@@ -0,0 +1,150 @@
+/* Username lookup benchmark */
+/*                                                                       */
+/* For each table size, writes a users.dat of that many users into a     */
+/* scratch directory, builds the in-memory index, and times              */
+/* find_user_by_username() on random existing names. For comparison it  */
+/* also times the lookup the index replaced: open users.dat and read()   */
+/* every record until the name matches.                                  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "./include/types.h"
+#include "./include/database.h"
+#include "./include/metrics.h"
+
+#define WRITE_BATCH 4096
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--users=N[,N...]] [--lookups=N] [--scan-lookups=N]\n"
+            "Writes userbench.tmp/ in the current directory and removes it afterwards.\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static void fail(const char *what) {
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+static void make_name(char *name, int id) {
+    snprintf(name, MAX_USERNAME_LEN, "user%08d", id);
+}
+
+static void write_users(int count) {
+    int fd = open("data/users.dat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) fail("data/users.dat");
+    UserHeader header = { .magic = DB_MAGIC, .version = DB_FORMAT_VERSION,
+                          .record_size = sizeof(User), .next_id = count, .record_count = count };
+    static User batch[WRITE_BATCH];
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) fail("write");
+    for (int done = 0; done < count; ) {
+        int n = count - done < WRITE_BATCH ? count - done : WRITE_BATCH;
+        memset(batch, 0, n * sizeof(User));
+        for (int i = 0; i < n; i++) {
+            batch[i].id = done + i;
+            batch[i].role = ROLE_CUSTOMER;
+            batch[i].active = 1;
+            batch[i].flags = RECORD_IN_USE;
+            make_name(batch[i].username, done + i);
+            strcpy(batch[i].password_hash, "pw");
+        }
+        if (write(fd, batch, n * sizeof(User)) != (ssize_t)(n * sizeof(User))) fail("write");
+        done += n;
+    }
+    close(fd);
+}
+
+// The lookup before the index: a fresh fd and a read() per record
+static int scan_lookup(const char *username) {
+    int fd = open("data/users.dat", O_RDONLY);
+    if (fd == -1) return -1;
+    lseek(fd, sizeof(UserHeader), SEEK_SET);
+    User u;
+    int found = -1;
+    while (read(fd, &u, sizeof(User)) == sizeof(User)) {
+        if (strcmp(u.username, username) == 0) {
+            found = u.id;
+            break;
+        }
+    }
+    close(fd);
+    return found;
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Times `lookups` lookups of random names; prints average, p50 and p99
+static void time_lookups(const char *label, int users, int lookups, int scan) {
+    long *ns = malloc(lookups * sizeof(long));
+    if (ns == NULL) fail("malloc");
+    char name[MAX_USERNAME_LEN];
+    double total = 0;
+    for (int i = 0; i < lookups; i++) {
+        int id = (int)(((long)rand() * RAND_MAX + rand()) % users);
+        make_name(name, id);
+        struct timespec a, b;
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        int found;
+        if (scan) {
+            found = scan_lookup(name);
+        } else {
+            User *u = find_user_by_username(name);
+            found = u ? u->id : -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        if (found != id) {
+            fprintf(stderr, "lookup of %s returned %d\n", name, found);
+            exit(EXIT_FAILURE);
+        }
+        ns[i] = (b.tv_sec - a.tv_sec) * 1000000000L + (b.tv_nsec - a.tv_nsec);
+        total += ns[i];
+    }
+    qsort(ns, lookups, sizeof(long), compare_long);
+    printf("%10d  %-6s %8d %14.0f %14ld %14ld\n", users, label, lookups, total / lookups,
+           ns[lookups / 2], ns[(long)(lookups * 0.99)]);
+    fflush(stdout);
+    free(ns);
+}
+
+int main(int argc, char *argv[]) {
+    char sizes[256] = "10000,1000000,10000000";
+    int lookups = 100000, scan_lookups = 20;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--users=", 8) == 0)               snprintf(sizes, sizeof(sizes), "%s", argv[i] + 8);
+        else if (strncmp(argv[i], "--lookups=", 10) == 0)       lookups = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--scan-lookups=", 15) == 0)  scan_lookups = atoi(argv[i] + 15);
+        else usage(argv[0]);
+    }
+    if (lookups <= 0 || scan_lookups < 0) usage(argv[0]);
+
+    if (mkdir("userbench.tmp", 0755) != 0 || chdir("userbench.tmp") != 0 || mkdir("data", 0755) != 0)
+        fail("userbench.tmp");
+    // Each size rewrites users.dat in place; the store sees the new length
+    if (open_record_stores(0) != 0) fail("open_record_stores");
+    printf("%10s  %-6s %8s %14s %14s %14s\n", "users", "lookup", "count", "avg ns", "p50 ns", "p99 ns");
+    for (char *size = strtok(sizes, ","); size != NULL; size = strtok(NULL, ",")) {
+        int users = atoi(size);
+        if (users <= 0) usage(argv[0]);
+        write_users(users);
+        long start = metrics_now_usec();
+        if (build_user_index() != 0) fail("build_user_index");
+        fprintf(stderr, "%d users: index built in %.2f s\n", users, (metrics_now_usec() - start) / 1e6);
+        time_lookups("index", users, lookups, 0);
+        if (scan_lookups > 0) time_lookups("scan", users, scan_lookups, 1);
+    }
+    unlink("data/users.dat");
+    unlink("data/accounts.dat");
+    unlink("data/loans.dat");
+    unlink("data/feedback.dat");
+    unlink("data/sessions.dat");
+    if (chdir("..") != 0 || rmdir("userbench.tmp/data") != 0 || rmdir("userbench.tmp") != 0)
+        fail("removing userbench.tmp");
+    return 0;
+}